@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "framebuffer.hpp"
+#include "logger.hpp"
+#include "tool_args.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+    chip8_bench: runs every ROM in a directory for a fixed number of frames
+    and reports, as JSON, the final display hash, instructions per second,
+    nanoseconds per frame and peak resident memory of each one.
+
+    Usage: chip8_bench <rom-dir> [--frames N] [--cpf N] [--seed N] [--mode M] [--repeat N]
+                                 [--json F] [--golden F] [--baseline F] [--tolerance P]
+
+    --frames N     frames to run each ROM for (default 3000)
+    --cpf N        cycles per frame (default 1000)
+    --seed N       seed for CXNN (default 1)
+    --mode M       interpreter, cached, block or jit (default cached)
+    --repeat N     runs per ROM; the fastest one is reported (default 5)
+    --json F       write the report to F instead of stdout
+    --golden F     check each ROM's display hash against the report F;
+                   exits with 1 on any mismatch
+    --baseline F   compare instructions per second against the report F;
+                   exits with 1 if any ROM got slower by more than the
+                   tolerance
+    --tolerance P  allowed slowdown against the baseline, in percent
+                   (default 5)
+
+    No keys are pressed, so ROMs that wait for input sit in FX0A; the hash
+    still has to match, and the idle cycles are not counted as instructions.
+    Each ROM runs with the quirk profile its file extension selects
+    (quirks::ForRom).
+    A report is also a valid golden or baseline file: every ROM is on a line
+    of its own, which is what the comparisons read back.
+*/
+
+namespace
+{
+    constexpr uint64_t DEFAULT_FRAMES = 3000;
+    constexpr uint64_t DEFAULT_CPF = 1000;
+    constexpr uint64_t DEFAULT_SEED = 1;
+    constexpr uint64_t DEFAULT_REPEAT = 5;
+    constexpr uint64_t DEFAULT_TOLERANCE = 5;
+
+    struct Settings
+    {
+        uint64_t frames = DEFAULT_FRAMES;
+        uint64_t cpf = DEFAULT_CPF;
+        uint64_t seed = DEFAULT_SEED;
+        uint64_t repeat = DEFAULT_REPEAT;
+        ExecutionMode mode = ExecutionMode::Cached;
+        std::string mode_name = "cached";
+    };
+
+    struct RomResult
+    {
+        std::string name;
+        uint64_t hash = 0;
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        double seconds = 0.0;       // fastest run
+        uint64_t peak_rss_kb = 0;
+        bool deterministic = true;  // every run ended on the same display
+    };
+
+    // A ROM line read back from an earlier report
+    struct Reference
+    {
+        uint64_t hash = 0;
+        double ips = 0.0;
+    };
+
+    struct Report
+    {
+        uint64_t frames = 0;
+        uint64_t cpf = 0;
+        uint64_t seed = 0;
+        std::map<std::string, Reference> roms;
+    };
+
+    void Usage()
+    {
+        logger::Error("Usage: chip8_bench <rom-dir> [--frames N] [--cpf N] [--seed N] [--mode M] [--repeat N] "
+                      "[--json F] [--golden F] [--baseline F] [--tolerance P]");
+    }
+
+    double Ips(const RomResult& r)
+    {
+        return r.seconds > 0.0 ? static_cast<double>(r.instructions) / r.seconds : 0.0;
+    }
+
+    /*
+        Peak resident set of the process. On Linux the high-water mark is
+        reset before each ROM, so the value belongs to that ROM alone;
+        elsewhere it is the peak of the whole process so far.
+    */
+    void ResetPeakRss()
+    {
+#if defined(__linux__)
+        if (FILE* file = fopen("/proc/self/clear_refs", "w"))
+        {
+            fputs("5", file);
+            fclose(file);
+        }
+#endif
+    }
+
+    uint64_t PeakRssKb()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.PeakWorkingSetSize / 1024;
+        }
+        return 0;
+#else
+#if defined(__linux__)
+        if (FILE* file = fopen("/proc/self/status", "r"))
+        {
+            char line[256];
+            unsigned long long kb = 0;
+            bool found = false;
+            while (!found && fgets(line, sizeof(line), file) != nullptr)
+            {
+                found = std::sscanf(line, "VmHWM: %llu kB", &kb) == 1;
+            }
+            fclose(file);
+            if (found)
+            {
+                return kb;
+            }
+        }
+#endif
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024;   // bytes on macOS
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+    }
+
+    bool RunRom(const std::filesystem::path& path, const Settings& settings, RomResult& result)
+    {
+        result.name = path.filename().string();
+        ResetPeakRss();
+
+        Chip8 chip8;
+        chip8.SetExecutionMode(settings.mode);
+        chip8.SetQuirks(quirks::ForRom(path.string()));
+        for (uint64_t run = 0; run < settings.repeat; run++)
+        {
+            if (!chip8.LoadROM(path.string()))
+            {
+                return false;
+            }
+            chip8.SetSeed(settings.seed);
+            chip8.SetClockRate(static_cast<uint32_t>(settings.cpf * Chip8::FRAME_HZ));
+
+            uint64_t instructions = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t f = 0; f < settings.frames; f++)
+            {
+                instructions += chip8.RunFrame().executed;
+            }
+            const double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            const uint64_t hash = chip8.GetGfxHash();
+            if (run == 0)
+            {
+                result.hash = hash;
+                result.instructions = instructions;
+                result.cycles = chip8.GetCycles();
+                result.seconds = seconds;
+            }
+            else
+            {
+                result.deterministic = result.deterministic && hash == result.hash && instructions == result.instructions;
+                result.seconds = std::min(result.seconds, seconds);
+            }
+        }
+
+        result.peak_rss_kb = PeakRssKb();
+        return true;
+    }
+
+    std::string Json(const Settings& settings, const std::vector<RomResult>& results, const Report* baseline)
+    {
+        uint64_t instructions = 0;
+        double seconds = 0.0;
+        for (const RomResult& r : results)
+        {
+            instructions += r.instructions;
+            seconds += r.seconds;
+        }
+
+        std::string out = "{\n";
+        out += fmt::format("  \"frames\": {},\n", settings.frames);
+        out += fmt::format("  \"cpf\": {},\n", settings.cpf);
+        out += fmt::format("  \"seed\": {},\n", settings.seed);
+        out += fmt::format("  \"mode\": \"{}\",\n", settings.mode_name);
+        out += "  \"roms\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const RomResult& r = results[i];
+            out += fmt::format("    {{\"rom\": \"{}\", \"hash\": \"{:016x}\", \"instructions\": {}, \"cycles\": {}, "
+                               "\"seconds\": {:.6f}, \"ips\": {:.0f}, \"ns_per_frame\": {:.1f}, \"peak_rss_kb\": {}",
+                r.name, r.hash, r.instructions, r.cycles, r.seconds, Ips(r),
+                r.seconds * 1e9 / static_cast<double>(settings.frames), r.peak_rss_kb);
+            if (baseline != nullptr)
+            {
+                const auto it = baseline->roms.find(r.name);
+                if (it != baseline->roms.end() && it->second.ips > 0.0)
+                {
+                    out += fmt::format(", \"baseline_ips\": {:.0f}, \"change_pct\": {:.1f}",
+                        it->second.ips, (Ips(r) / it->second.ips - 1.0) * 100.0);
+                }
+            }
+            out += (i + 1 < results.size()) ? "},\n" : "}\n";
+        }
+        out += "  ],\n";
+        out += fmt::format("  \"total\": {{\"instructions\": {}, \"seconds\": {:.6f}, \"ips\": {:.0f}}}\n",
+            instructions, seconds, seconds > 0.0 ? static_cast<double>(instructions) / seconds : 0.0);
+        out += "}\n";
+        return out;
+    }
+
+    // Finds `"key": value` on a line; string values lose their quotes
+    bool Field(const std::string& line, std::string_view key, std::string& value)
+    {
+        const std::string pattern = fmt::format("\"{}\":", key);
+        size_t pos = line.find(pattern);
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+        pos = line.find_first_not_of(' ', pos + pattern.size());
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+        if (line[pos] == '"')
+        {
+            const size_t end = line.find('"', pos + 1);
+            if (end == std::string::npos)
+            {
+                return false;
+            }
+            value = line.substr(pos + 1, end - pos - 1);
+        }
+        else
+        {
+            const size_t end = line.find_first_of(",}", pos);
+            value = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        }
+        return true;
+    }
+
+    bool ReadReport(const std::string& path, Report& report)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            logger::Error("Failed to open report: {}", path);
+            return false;
+        }
+
+        std::string line;
+        std::string value;
+        while (std::getline(file, line))
+        {
+            if (Field(line, "rom", value))
+            {
+                Reference ref;
+                std::string hash;
+                std::string ips;
+                if (!Field(line, "hash", hash) || !Field(line, "ips", ips))
+                {
+                    logger::Error("Malformed ROM entry in {}: {}", path, line);
+                    return false;
+                }
+                ref.hash = std::strtoull(hash.c_str(), nullptr, 16);
+                ref.ips = std::strtod(ips.c_str(), nullptr);
+                report.roms[value] = ref;
+            }
+            else if (Field(line, "frames", value))
+            {
+                tool_args::ParseCount(value, report.frames);
+            }
+            else if (Field(line, "cpf", value))
+            {
+                tool_args::ParseCount(value, report.cpf);
+            }
+            else if (Field(line, "seed", value))
+            {
+                tool_args::ParseCount(value, report.seed);
+            }
+        }
+        return true;
+    }
+
+    // Hashes and instruction counts only mean something for the same run length, clock and seed
+    bool SameRun(const Report& report, const Settings& settings, const std::string& path)
+    {
+        if (report.frames != settings.frames || report.cpf != settings.cpf || report.seed != settings.seed)
+        {
+            logger::Error("{} was made with --frames {} --cpf {} --seed {}; this run uses --frames {} --cpf {} --seed {}",
+                path, report.frames, report.cpf, report.seed, settings.frames, settings.cpf, settings.seed);
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    logger::StartAsync();
+
+    const std::filesystem::path rom_dir = argv[1];
+    Settings settings;
+    std::string json_path;
+    std::string golden_path;
+    std::string baseline_path;
+    uint64_t tolerance = DEFAULT_TOLERANCE;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            Usage();
+            return 1;
+        }
+
+        if (arg == "--mode")
+        {
+            settings.mode_name = argv[++i];
+            if (!tool_args::ParseMode(settings.mode_name, settings.mode))
+            {
+                logger::Error("Unknown execution mode: {}", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--json" || arg == "--golden" || arg == "--baseline")
+        {
+            std::string& path = (arg == "--json") ? json_path : (arg == "--golden") ? golden_path : baseline_path;
+            path = argv[++i];
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (!tool_args::ParseCount(argv[i + 1], value))
+        {
+            logger::Error("Invalid number for {}: {}", arg, argv[i + 1]);
+            return 1;
+        }
+        i++;
+
+        if (arg == "--frames")
+        {
+            settings.frames = value;
+        }
+        else if (arg == "--cpf")
+        {
+            settings.cpf = value;
+        }
+        else if (arg == "--seed")
+        {
+            settings.seed = value;
+        }
+        else if (arg == "--repeat")
+        {
+            settings.repeat = value;
+        }
+        else if (arg == "--tolerance")
+        {
+            tolerance = value;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (settings.frames == 0 || settings.repeat == 0)
+    {
+        logger::Error("--frames and --repeat must be at least 1");
+        return 1;
+    }
+    if (settings.cpf == 0 || settings.cpf > UINT32_MAX / Chip8::FRAME_HZ)
+    {
+        logger::Error("--cpf is out of range: {}", settings.cpf);
+        return 1;
+    }
+
+    Report golden;
+    Report baseline;
+    if (!golden_path.empty() && (!ReadReport(golden_path, golden) || !SameRun(golden, settings, golden_path)))
+    {
+        return 1;
+    }
+    if (!baseline_path.empty() && (!ReadReport(baseline_path, baseline) || !SameRun(baseline, settings, baseline_path)))
+    {
+        return 1;
+    }
+
+    std::error_code error;
+    std::vector<std::filesystem::path> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(rom_dir, error))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path());
+        }
+    }
+    if (error || roms.empty())
+    {
+        logger::Error("No ROMs found in {}", rom_dir.string());
+        return 1;
+    }
+    std::sort(roms.begin(), roms.end());
+
+    std::vector<RomResult> results;
+    for (const auto& path : roms)
+    {
+        RomResult result;
+        if (!RunRom(path, settings, result))
+        {
+            return 1;
+        }
+        results.push_back(result);
+    }
+
+    const std::string json = Json(settings, results, baseline_path.empty() ? nullptr : &baseline);
+    if (json_path.empty())
+    {
+        fmt::print("{}", json);
+    }
+    else
+    {
+        std::ofstream file(json_path);
+        if (!(file << json))
+        {
+            logger::Error("Failed to write report: {}", json_path);
+            return 1;
+        }
+    }
+
+    bool ok = true;
+    for (const RomResult& r : results)
+    {
+        if (!r.deterministic)
+        {
+            logger::Error("{}: runs with the same seed ended differently", r.name);
+            ok = false;
+        }
+
+        if (!golden_path.empty())
+        {
+            const auto it = golden.roms.find(r.name);
+            if (it == golden.roms.end())
+            {
+                logger::Warn("{}: no golden hash", r.name);
+            }
+            else if (it->second.hash != r.hash)
+            {
+                logger::Error("{}: display hash {:016x}, golden {:016x}", r.name, r.hash, it->second.hash);
+                ok = false;
+            }
+        }
+
+        if (!baseline_path.empty())
+        {
+            const auto it = baseline.roms.find(r.name);
+            if (it == baseline.roms.end() || it->second.ips <= 0.0)
+            {
+                logger::Warn("{}: not in the baseline", r.name);
+                continue;
+            }
+            const double change = (Ips(r) / it->second.ips - 1.0) * 100.0;
+            if (change < -static_cast<double>(tolerance))
+            {
+                logger::Error("{}: {:.0f} instructions/sec, {:.1f}% below the baseline's {:.0f}",
+                    r.name, Ips(r), -change, it->second.ips);
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
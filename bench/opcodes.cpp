@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "tool_args.hpp"
+
+/*
+    chip8_opbench: times the interpreter's opcode handlers one family at a
+    time, to show which of Execute_0x0 ... Execute_0xF dominate.
+
+    Usage: chip8_opbench [--samples N] [--passes N] [--filter S] [--json F]
+
+    --samples N  timed samples per case (default 25)
+    --passes N   passes over the case's stream per sample (default 200)
+    --filter S   only run cases whose name contains S
+    --json F     also write the results to F
+
+    Each case is a synthetic stream of STREAM_OPS opcodes that is fed to
+    Chip8::ExecuteOpcode, so only Decode, the Execute switch and the handler
+    are measured: no fetch from memory, no clock, no display wait. Registers,
+    I and the display are set up before every pass, outside the timed part,
+    so a pass always starts from the same state. Operands rotate through the
+    registers to avoid one long dependency chain.
+
+    Every sample gives one ns/op figure; the table shows their mean, standard
+    deviation, minimum and median. Call and return are timed as a pair, so
+    their figure is the average of the two.
+*/
+
+namespace
+{
+    constexpr int STREAM_OPS = 1024;
+    constexpr uint64_t DEFAULT_SAMPLES = 25;
+    constexpr uint64_t DEFAULT_PASSES = 200;
+    constexpr uint64_t WARMUP_PASSES = 16;
+
+    struct Setup
+    {
+        uint8_t v = 0;          // value of V0-VE
+        uint8_t x = 0;          // V0 and V1 also serve as DXYN's coordinates
+        uint8_t y = 0;
+        uint16_t i = 0x300;
+        uint8_t key = 0xFF;     // key held down, if any
+        bool hires = false;     // 128x64 SUPER-CHIP display
+        uint8_t planes = 1;     // XO-CHIP bitplanes DXYN draws to
+        QuirkProfile profile = QuirkProfile::Vip;
+    };
+
+    struct Case
+    {
+        std::string name;
+        std::vector<uint16_t> stream;
+        Setup setup;
+    };
+
+    struct Stats
+    {
+        double mean = 0.0;
+        double stddev = 0.0;
+        double min = 0.0;
+        double median = 0.0;
+    };
+
+    // Registers X (and Y) rotate through V0-VE; VF is left to the flags
+    uint16_t Rotate(uint16_t base, int i, bool with_y)
+    {
+        const uint16_t x = static_cast<uint16_t>(i % 15);
+        const uint16_t y = static_cast<uint16_t>((i + 7) % 15);
+        return static_cast<uint16_t>(base | (x << 8) | (with_y ? (y << 4) : 0));
+    }
+
+    std::vector<uint16_t> Repeat(std::initializer_list<uint16_t> pattern)
+    {
+        std::vector<uint16_t> stream;
+        while (stream.size() < STREAM_OPS)
+        {
+            stream.insert(stream.end(), pattern.begin(), pattern.end());
+        }
+        stream.resize(STREAM_OPS);
+        return stream;
+    }
+
+    std::vector<uint16_t> Rotated(uint16_t base, bool with_y)
+    {
+        std::vector<uint16_t> stream(STREAM_OPS);
+        for (int i = 0; i < STREAM_OPS; i++)
+        {
+            stream[i] = Rotate(base, i, with_y);
+        }
+        return stream;
+    }
+
+    std::vector<Case> Cases()
+    {
+        std::vector<Case> cases;
+        const auto add = [&cases](std::string name, std::vector<uint16_t> stream, Setup setup = {})
+        {
+            cases.push_back(Case{std::move(name), std::move(stream), setup});
+        };
+
+        add("00E0 clear", Repeat({0x00E0}));
+        add("2NNN+00EE call/return", Repeat({0x2400, 0x00EE}));
+        add("1NNN jump", Repeat({0x1200}));
+        add("BNNN jump+V0", Repeat({0xB200}));
+
+        add("3XNN skip taken", Rotated(0x3000, false));
+        add("3XNN skip not taken", Rotated(0x3001, false));
+        add("4XNN skip taken", Rotated(0x4001, false));
+        add("5XY0 skip taken", Rotated(0x5000, true));
+        add("9XY0 skip not taken", Rotated(0x9000, true));
+        add("EX9E key up", Rotated(0xE09E, false));
+        add("EXA1 key up", Rotated(0xE0A1, false));
+        add("EX9E key down", Rotated(0xE09E, false), Setup{.key = 0});
+
+        add("6XNN load", Rotated(0x6042, false));
+        add("7XNN add", Rotated(0x7003, false));
+        add("8XY0 mov", Rotated(0x8000, true), Setup{.v = 0x5A});
+        add("8XY1 or", Rotated(0x8001, true), Setup{.v = 0x5A});
+        add("8XY2 and", Rotated(0x8002, true), Setup{.v = 0x5A});
+        add("8XY3 xor", Rotated(0x8003, true), Setup{.v = 0x5A});
+        add("8XY4 add", Rotated(0x8004, true), Setup{.v = 0x5A});
+        add("8XY5 sub", Rotated(0x8005, true), Setup{.v = 0x5A});
+        add("8XY6 shr", Rotated(0x8006, true), Setup{.v = 0x5A});
+        add("8XY7 subn", Rotated(0x8007, true), Setup{.v = 0x5A});
+        add("8XYE shl", Rotated(0x800E, true), Setup{.v = 0x5A});
+
+        add("ANNN load I", Repeat({0xA300}));
+        add("CXNN random", Rotated(0xC0FF, false));
+
+        // V0 and V1 hold the coordinates; the sprite rows come from the font at 0
+        add("DXYN h=1", Repeat({0xD011}), Setup{.x = 10, .y = 10, .i = 0});
+        add("DXYN h=5", Repeat({0xD015}), Setup{.x = 10, .y = 10, .i = 0});
+        add("DXYN h=15", Repeat({0xD01F}), Setup{.x = 10, .y = 10, .i = 0});
+        add("DXYN h=15 clip right", Repeat({0xD01F}), Setup{.x = 60, .y = 10, .i = 0});
+        add("DXYN h=15 clip bottom", Repeat({0xD01F}), Setup{.x = 10, .y = 28, .i = 0});
+        add("DXYN h=15 wrapped start", Repeat({0xD01F}), Setup{.x = 70, .y = 40, .i = 0});
+        add("DXYN h=15 hires", Repeat({0xD01F}), Setup{.x = 60, .y = 10, .i = 0, .hires = true});
+        add("DXY0 16x16", Repeat({0xD010}), Setup{.x = 10, .y = 10, .i = 0x50});
+        add("DXY0 16x16 hires", Repeat({0xD010}), Setup{.x = 60, .y = 10, .i = 0x50, .hires = true});
+
+        add("00CN scroll down", Repeat({0x00C4}), Setup{.hires = true});
+        add("00FB scroll right", Repeat({0x00FB}), Setup{.hires = true});
+        add("00FC scroll left", Repeat({0x00FC}), Setup{.hires = true});
+
+        add("FX07 get delay", Rotated(0xF007, false));
+        add("FX15 set delay", Rotated(0xF015, false));
+        add("FX18 set sound", Rotated(0xF018, false));
+        add("FX1E add I", Rotated(0xF01E, false), Setup{.v = 1});
+        add("FX29 font", Rotated(0xF029, false));
+        add("FX30 big font", Rotated(0xF030, false));
+        add("FX33 bcd", Rotated(0xF033, false), Setup{.v = 0xE7});
+
+        // I moves on by X + 1 per store and wraps at 4 KB
+        for (const uint16_t x : {0x0, 0x3, 0x7, 0xF})
+        {
+            add(fmt::format("FX55 store X={:X}", x), Repeat({static_cast<uint16_t>(0xF055 | (x << 8))}));
+        }
+        for (const uint16_t x : {0x0, 0x3, 0x7, 0xF})
+        {
+            add(fmt::format("FX65 load X={:X}", x), Repeat({static_cast<uint16_t>(0xF065 | (x << 8))}));
+        }
+        add("FX75 save flags X=7", Repeat({0xF775}));
+        add("FX85 load flags X=7", Repeat({0xF785}));
+
+        // XO-CHIP; F000 reads its operand from the word after PC
+        constexpr Setup xo{.profile = QuirkProfile::XoChip};
+        add("F000 NNNN long load", Repeat({0xF000}), xo);
+        add("5XY2 store range X..Y=7", Repeat({0x5072}), xo);
+        add("5XY3 load range X..Y=7", Repeat({0x5073}), xo);
+        add("3XNN skip taken xo", Rotated(0x3000, false), xo);
+        add("DXYN h=15 both planes", Repeat({0xD01F}),
+            Setup{.x = 10, .y = 10, .i = 0, .planes = 3, .profile = QuirkProfile::XoChip});
+        add("00DN scroll up", Repeat({0x00D4}), Setup{.hires = true, .profile = QuirkProfile::XoChip});
+        return cases;
+    }
+
+    void Prepare(Chip8& chip8, const Setup& setup)
+    {
+        std::fill(std::begin(chip8._V), std::end(chip8._V), setup.v);
+        chip8._V[0] = setup.x;
+        chip8._V[1] = setup.y;
+        chip8._I = setup.i;
+        chip8._pc = rom_start;
+        chip8._sp = 0;
+        std::fill(std::begin(chip8._key), std::end(chip8._key), 0);
+        if (setup.key <= 0xF)
+        {
+            chip8._key[setup.key] = 1;
+        }
+        std::fill_n(&chip8._gfx[0][0], framebuffer::BITPLANES * framebuffer::WORDS, 0);
+        chip8._hires = setup.hires;
+        chip8._planes = setup.planes;
+        chip8._waiting_for_vblank = false;
+    }
+
+    double Pass(Chip8& chip8, const Case& c)
+    {
+        Prepare(chip8, c.setup);
+        const auto start = std::chrono::steady_clock::now();
+        for (const uint16_t opcode : c.stream)
+        {
+            chip8.ExecuteOpcode(opcode);
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Stats Measure(Chip8& chip8, const Case& c, uint64_t samples, uint64_t passes)
+    {
+        for (uint64_t p = 0; p < WARMUP_PASSES; p++)
+        {
+            Pass(chip8, c);
+        }
+
+        std::vector<double> ns_per_op(samples);
+        for (double& sample : ns_per_op)
+        {
+            double ns = 0.0;
+            for (uint64_t p = 0; p < passes; p++)
+            {
+                ns += Pass(chip8, c);
+            }
+            sample = ns / static_cast<double>(passes * c.stream.size());
+        }
+
+        Stats stats;
+        for (const double s : ns_per_op)
+        {
+            stats.mean += s;
+        }
+        stats.mean /= static_cast<double>(samples);
+        for (const double s : ns_per_op)
+        {
+            stats.stddev += (s - stats.mean) * (s - stats.mean);
+        }
+        stats.stddev = samples > 1 ? std::sqrt(stats.stddev / static_cast<double>(samples - 1)) : 0.0;
+
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+        stats.min = ns_per_op.front();
+        stats.median = (samples % 2 == 1) ? ns_per_op[samples / 2]
+                                          : (ns_per_op[samples / 2 - 1] + ns_per_op[samples / 2]) / 2.0;
+        return stats;
+    }
+
+    void Usage()
+    {
+        logger::Error("Usage: chip8_opbench [--samples N] [--passes N] [--filter S] [--json F]");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t samples = DEFAULT_SAMPLES;
+    uint64_t passes = DEFAULT_PASSES;
+    std::string filter;
+    std::string json_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            Usage();
+            return 1;
+        }
+
+        if (arg == "--filter" || arg == "--json")
+        {
+            (arg == "--filter" ? filter : json_path) = argv[++i];
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (!tool_args::ParseCount(argv[i + 1], value) || value == 0)
+        {
+            logger::Error("Invalid number for {}: {}", arg, argv[i + 1]);
+            return 1;
+        }
+        i++;
+
+        if (arg == "--samples")
+        {
+            samples = value;
+        }
+        else if (arg == "--passes")
+        {
+            passes = value;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    Chip8 chip8;
+    chip8.SetSeed(1);
+    chip8.SetExecutionMode(ExecutionMode::Interpreter);
+    chip8.Reset();
+
+    std::string json = "[\n";
+    bool first = true;
+    fmt::print("{:<26} {:>9} {:>9} {:>9} {:>9}\n", "case", "ns/op", "stddev", "min", "median");
+    for (const Case& c : Cases())
+    {
+        if (c.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        chip8.SetQuirks(c.setup.profile);
+        const Stats stats = Measure(chip8, c, samples, passes);
+        fmt::print("{:<26} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n", c.name, stats.mean, stats.stddev, stats.min, stats.median);
+
+        json += fmt::format("{}  {{\"case\": \"{}\", \"ns_per_op\": {:.4f}, \"stddev\": {:.4f}, \"min\": {:.4f}, \"median\": {:.4f}}}",
+            first ? "" : ",\n", c.name, stats.mean, stats.stddev, stats.min, stats.median);
+        first = false;
+    }
+    json += "\n]\n";
+
+    if (!json_path.empty())
+    {
+        std::ofstream file(json_path);
+        if (!(file << json))
+        {
+            logger::Error("Failed to write results: {}", json_path);
+            return 1;
+        }
+    }
+    return 0;
+}
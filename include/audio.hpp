@@ -0,0 +1,98 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "chip8.hpp"
+
+/*
+    Audio output
+
+    The buzzer is rendered on the emulator thread, one timer tick (1/60 s)
+    at a time: after every emulated frame, Tick() writes the samples of the
+    tick that frame's vblank ended. Ticks fall on exact sample positions,
+    tick n ending on sample n * SAMPLE_RATE / 60, so the sound starts and
+    stops on the timer tick that turns it on or off. While the sound timer
+    runs, the audio pattern is played: a 500 Hz square wave unless an
+    XO-CHIP ROM loaded its own (F002, pitch FX3A).
+
+    The samples reach SDL's audio thread through SampleRing, a lock-free
+    single producer / single consumer ring. The stream callback only copies
+    from the ring into the stream; it never allocates or takes a lock, and
+    pads an underrun with silence.
+
+    Latency is what the ring holds plus the device buffer (DEVICE_FRAMES).
+    Before each tick the ring should hold _target samples: enough to ride
+    out the emulator thread's jitter, which an underrun shows was too few.
+    Every underrun raises the target, up to where a whole tick still stays
+    under MAX_LATENCY_MS on average, and it creeps back down while none
+    occur. Paced by steady_clock, the emulator and the sound card drift
+    apart, so each tick is stretched or shrunk by up to MAX_SKEW samples to
+    steer the ring towards the target. As the master clock (SetMasterClock)
+    the audio device paces the emulator instead, which runs a frame whenever
+    the ring falls below the target; ticks then keep their exact length and
+    nothing drifts.
+*/
+
+// Lock-free ring of samples for one producer thread and one consumer
+// thread. The indices only grow; each side owns one and reads the other.
+class SampleRing
+{
+    public:
+        static constexpr size_t CAPACITY = 8192;    // a power of two, 170 ms at 48 kHz
+
+        size_t Push(const float* src, size_t n);    // producer; returns the samples written
+        size_t Pop(float* dst, size_t n);           // consumer; returns the samples read
+        size_t Size() const;
+
+    private:
+        float _data[CAPACITY] = {};
+        alignas(64) std::atomic<size_t> _head{0};   // next sample written
+        alignas(64) std::atomic<size_t> _tail{0};   // next sample read
+};
+
+class Audio
+{
+    public:
+        static constexpr int SAMPLE_RATE = 48000;
+        static constexpr int TICK_SAMPLES = SAMPLE_RATE / Chip8::FRAME_HZ;
+        static constexpr int DEVICE_FRAMES = 128;       // 2.7 ms device buffer
+        static constexpr int MAX_LATENCY_MS = 20;
+        static constexpr size_t MIN_TARGET = DEVICE_FRAMES;
+        static constexpr size_t MAX_TARGET = SAMPLE_RATE * MAX_LATENCY_MS / 1000 - DEVICE_FRAMES - TICK_SAMPLES / 2;
+        static constexpr int MAX_SKEW = TICK_SAMPLES / 200;   // 0.5% of a tick
+        static constexpr float VOLUME = 0.25f;
+
+        Audio();
+        ~Audio();
+        Audio(const Audio&) = delete;
+        Audio& operator=(const Audio&) = delete;
+
+        bool Open();
+        void Close();
+        bool IsOpen() const;
+        void Tick(const Chip8& chip8);
+        void Tick();
+        int TicksDue() const;
+        void SetMasterClock(bool master);
+        bool IsMasterClock() const;
+
+    private:
+        SDL_AudioStream* _stream = nullptr;
+        SampleRing _ring;
+        float _tick_buffer[TICK_SAMPLES + MAX_SKEW + 1];    // emulator thread
+        float _device_buffer[1024];                         // audio thread
+        uint64_t _ticks = 0;
+        double _phase = 0.0;            // bit of the 128 bit audio pattern being played
+        size_t _target = MIN_TARGET;    // samples the ring should hold before a tick
+        uint32_t _quiet_ticks = 0;      // ticks since the last underrun
+        uint32_t _underruns_seen = 0;
+        std::atomic<uint32_t> _underruns{0};
+        bool _started = false;          // the device runs from the first tick on
+        bool _master_clock = false;
+
+        void Render(bool on, const uint8_t (&pattern)[16], double rate);
+        void Adapt();
+        static void SDLCALL Callback(void* userdata, SDL_AudioStream* stream, int additional, int total);
+};
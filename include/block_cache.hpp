@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "instruction.hpp"
+
+/*
+    Basic-block cache
+
+    A block is a run of straight-line instructions that ends at the first
+    instruction which can change control flow, block the CPU or write to
+    memory (1NNN, 2NNN, 00EE, BNNN, skips, DXYN, FX0A, FX33, FX55, and
+    XO-CHIP's 5XY2, which shares its nibble with a skip). Each block
+    is translated once into a sequence of decoded instructions (micro-ops)
+    and then executed in a single dispatch.
+
+    A bitmap with one bit per memory byte records which bytes belong to a
+    translated block. A store into a marked byte drops only the blocks that
+    cover that byte; stores elsewhere cost a single bit test. Those blocks
+    can only start within MAX_BLOCK_BYTES before the byte, so they are
+    looked up by start address in that window rather than by scanning
+    every block.
+
+    Each block remembers the block that ran after it last time, so a loop
+    that keeps leaving a block the same way finds the next one without a
+    lookup. Those links, and pointers to blocks in general, hold only while
+    Epoch() is unchanged: it moves on whenever a block is added or dropped.
+    Native code chains through Links() instead, a table by start address
+    that loses a block's entry as soon as the block is dropped.
+*/
+
+class BlockCache
+{
+    public:
+        static constexpr size_t MAX_BLOCK_LENGTH = 64;
+        // every op an F000 NNNN, plus the word after an XO-CHIP block
+        static constexpr uint32_t MAX_BLOCK_BYTES = 4 * MAX_BLOCK_LENGTH + 2;
+
+        // Runs the block's native code, and any compiled blocks it chains
+        // to, for at most budget instructions; returns how many ran
+        using NativeFn = uint64_t (*)(Chip8*, uint64_t budget);
+
+        // Where native code finds the block at a start address to chain to:
+        // the code past its prologue and its length, both 0 if it has none
+        struct Link
+        {
+            const void* body = nullptr;
+            uint64_t length = 0;
+        };
+
+        struct Block
+        {
+            uint16_t start = 0;     // address of the first instruction
+            uint32_t end = 0;       // one past the last byte of the last instruction
+            bool live = false;
+            uint32_t hits = 0;      // executions, used to find hot blocks for the JIT
+            NativeFn native = nullptr;
+            std::vector<Instruction> ops;
+            Block* next = nullptr;  // the block at next_pc, if next_epoch is current
+            uint16_t next_pc = 0;
+            uint32_t next_epoch = 0;
+        };
+
+        bool Allocated() const;
+        void Allocate(size_t memory_size);
+        void Clear();
+
+        Block* Find(uint16_t pc);
+
+        // Find, for the block that from handed over to at pc
+        Block* FindAfter(Block& from, uint16_t pc)
+        {
+            if (from.next_epoch == _epoch && from.next_pc == pc)
+            {
+                return from.next;
+            }
+            Block* to = Find(pc);
+            if (to != nullptr)
+            {
+                from.next = to;
+                from.next_pc = pc;
+                from.next_epoch = _epoch;
+            }
+            return to;
+        }
+
+        uint32_t Epoch() const { return _epoch; }
+        Block& Insert(uint16_t start, uint32_t end, std::vector<Instruction>&& ops);
+
+        static bool EndsBlock(uint16_t opcode);
+
+        void SetNative(Block& block, NativeFn fn, const void* body);
+        const Link* Links() const { return _links.data(); }
+        const uint64_t* CodeBits() const { return _code_bits.data(); }
+
+        void OnStore(uint16_t addr)
+        {
+            if (!_code_bits.empty() && (_code_bits[addr >> 6] >> (addr & 63)) & 1)
+            {
+                Invalidate(addr);
+            }
+        }
+
+        void InvalidateRange(uint32_t start, uint32_t end);
+
+        size_t LiveBlocks() const;
+        void DropNative();
+
+    private:
+        std::vector<Block> _blocks;
+        std::vector<int32_t> _entry;        // block index per start address, -1 if none
+        std::vector<uint64_t> _code_bits;   // one bit per memory byte covered by a block
+        std::vector<Link> _links;           // per start address, for native code
+        std::vector<uint32_t> _free;        // indices of dead blocks for reuse
+        uint32_t _epoch = 1;                // never 0, so a new block has no link
+
+        void Invalidate(uint16_t addr);
+        void MarkCode(uint32_t start, uint32_t end);
+        void UnmarkCode(uint32_t start, uint32_t end);
+};
@@ -3,9 +3,20 @@
 #include <iostream>
 #include <bitset>
 #include <cstdio>
-#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 #include "logger.hpp"
 #include "random.hpp"
+#include "instruction.hpp"
+#include "block_cache.hpp"
+#include "jit_x64.hpp"
+#include "framebuffer.hpp"
+#include "paged_memory.hpp"
+#include "profiler.hpp"
+#include "quirks.hpp"
+#include "trace.hpp"
 
 enum class PrintMode
 {
@@ -23,36 +34,96 @@ constexpr static uint16_t rom_start = 0x200;
 
 inline constexpr int W = 64;
 inline constexpr int H = 32;
+inline constexpr int HIRES_W = 128;     // SUPER-CHIP high resolution mode (00FF)
+inline constexpr int HIRES_H = 64;
+static_assert(W == 64 && HIRES_W == 2 * W, "display rows are packed into one or two uint64_t");
+static_assert(HIRES_H == framebuffer::PLANE, "each plane holds one word per high resolution row");
 
-inline constexpr uint16_t RAM = 4096;
+inline constexpr uint16_t RAM = 4096;        // CHIP-8 and SUPER-CHIP; the decode cache and blocks cover this much
+inline constexpr uint32_t XO_RAM = 65536;    // XO-CHIP, reached through I (F000 NNNN) and by running off the end of RAM
 inline constexpr uint16_t rom_start = 0x200;
+static_assert(PagedMemory::SIZE == XO_RAM, "memory pages must cover the XO-CHIP address space");
+
+enum class ExecutionMode
+{
+    Interpreter,    // Fetch/Decode/Execute on every cycle (reference)
+    Cached,         // handlers looked up in the decode cache by PC
+    Block,          // whole basic blocks translated once and run in one dispatch
+    Jit             // Block, with hot blocks compiled to native x86-64 code
+};
+
+// Why RunCycles / RunFrame stopped executing instructions
+enum class StopReason
+{
+    Budget,         // ran every cycle it was asked to
+    DisplayWait,    // DXYN is waiting for the vblank
+    KeyWait         // FX0A is waiting for a key
+};
+
+struct RunResult
+{
+    StopReason reason = StopReason::Budget;
+    uint64_t cycles = 0;    // cycles that passed, idle ones included
+    uint64_t executed = 0;  // instructions that ran
+};
+
+// A key press or release waiting to be applied, see Chip8::QueueKey()
+struct InputEvent
+{
+    uint64_t cycle = 0;     // applied when the clock reaches this cycle
+    uint8_t key = 0;
+    bool down = false;
+};
+
+struct Chip8State; // save_state.hpp
 
 class Chip8
 {
     public: // <--- change back to private after
-        uint8_t _memory[RAM];
+        PagedMemory _memory;                    // copy-on-write pages, shared with forks
         uint8_t _V[16];
         uint16_t _I = 0;
         uint16_t _pc = rom_start;
         uint8_t _delay_timer = 0;
         uint8_t _sound_timer = 0;
+        bool _sound_on = false;             // the sound timer was running at the last vblank
         uint16_t _stack[16];
         uint16_t _sp = 0;
         uint8_t _key[16];
-        uint8_t _gfx[W * H];
+        uint64_t _gfx[framebuffer::BITPLANES][framebuffer::WORDS];  // one bit per pixel, see framebuffer.hpp
+        bool _hires = false;                // 128x64 SUPER-CHIP mode, see 00FE / 00FF
+        uint8_t _planes = 1;                // bitplanes DXYN, 00E0 and the scrolls act on, see FN01
+        uint8_t _rpl[16];                   // SUPER-CHIP RPL user flags, FX75 / FX85
+        uint8_t _audio_pattern[16];         // XO-CHIP 1-bit sample loop, F002
+        uint8_t _pitch = 64;                // XO-CHIP playback pitch of _audio_pattern, FX3A
         uint16_t _opcode = 0;
-        uint16_t _NNN = 0;
-        uint16_t __NN = 0;
-        uint16_t ___N = 0;
-        uint8_t _X = 0;
-        uint8_t _Y = 0;
+        Instruction _instr;
+        std::vector<Instruction> _decode_cache; // RAM / 2 entries, allocated on first use
+        BlockCache _blocks;                     // allocated on first use in Block mode
+        std::unique_ptr<JitX64> _jit;           // created on first use in Jit mode
+        std::unique_ptr<Profiler> _profiler;    // only created when Profiler::ENABLED
+        TraceWriter* _trace = nullptr;          // not owned, see SetTrace()
+        std::deque<InputEvent> _input;          // queued key events in cycle order, not part of the state
+        ExecutionMode _mode = ExecutionMode::Cached;
+        QuirkProfile _quirks = QuirkProfile::Vip;
+        Instruction (*_decode)(uint16_t opcode) = nullptr;     // DecodeInstruction<Q> for _quirks
+        void (Chip8::*_execute)() = nullptr;                    // ExecuteAs<Q> for _quirks
+        uint16_t _address_mask = 0x0FFF;                        // Q::ADDRESS_MASK for _quirks
+        bool _xo_chip = false;                                  // Q::XO_CHIP for _quirks
         bool _waiting_for_key = false;
-        uint8_t _waiting_register = -1;
-        bool _draw_flag = false;
+        uint8_t _waiting_register = IDLE_REGISTER;  // FX0A's X while _waiting_for_key
+        bool _draw_flag = false;            // set when any row of _gfx changed since the last TakeDirtyRows()
+        uint64_t _dirty_rows = 0;           // bit y set when row y changed
         size_t _tic = 0;
         bool _waiting_for_vblank = false;
-        std::chrono::steady_clock::time_point _next_vblank;
-        const uint8_t _fontset[80]
+        uint32_t _clock_hz = DEFAULT_CLOCK_HZ;
+        uint64_t _cycles = 0;               // emulated cycles since reset, idle cycles included
+        uint64_t _frames = 0;               // vblanks since reset
+        uint64_t _next_vblank = 0;          // cycle on which the next vblank fires
+        uint32_t _frame_remainder = 0;      // carries the fractional part of _clock_hz / FRAME_HZ
+        rng::Xoshiro256 _rng;               // CXNN generator, part of the machine state
+        uint64_t _seed = rng::RandomSeed(); // _rng is seeded from this on every Reset()
+        static constexpr uint8_t _fontset[80]
         {
             0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
             0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -71,8 +142,33 @@ class Chip8
             0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
             0xF0, 0x80, 0xF0, 0x80, 0x80  // F
         };
-        const size_t _fontset_start = 0x0;
+        static constexpr size_t _fontset_start = 0x0;
+        static constexpr uint8_t _big_fontset[160]  // 8x10 SUPER-CHIP digits, FX30
+        {
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+        };
+        static constexpr size_t _big_fontset_start = 0x50;
+        static constexpr uint8_t DEFAULT_PATTERN = 0xF0;    // every byte of _audio_pattern after a reset
+        static constexpr uint8_t DEFAULT_PITCH = 64;
+        static constexpr uint8_t IDLE_REGISTER = 0xFF;      // _waiting_register when no FX0A is waiting
+        static constexpr uint32_t JIT_THRESHOLD = 16;
     private:
+        friend class JitX64;
         int V_Size();
         int KeySize();
         int StackSize();
@@ -81,22 +177,88 @@ class Chip8
         void Fetch();
         void Decode();
         void Execute();
-        void Execute_0x0();
+        template <typename Q> void ExecuteAs();
+        template <typename Q> void Execute_0x0();
         void Execute_0x1();
         void Execute_0x2();
-        void Execute_0x3();
-        void Execute_0x4();
-        void Execute_0x5();
+        template <typename Q> void Execute_0x3();
+        template <typename Q> void Execute_0x4();
+        template <typename Q> void Execute_0x5();
         void Execute_0x6();
         void Execute_0x7();
-        void Execute_0x8();
-        void Execute_0x9();
+        template <typename Q> void Execute_0x8();
+        template <typename Q> void Execute_0x9();
         void Execute_0xA();
-        void Execute_0xB();
+        template <typename Q> void Execute_0xB();
         void Execute_0xC();
-        void Execute_0xD();
-        void Execute_0xE();
-        void Execute_0xF();  
+        template <typename Q> void Execute_0xD();
+        template <typename Q> void Execute_0xE();
+        template <typename Q> void Execute_0xF();
+        template <typename Q> static Instruction DecodeInstruction(uint16_t opcode);
+        const Instruction& FetchDecoded();
+        void StoreByte(uint16_t addr, uint8_t value);
+        void InvalidateCodeRange(uint32_t start, uint32_t end);
+        BlockCache::Block& TranslateBlock(uint16_t pc);
+        size_t RunBlocks(uint64_t limit);
+        void ExecuteOne();
+        void ExecuteTraced(uint64_t cycle);
+        uint64_t Run(uint64_t limit);
+        StopReason Blocked() const;
+        void CompileBlock(BlockCache::Block& block);
+        template <typename Q> uint64_t DrawWide(const Instruction& in);
+        template <typename Q> uint16_t SkipLength() const;
+        static void Op_00E0(Chip8& c, const Instruction& in);
+        static void Op_00EE(Chip8& c, const Instruction& in);
+        static void Op_0NNN(Chip8& c, const Instruction& in);
+        static void Op_00CN(Chip8& c, const Instruction& in);
+        static void Op_00DN(Chip8& c, const Instruction& in);
+        static void Op_00FB(Chip8& c, const Instruction& in);
+        static void Op_00FC(Chip8& c, const Instruction& in);
+        static void Op_00FD(Chip8& c, const Instruction& in);
+        static void Op_00FE(Chip8& c, const Instruction& in);
+        static void Op_00FF(Chip8& c, const Instruction& in);
+        static void Op_1NNN(Chip8& c, const Instruction& in);
+        static void Op_2NNN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_3XNN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_4XNN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_5XY0(Chip8& c, const Instruction& in);
+        static void Op_5XY2(Chip8& c, const Instruction& in);
+        static void Op_5XY3(Chip8& c, const Instruction& in);
+        static void Op_6XNN(Chip8& c, const Instruction& in);
+        static void Op_7XNN(Chip8& c, const Instruction& in);
+        static void Op_8XY0(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_8XY1(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_8XY2(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_8XY3(Chip8& c, const Instruction& in);
+        static void Op_8XY4(Chip8& c, const Instruction& in);
+        static void Op_8XY5(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_8XY6(Chip8& c, const Instruction& in);
+        static void Op_8XY7(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_8XYE(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_9XY0(Chip8& c, const Instruction& in);
+        static void Op_ANNN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_BNNN(Chip8& c, const Instruction& in);
+        static void Op_CXNN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_DXYN(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_EX9E(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_EXA1(Chip8& c, const Instruction& in);
+        static void Op_F000(Chip8& c, const Instruction& in);
+        static void Op_FN01(Chip8& c, const Instruction& in);
+        static void Op_F002(Chip8& c, const Instruction& in);
+        static void Op_FX07(Chip8& c, const Instruction& in);
+        static void Op_FX0A(Chip8& c, const Instruction& in);
+        static void Op_FX15(Chip8& c, const Instruction& in);
+        static void Op_FX18(Chip8& c, const Instruction& in);
+        static void Op_FX1E(Chip8& c, const Instruction& in);
+        static void Op_FX29(Chip8& c, const Instruction& in);
+        static void Op_FX30(Chip8& c, const Instruction& in);
+        static void Op_FX33(Chip8& c, const Instruction& in);
+        static void Op_FX3A(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_FX55(Chip8& c, const Instruction& in);
+        template <typename Q> static void Op_FX65(Chip8& c, const Instruction& in);
+        static void Op_FX75(Chip8& c, const Instruction& in);
+        static void Op_FX85(Chip8& c, const Instruction& in);
+        static void Op_Unknown(Chip8& c, const Instruction& in);
         void Get_X();
         void Get_Y();
         void VF_Flag();
@@ -105,28 +267,74 @@ class Chip8
         void UpdateSoundTimer();
         void UpdateTimers();
         void InitFontset();
+        void SetHiRes(bool hires);
+        void Scroll(uint64_t (*scroll)(uint64_t*, int, int, int), int n);
+        void MarkDirty(uint64_t rows);
+        void AdvanceClock(uint64_t cycles);
+        void VBlank();
+        void ScheduleVBlank();
+        void ProfileBlocked(uint64_t cycles);
+        void ApplyInput();
+        uint64_t NextInputCycle() const;
     public:
+        static constexpr uint32_t DEFAULT_CLOCK_HZ = 10000;
+        static constexpr uint32_t FRAME_HZ = 60;
+
         Chip8();
         ~Chip8();
         bool LoadROM(const std::string& filename);
         void Cycle();
+        size_t Step();
+        void ExecuteOpcode(uint16_t opcode);
+        RunResult RunCycles(uint64_t n);
+        RunResult RunFrame();
         void Update();
         bool DrawFlag();
+        uint64_t TakeDirtyRows();
         void Reset();
         void ClearScreen();
         void Debug_Print(PrintMode pm);
         void Debug_PrintGfx();
         uint8_t (&GetRegisters())[16];
-        uint8_t (&GetGfx())[W * H];
+        uint64_t (&GetGfx())[framebuffer::WORDS];
+        uint64_t (&GetGfx(int bitplane))[framebuffer::WORDS];
+        bool GetHiRes() const;
+        int GetWidth() const;
+        int GetHeight() const;
+        uint64_t GetGfxHash() const;
+        bool GetPixel(int x, int y);
+        void UnpackGfx(uint8_t (&out)[HIRES_W * HIRES_H]);
+        const uint8_t (&GetAudioPattern() const)[16];
+        uint8_t GetPitch() const;
+        double GetPatternRate() const;
         uint8_t &GetDelayTimer();
         uint8_t &GetSoundTimer();
+        bool GetSoundOn() const;
         void SetDelayTimer(uint8_t t);
         void SetSoundTimer(uint8_t t);
         void SetKey(uint8_t k);
         void UnsetKey(uint8_t k);
         void OnKeyPressed(uint8_t k);
         void OnKeyReleased(uint8_t k);
-        void MaybeTick_vblank();
+        uint64_t QueueKey(uint64_t cycle, uint8_t k, bool down);
+        void ClearInput();
+        void SetClockRate(uint32_t hz);
+        uint32_t GetClockRate();
+        uint64_t GetCycles();
+        uint64_t GetFrames();
+        uint64_t GetNextVBlank();
+        void SetSeed(uint64_t seed);
+        uint64_t GetSeed();
+        void SetExecutionMode(ExecutionMode mode);
+        ExecutionMode GetExecutionMode();
+        void SetQuirks(QuirkProfile profile);
+        QuirkProfile GetQuirks() const;
+        void InvalidateCode();
+        void SaveState(Chip8State& out) const;
+        bool LoadState(const Chip8State& in);
+        void ForkFrom(const Chip8& parent);
+        const Profiler* GetProfiler() const;
+        void SetTrace(TraceWriter* trace);
 };
 
 /*
@@ -141,6 +349,9 @@ Notes:
       refresh, and 96 bytes below that (0xEA0-0xEFF) 
       are reserved for call stack, internal use, and 
       other variables
+  - XO-CHIP extends memory to 64 KB (0x0000-0xFFFF); code
+      still runs from the first 4 KB, the rest is mostly
+      data reached with F000 NNNN
   Register:
   - 16 8-bit registers
   - Named V0 to VF
@@ -163,8 +374,8 @@ Notes:
   - Hey keyboard, 16 keys, range 0 to F
     Three opcodes used for detecting input
   Graphics and sound:
-  - 64x32 pixels
-  - Monochrome
+  - 64x32 pixels (128x64 in SUPER-CHIP high resolution mode)
+  - Monochrome (four colours from two bitplanes on XO-CHIP)
   - Sprite pixels are XOR'd with corresponding screen pixel
   - Unset sprite pixels do nothing
   - The carry flag (VF) is set to 1 if any screen pixels are flipped
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+#include "random.hpp"
+
+/*
+    Lockstep multi-instance core
+
+    Runs N instances of one ROM side by side, for search and training
+    workloads that replay the same program with different inputs. State is
+    kept as a structure of arrays (V0 of every lane, then V1, ..., then I, PC,
+    timers, stack and framebuffers) and all lanes share one virtual clock.
+
+    Lanes run in groups that share a PC and opcode; a slice (the cycles up
+    to the next vblank) starts with every lane that is not blocked grouped
+    by its next instruction. Each cycle a group executes its instruction
+    once across its lanes with plain lane loops the compiler vectorizes,
+    using a 0x00/0xFF lane mask over the span of lanes it covers. A group
+    whose lanes all reach the same PC carries over to the next cycle as it
+    is; one that branched apart is split by what its lanes fetch, and groups
+    that meet at the same instruction again are merged. A lane left in a
+    group of its own has taken a path no other lane is on, and would not
+    fall back into step before it blocks; it runs on alone to the end of
+    the slice or until it blocks, without holding up the others. Lanes only
+    interact through the clock, so running one ahead inside a slice changes
+    nothing. Lanes that block drop out until the next slice, so they cost
+    nothing while the rest run.
+
+    Memory is tracked in 256-byte pages that hold the same bytes in every
+    lane until a store makes them differ. An opcode on such a page is read
+    once from lane 0's copy, which stands in for a per-lane decode cache:
+    a group that stays on one PC there carries its opcode over without a
+    fetch per lane.
+
+    Behaviour matches Chip8 lane for lane, so Chip8 serves as the oracle.
+*/
+
+class Chip8Batch
+{
+    public:
+        struct Stats
+        {
+            uint64_t converged = 0;     // cycles on which the running lanes formed one group
+            uint64_t grouped = 0;       // cycles on which they were split into several
+            uint64_t scalar = 0;        // instructions run by lanes on their own
+            uint64_t executed = 0;      // instructions run, summed over the lanes
+        };
+
+        explicit Chip8Batch(size_t lanes);
+
+        bool LoadROM(const std::string& filename);
+        bool LoadROM(const uint8_t* data, size_t size);
+        void Reset();
+
+        // Advances every lane by n cycles / to the next vblank. Lanes never
+        // stop the batch early; executed counts the instructions of all lanes.
+        RunResult RunCycles(uint64_t n);
+        RunResult RunFrame();
+
+        void OnKeyPressed(size_t lane, uint8_t k);
+        void OnKeyReleased(size_t lane, uint8_t k);
+
+        void SetSeed(size_t lane, uint64_t seed);
+        void SetClockRate(uint32_t hz);
+        void SetQuirks(QuirkProfile profile);   // resets the lanes if the address space changes size
+        size_t Lanes() const;
+        uint64_t GetCycles() const;
+        uint64_t GetFrames() const;
+        const Stats& GetStats() const;
+
+        uint8_t GetV(size_t lane, int reg) const;
+        uint16_t GetI(size_t lane) const;
+        uint16_t GetPC(size_t lane) const;
+        uint16_t GetSP(size_t lane) const;
+        uint16_t GetStack(size_t lane, int level) const;
+        uint8_t GetDelayTimer(size_t lane) const;
+        uint8_t GetSoundTimer(size_t lane) const;
+        bool WaitingForVBlank(size_t lane) const;
+        bool WaitingForKey(size_t lane) const;
+        const uint8_t* GetMemory(size_t lane) const;     // RAM bytes, XO_RAM under XO-CHIP
+        const uint64_t* GetGfx(size_t lane, int bitplane = 0) const;  // packed rows, laid out as in Chip8
+        bool GetHiRes(size_t lane) const;
+
+    private:
+        size_t _lanes;
+
+        std::vector<uint8_t> _memory;           // [lane][_memory_size]
+        std::vector<uint8_t> _V;                // [reg][lane]
+        std::vector<uint16_t> _I;
+        std::vector<uint16_t> _pc;
+        std::vector<uint16_t> _stack;           // [level][lane]
+        std::vector<uint16_t> _sp;
+        std::vector<uint8_t> _delay_timer;
+        std::vector<uint8_t> _sound_timer;
+        std::vector<uint16_t> _keys;            // bit k set while key k is down
+        std::vector<uint64_t> _gfx;             // [lane][framebuffer::BITPLANES][framebuffer::WORDS]
+        std::vector<uint8_t> _hires;            // 1 while a lane is in the 128x64 mode
+        std::vector<uint8_t> _planes;           // selected XO-CHIP bitplanes, FN01
+        std::vector<uint8_t> _rpl;              // [lane][16] RPL user flags
+        std::vector<uint8_t> _audio_pattern;    // [lane][16] XO-CHIP audio pattern, F002
+        std::vector<uint8_t> _pitch;            // XO-CHIP pattern pitch, FX3A
+        std::vector<uint8_t> _waiting_for_vblank;
+        std::vector<uint8_t> _waiting_for_key;
+        std::vector<uint8_t> _waiting_register;
+        std::vector<rng::Xoshiro256> _rng;      // per-lane CXNN generator
+        std::vector<uint64_t> _seeds;           // _rng[lane] is seeded from _seeds[lane] on Reset()
+
+        struct Group
+        {
+            uint32_t key;                       // PC << 16 | opcode the group runs next
+            uint32_t start;                     // its lanes are _order[start, start + size)
+            uint32_t size;
+            uint32_t lo;                        // the lanes span [lo, hi)
+            uint32_t hi;
+        };
+
+        struct Slot
+        {
+            uint32_t key = 0;                   // PC << 16 | opcode
+            uint32_t stamp = 0;                 // the slot is empty unless this is _stamp
+            uint32_t group = 0;
+        };
+
+        // a group is run with a mask over the lanes it spans unless that is
+        // more than this many lanes for each one in it
+        static constexpr size_t MAX_SPAN_PER_LANE = 8;
+        static constexpr int PAGE_SHIFT = 8;    // memory is tracked as uniform in pages of 256 bytes
+
+        std::vector<Group> _groups;             // the lanes in lockstep this cycle, by instruction
+        std::vector<uint32_t> _order;
+        std::vector<Group> _next_groups;        // built from _groups as they run, for the next cycle
+        std::vector<uint32_t> _next_order;
+        std::vector<uint64_t> _split;           // key << 32 | lane, see AddGroups()
+        std::vector<uint32_t> _entry_group;     // group per entry of _split
+        std::vector<uint8_t> _ones;             // 0xFF for every lane
+        std::vector<uint8_t> _mask;             // 0xFF for lanes executing the current group, 0 between groups
+        std::vector<Slot> _slots;               // hash table from key to group, a power of two in size
+        uint32_t _stamp = 0;
+        std::vector<uint8_t> _page_uniform;     // 1 while every lane holds the same bytes in a page
+        bool _lanes_blocked = false;            // a lane of the current group started waiting
+
+        void (Chip8Batch::*_execute)(uint16_t, size_t, size_t, const uint8_t*) = nullptr; // Execute<Q> for the quirk profile
+        uint32_t _memory_size = RAM;            // Q::ADDRESS_MASK + 1
+        uint16_t _address_mask = RAM - 1;
+        uint32_t _clock_hz = Chip8::DEFAULT_CLOCK_HZ;
+        uint64_t _cycles = 0;
+        uint64_t _frames = 0;
+        uint64_t _next_vblank = 0;
+        uint32_t _frame_remainder = 0;
+        Stats _stats;
+
+        uint8_t* Reg(int reg) { return _V.data() + reg * _lanes; }
+        uint8_t* Mem(size_t lane) { return _memory.data() + lane * _memory_size; }
+        uint64_t* Gfx(size_t lane, int bitplane = 0) { return _gfx.data() + (lane * framebuffer::BITPLANES + bitplane) * framebuffer::WORDS; }
+
+        void RunSlice(uint64_t cycles);
+        void BeginSlice();
+        bool Cycle(uint64_t remaining);
+        uint32_t Fetch(size_t lane);
+        void AddGroups(const uint64_t* entries, size_t count, std::vector<Group>& groups, std::vector<uint32_t>& order);
+        void Regroup(const Group& group);
+        void Merge();
+        void RunAlone(size_t lane, uint64_t cycles);
+        template <typename Q> void Execute(uint16_t opcode, size_t lo, size_t hi, const uint8_t* m);
+        void CheckUniformStore(size_t lo, size_t hi, const uint8_t* m, int back, int count);
+        template <typename Q> uint16_t SkipLength(size_t lane);
+        void Scroll(size_t lane, uint64_t (*scroll)(uint64_t*, int, int, int), int n);
+        void AdvanceClock(uint64_t cycles);
+        void VBlank();
+        void ScheduleVBlank();
+};
@@ -2,7 +2,11 @@
 
 #include <SDL3/SDL.h>
 #include <chrono>
+#include "audio.hpp"
 #include "chip8.hpp"
+#include "movie.hpp"
+#include "rewind.hpp"
+#include "save_state.hpp"
 #include "window.hpp"
 #include "event_handler.hpp"
 
@@ -11,20 +15,33 @@ class Emulator
 private:
     Chip8 _chip8;
     Window _window;
+    Audio _audio;               // after _window: closed before SDL_Quit()
     EventHandler _event_handler;
 
-    double cpu_accum = 0.0;
     double frame_accum = 0.0;
 
     std::chrono::steady_clock::time_point prev =
         std::chrono::steady_clock::now();
 
-    uint32_t bg_color = 0x000000FF;
-    uint32_t fg_color = 0xF0FF00FF;
+    // Colour of each pixel value; XO-CHIP's second bitplane adds the last two
+    uint32_t palette[4] = {0x000000FF, 0xF0FF00FF, 0xFF6600FF, 0x662200FF};
+
+    // RGBA copy of the display, GetWidth() pixels per row; only dirty rows
+    // are re-expanded each frame
+    uint32_t _pixels[HIRES_W * HIRES_H] = {};
+    int _display_width = W;     // resolution the texture currently shows
+
+    // One snapshot per emulated frame; holding the rewind key plays them
+    // back newest first at the normal frame rate
+    RewindBuffer _rewind;
+    Chip8State _snapshot;
+
+    // Input movie of the session, written to _movie_path on exit
+    MovieRecorder _recorder;
+    std::string _movie_path;
 
     static constexpr double CPU_HZ = 10000.0;
     static constexpr double FRAME_HZ = 60.0;
-    static constexpr double SEC_PER_CPU = 1.0 / CPU_HZ;
     static constexpr double SEC_PER_FRAME = 1.0 / FRAME_HZ;
 
 public:
@@ -34,6 +51,9 @@ public:
     void Run();
     void Tick();
     bool LoadRom(const std::string& filename);
-    void UploadGrid(uint32_t fg, uint32_t bg);
+    void UploadGrid(const uint32_t (&colors)[4], uint64_t dirty_rows);
     bool Setup(const std::string& rom_path);
+    void RecordMovie(const std::string& path);
+    void UseAudioClock(bool enabled);
+    void SaveMovie();
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <SDL3/SDL.h>
 #include <unordered_map>
+#include "movie.hpp"
 #include "window.hpp"
 
 class EventHandler
@@ -10,10 +11,18 @@ class EventHandler
         SDL_Event _event;
         Window* _window = nullptr;
         std::unordered_map<SDL_Keycode, uint8_t> _key_map;
+        bool _rewind_held = false;
+        MovieRecorder* _recorder = nullptr;     // told about every key event applied
+
+        static constexpr SDL_Keycode REWIND_KEY = SDLK_BACKSPACE;   // held to step back in time
+
+        void QueueKey(Chip8& chip8, uint64_t present_cycle, Uint64 now, uint8_t key, bool down);
     public:
         EventHandler(Window* window);
         ~EventHandler();
-        void ProcessEvents(Chip8& chip8);
+        void ProcessEvents(Chip8& chip8, uint64_t present_cycle);
+        bool RewindHeld() const;
         void SetWindow(Window* window);
+        void SetRecorder(MovieRecorder* recorder);
         void InitKeyMap();
 };
\ No newline at end of file
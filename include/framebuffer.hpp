@@ -0,0 +1,120 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+/*
+    Display rows are stored bit-packed, one uint64_t per row, with the most
+    significant bit holding the leftmost pixel (x = 0).
+
+    A 128 pixel SUPER-CHIP row takes two words, stored as two planes: x 0-63
+    in rows[y] and x 64-127 in rows[PLANE + y]. The 64x32 display is then
+    just the first 32 words, laid out as it always was, and every row of
+    either resolution is still one bit in a uint64_t dirty mask.
+
+    XO-CHIP adds a second bitplane: a whole second display of WORDS words,
+    stored right after the first. A pixel's colour is its bit in bitplane 0
+    plus twice its bit in bitplane 1, so the functions below all work on
+    one bitplane at a time and only ExpandPlanes() looks at both.
+*/
+
+namespace framebuffer
+{
+    inline constexpr int PLANE = 64;        // offset of the right half of 128 pixel rows
+    inline constexpr int WORDS = 2 * PLANE;
+    inline constexpr int BITPLANES = 2;     // XO-CHIP colour planes, see FN01
+
+    inline bool Pixel(uint64_t row, int x)
+    {
+        return ((row >> (63 - x)) & 0x1) != 0;
+    }
+
+    // Expands one packed row into `width` RGBA pixels: fg where a bit is set,
+    // bg elsewhere. Uses AVX2 or SSE2 on x86-64 and SIMD128 on WebAssembly.
+    void ExpandRow(uint64_t row, uint32_t* dst, int width, uint32_t fg, uint32_t bg);
+
+    // ExpandRow for the same row of both bitplanes: each pixel is
+    // palette[bit in p0 | bit in p1 << 1]
+    void ExpandPlanes(uint64_t p0, uint64_t p1, uint32_t* dst, int width, const uint32_t (&palette)[4]);
+
+    inline constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+    // FNV-1a over the packed rows, each row taken low byte first, so the
+    // value does not depend on host byte order. Passing the hash of one set
+    // of rows as seed continues it over another.
+    inline uint64_t Hash(const uint64_t* rows, int count, uint64_t seed = HASH_SEED)
+    {
+        uint64_t hash = seed;
+        for (int y = 0; y < count; ++y)
+        {
+            for (int b = 0; b < 8; ++b)
+            {
+                hash ^= (rows[y] >> (b * 8)) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    // Expands one packed row into `width` bytes of 0 or 1
+    inline void UnpackRow(uint64_t row, uint8_t* dst, int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            dst[x] = static_cast<uint8_t>((row >> (63 - x)) & 0x1);
+        }
+    }
+
+    /*
+        XORs a sprite into a display `planes` words wide (1 for 64 pixels,
+        2 for 128) and `height` rows high. fetch(row) returns the sprite row,
+        `sprite_width` (8 or 16) bits wide. The sprite is moved into place
+        as one word shifted across both planes: shifting clips it at the
+        right edge, with WRAP the bits that fall off come back in on the
+        left and rows wrap at the bottom instead of being clipped. Returns
+        the rows that changed; collision is set if any lit pixel was cleared.
+    */
+    template <bool WRAP, typename Fetch>
+    uint64_t Draw(uint64_t* rows, int planes, int height, int x, int y, int count, int sprite_width,
+                  Fetch fetch, bool& collision)
+    {
+        const int rows_drawn = WRAP ? count : (count < height - y ? count : height - y);
+        uint64_t hit = 0;
+        uint64_t dirty = 0;
+        for (int row = 0; row < rows_drawn; row++)
+        {
+            const uint64_t top = static_cast<uint64_t>(fetch(row)) << (64 - sprite_width);
+            const int line = WRAP ? (y + row) % height : y + row;
+            uint64_t left = 0;
+            uint64_t right = 0;
+            if (planes == 1)
+            {
+                left = WRAP ? std::rotr(top, x) : top >> x;
+            }
+            else if (x < 64)
+            {
+                left = top >> x;
+                right = (x == 0) ? 0 : top << (64 - x);
+            }
+            else
+            {
+                right = top >> (x - 64);
+                left = (WRAP && x > 64) ? top << (128 - x) : 0;
+            }
+            hit |= (rows[line] & left) | (rows[PLANE + line] & right);
+            rows[line] ^= left;
+            rows[PLANE + line] ^= right;
+            dirty |= static_cast<uint64_t>((left | right) != 0) << line;
+        }
+        collision = hit != 0;
+        return dirty;
+    }
+
+    // Scrolls the display up or down by n rows / left or right by n pixels,
+    // with blank pixels shifted in (n from 1 to 63 for the horizontal ones);
+    // each returns the rows that changed
+    uint64_t ScrollUp(uint64_t* rows, int planes, int height, int n);
+    uint64_t ScrollDown(uint64_t* rows, int planes, int height, int n);
+    uint64_t ScrollLeft(uint64_t* rows, int planes, int height, int n);
+    uint64_t ScrollRight(uint64_t* rows, int planes, int height, int n);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+class Chip8;
+struct Instruction;
+
+using InstructionHandler = void (*)(Chip8&, const Instruction&);
+
+// A fully decoded opcode: the handler for that exact instruction plus its operands
+struct Instruction
+{
+    InstructionHandler handler = nullptr;
+    uint16_t opcode = 0;
+    uint16_t NNN = 0;
+    uint8_t NN = 0;
+    uint8_t N = 0;
+    uint8_t X = 0;
+    uint8_t Y = 0;
+};
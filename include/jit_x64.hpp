@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "block_cache.hpp"
+
+/*
+    x86-64 JIT backend
+
+    Compiles hot basic blocks from the BlockCache into native code. Within a
+    block, PC is a compile-time constant, I lives in r15 and up to nine of the
+    V registers used by the block are kept in host registers (the rest are
+    accessed in memory); everything is written back once at the block exit.
+    Calls, returns, CXNN, low resolution DXYN and the FX33 / FX55 stores are
+    translated natively; a store takes the slow way through StoreByte only
+    when its page is shared or holds translated code. Everything else calls
+    the instruction's decoded handler from the generated code. Blocks are
+    compiled for the Chip8's quirk profile at the time; SetQuirks() throws
+    the native code away.
+
+    A block exit looks its successor up in BlockCache::Links() and jumps
+    straight into its code while the budget it was given has room for it
+    and the CPU has not blocked, so a hot loop runs without coming back to
+    Chip8::RunBlocks between blocks.
+
+    On hosts other than x86-64 (or under Emscripten) Supported() is false and
+    Compile() always returns nullptr, so Jit mode behaves like Block mode.
+*/
+
+class JitX64
+{
+    public:
+        using BlockFn = BlockCache::NativeFn;
+
+        static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+        static bool Supported();
+
+        explicit JitX64(size_t capacity = DEFAULT_CAPACITY);
+        ~JitX64();
+        JitX64(const JitX64&) = delete;
+        JitX64& operator=(const JitX64&) = delete;
+
+        // Returns nullptr if the code buffer is full; call Reset() and retry
+        BlockFn Compile(Chip8& c, const BlockCache::Block& block);
+        void Reset();
+        size_t Used() const;
+        const void* Body(BlockFn fn) const;     // where chained blocks enter fn
+
+    private:
+        uint8_t* _code = nullptr;
+        size_t _capacity = 0;
+        size_t _used = 0;
+        size_t _body_offset = 0;
+
+        static void Store(Chip8* c, uint32_t addr, uint32_t value);
+};
@@ -1,9 +1,43 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <fmt/core.h>
+#include <fmt/format.h>
 #include <fmt/printf.h>
 #include <string_view>
-#include <SDL3/SDL.h>
+
+/*
+    Logging
+
+    Levels below CHIP8_LOG_LEVEL (0 debug, 1 info, 2 warn, 3 error, 4 off;
+    set with the CMake option of the same name) are compiled out: the call
+    becomes an empty `if constexpr`. Without it, release builds keep info
+    and up, other builds everything.
+
+    A call site, told apart by its format string, may log RATE_LIMIT
+    messages a second. Further ones are counted and dropped before they are
+    formatted, and the next message from that site that gets through is
+    preceded by how many were dropped. A ROM that hits an unknown opcode on
+    every cycle therefore no longer runs at the speed of the terminal.
+
+    After StartAsync() messages are formatted into a fixed-size record and
+    pushed onto a lock-free ring. A background thread adds the prefix, folds
+    runs of the same message into one "repeated N times" line and writes
+    them out in batches. Callers never wait: when the ring is full the
+    message is dropped and counted. StopAsync(), or the end of the program,
+    writes out whatever is still queued.
+
+    Print() output is never filtered, limited or folded.
+*/
+
+#ifndef CHIP8_LOG_LEVEL
+#ifdef NDEBUG
+#define CHIP8_LOG_LEVEL 1
+#else
+#define CHIP8_LOG_LEVEL 0
+#endif
+#endif
 
 namespace logger
 {
@@ -15,7 +49,28 @@ namespace logger
         Error,
         Debug
     };
-   
+
+    inline constexpr int MIN_LEVEL = CHIP8_LOG_LEVEL;
+    inline constexpr uint32_t RATE_LIMIT = 20;      // messages per call site per second
+    inline constexpr size_t RECORD_TEXT = 240;      // longer messages are cut in async mode
+
+    constexpr int Severity(LogLevel lvl)
+    {
+        switch (lvl)
+        {
+            case LogLevel::Debug:   return 0;
+            case LogLevel::Info:    return 1;
+            case LogLevel::Warn:    return 2;
+            case LogLevel::Error:   return 3;
+            default:                return 4;
+        }
+    }
+
+    constexpr bool Enabled(LogLevel lvl)
+    {
+        return lvl == LogLevel::Default || Severity(lvl) >= MIN_LEVEL;
+    }
+
     inline const char* prefix(LogLevel lvl)
     {
         switch(lvl)
@@ -29,40 +84,69 @@ namespace logger
         }
         return "";
     }
-        
+
+    // logger.cpp
+    bool Admit(LogLevel lvl, std::string_view site);
+    void Write(LogLevel lvl, std::string_view text);
+    // Hands writing to the background thread, so a ROM that floods
+    // warnings does not stall the emulation on stderr
+    bool StartAsync(size_t capacity = 1024);
+    void StopAsync();
+
     template<typename... Args>
     void Log(LogLevel lvl, fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        fmt::print(stderr, "{}{}\n", prefix(lvl), fmt::format(fmt_str, std::forward<Args>(args)...));
+        const fmt::string_view site = fmt_str;
+        if (!Admit(lvl, std::string_view(site.data(), site.size())))
+        {
+            return;
+        }
+        fmt::memory_buffer text;
+        fmt::format_to(fmt::appender(text), fmt_str, std::forward<Args>(args)...);
+        Write(lvl, std::string_view(text.data(), text.size()));
     }
 
     template<typename... Args>
     void Print(fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        fmt::print(stderr, "{}{}", prefix(LogLevel::Default), fmt::format(fmt_str, std::forward<Args>(args)...));
+        fmt::memory_buffer text;
+        fmt::format_to(fmt::appender(text), fmt_str, std::forward<Args>(args)...);
+        Write(LogLevel::Default, std::string_view(text.data(), text.size()));
     }
-    
+
     template<typename... Args>
     void Info(fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        Log(LogLevel::Info, fmt_str, std::forward<Args>(args)...);
+        if constexpr (Enabled(LogLevel::Info))
+        {
+            Log(LogLevel::Info, fmt_str, std::forward<Args>(args)...);
+        }
     }
 
     template<typename... Args>
     void Warn(fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        Log(LogLevel::Warn, fmt_str, std::forward<Args>(args)...);
+        if constexpr (Enabled(LogLevel::Warn))
+        {
+            Log(LogLevel::Warn, fmt_str, std::forward<Args>(args)...);
+        }
     }
 
     template<typename... Args>
     void Error(fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        Log(LogLevel::Error, fmt_str, std::forward<Args>(args)...);
+        if constexpr (Enabled(LogLevel::Error))
+        {
+            Log(LogLevel::Error, fmt_str, std::forward<Args>(args)...);
+        }
     }
 
     template<typename... Args>
     void Debug(fmt::format_string<Args...> fmt_str, Args&&... args)
     {
-        Log(LogLevel::Debug, fmt_str, std::forward<Args>(args)...);
+        if constexpr (Enabled(LogLevel::Debug))
+        {
+            Log(LogLevel::Debug, fmt_str, std::forward<Args>(args)...);
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+
+/*
+    Input movies
+
+    A movie is everything needed to repeat a session exactly: the ROM (by
+    hash), the CXNN seed, the clock rate, and every key press and release
+    stamped with the emulated cycle it was applied on. Replaying feeds the
+    events back at the same cycles, so the machine goes through the same
+    states at whatever speed the host runs it.
+
+    The recorder can also store a hash of the display after every frame;
+    playback then compares each frame against it and stops at the first one
+    that differs, which points at the frame where a build or a platform
+    started to behave differently.
+
+    Files hold a header with a CRC-32 of the body (see save_state.hpp),
+    followed by the events and then the frame hashes, in host byte order.
+*/
+
+struct MovieEvent
+{
+    uint64_t cycle = 0;         // emulated cycle the event was applied on
+    uint8_t key = 0;
+    uint8_t down = 0;
+    uint8_t reserved[6] = {};
+};
+
+struct Movie
+{
+    uint64_t rom_hash = 0;                  // movie::HashFile of the ROM
+    uint64_t seed = 0;
+    uint32_t clock_hz = Chip8::DEFAULT_CLOCK_HZ;
+    uint64_t frames = 0;
+    std::vector<MovieEvent> events;         // in cycle order
+    std::vector<uint64_t> frame_hashes;     // framebuffer::Hash after each frame; empty if not recorded
+};
+
+struct PlaybackResult
+{
+    static constexpr uint64_t NO_DIVERGENCE = UINT64_MAX;
+
+    uint64_t frames = 0;                    // frames played
+    uint64_t executed = 0;                  // instructions run
+    uint64_t divergent_frame = NO_DIVERGENCE;
+    uint64_t expected_hash = 0;
+    uint64_t actual_hash = 0;
+};
+
+namespace movie
+{
+    bool HashFile(const std::string& path, uint64_t& hash);
+
+    bool WriteFile(const std::string& path, const Movie& movie);
+    bool ReadFile(const std::string& path, Movie& movie);
+
+    // Plays movie on chip8, which must have just loaded the movie's ROM.
+    // With verify set, stops at the first frame whose display hash differs.
+    PlaybackResult Play(Chip8& chip8, const Movie& movie, bool verify);
+}
+
+class MovieRecorder
+{
+    public:
+        // Starts a new movie; call right after chip8 loaded the ROM
+        void Start(Chip8& chip8, uint64_t rom_hash, bool frame_hashes = true);
+        void Stop();
+        bool Recording() const;
+
+        // Called with the cycle a key event is applied on (see
+        // Chip8::QueueKey), and after every frame
+        void OnKey(uint64_t cycle, uint8_t key, bool down);
+        void OnFrame(Chip8& chip8);
+
+        // Drops what was recorded after chip8's current point in time, after
+        // the machine was restored to an earlier state
+        void Rewind(Chip8& chip8);
+
+        const Movie& GetMovie() const;
+
+    private:
+        Movie _movie;
+        bool _recording = false;
+        bool _frame_hashes = true;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Copy-on-write paged memory
+
+    The 64 KB XO-CHIP address space is split into 256-byte pages held by
+    reference. Copying a PagedMemory copies the page table and bumps
+    reference counts, so forking an instance costs PAGES pointer copies no
+    matter how much of memory is in use. A page is duplicated only when it
+    is written while another copy still holds it; an unshared page is
+    written in place. Pages no one has written since Clear() all point at
+    one static zero page, so a CHIP-8 program, which only ever touches the
+    first 4 KB, keeps the other 60 KB in that single page.
+
+    Reference counts are atomic, so copies may be handed to other threads.
+    A single PagedMemory must still not be copied while it is being written.
+*/
+
+class PagedMemory
+{
+    public:
+        static constexpr size_t SIZE = 65536;
+        static constexpr size_t PAGE_SHIFT = 8;
+        static constexpr size_t PAGE_SIZE = size_t{1} << PAGE_SHIFT;
+        static constexpr size_t PAGES = SIZE / PAGE_SIZE;
+
+        // bytes come first so a Page* is also a pointer to its data (the JIT
+        // loads through the page table directly)
+        struct Page
+        {
+            uint8_t bytes[PAGE_SIZE];
+            std::atomic<uint32_t> refs;
+        };
+
+        PagedMemory();
+        PagedMemory(const PagedMemory& other);
+        PagedMemory& operator=(const PagedMemory& other);
+        ~PagedMemory();
+
+        uint8_t operator[](size_t addr) const
+        {
+            return _pages[addr >> PAGE_SHIFT]->bytes[addr & (PAGE_SIZE - 1)];
+        }
+
+        void Write(size_t addr, uint8_t value)
+        {
+            Page* page = _pages[addr >> PAGE_SHIFT];
+            if (page->refs.load(std::memory_order_acquire) != 1)
+            {
+                page = Unshare(addr >> PAGE_SHIFT);
+            }
+            page->bytes[addr & (PAGE_SIZE - 1)] = value;
+        }
+
+        const uint8_t* PageData(size_t page) const { return _pages[page]->bytes; }
+        const Page* const* PageTable() const { return _pages; }
+        bool SharesPage(const PagedMemory& other, size_t page) const { return _pages[page] == other._pages[page]; }
+
+        void Clear();
+        void CopyTo(uint8_t* out, size_t pages = PAGES) const;    // the first pages pages
+
+    private:
+        Page* _pages[PAGES];
+
+        Page* Unshare(size_t page);
+        static void Retain(Page* page);
+        static void Release(Page* page);
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Execution profiler
+
+    Built in only when CHIP8_PROFILE is defined (cmake -DCHIP8_PROFILE=ON).
+    Chip8 calls into it from behind `if constexpr (Profiler::ENABLED)`, so a
+    normal build has no counters, no calls and no branches for it.
+
+    When enabled it counts every executed instruction three ways: per opcode
+    class (DXYN, 8XY4, ...), per PC, and per call stack. The call stack is a
+    shadow of the CHIP-8 one, kept as a tree of subroutine entry points that
+    2NNN and 00EE walk up and down, so the per-instruction cost is three
+    increments; the tree is only searched on a call. Cycles the CPU spent
+    blocked on the display wait or on FX0A are counted separately.
+
+    WriteJson dumps everything; WriteFolded writes one line per call stack,
+    "sub_0200;sub_02F4;sub_0310 <count>", the folded format flamegraph.pl and
+    speedscope read. Blocked cycles appear as [display wait] and [key wait]
+    frames under the stack that was running when the CPU blocked. Every
+    instruction takes one cycle, so all counts are in cycles.
+*/
+
+class Profiler
+{
+    public:
+#ifdef CHIP8_PROFILE
+        static constexpr bool ENABLED = true;
+#else
+        static constexpr bool ENABLED = false;
+#endif
+
+        static constexpr int CLASSES = 52;
+        static constexpr int ADDRESSES = 65536;    // the XO-CHIP address space
+        static constexpr int MAX_DEPTH = 16;        // the CHIP-8 stack depth
+        static constexpr size_t MAX_NODES = 4096;   // deeper or further call paths stay in their caller
+
+        Profiler();
+
+        void OnExecute(uint16_t pc, uint16_t opcode)
+        {
+            _by_pc[pc & (ADDRESSES - 1)]++;
+            _by_class[OpClass(opcode)]++;
+            _nodes[_node].instructions++;
+            if ((opcode >> 12) == 0x2)
+            {
+                Call(opcode & 0x0FFF);
+            }
+            else if (opcode == 0x00EE)
+            {
+                Return();
+            }
+        }
+
+        void OnDisplayWait(uint64_t cycles)
+        {
+            _nodes[_node].display_wait += cycles;
+        }
+
+        void OnKeyWait(uint64_t cycles)
+        {
+            _nodes[_node].key_wait += cycles;
+        }
+
+        void Clear();
+
+        uint64_t Instructions() const;
+        uint64_t ClassCount(int op_class) const;
+        uint64_t PcCount(uint16_t pc) const;
+
+        std::string Json() const;
+        std::string Folded() const;
+        bool WriteJson(const std::string& path) const;
+        bool WriteFolded(const std::string& path) const;
+
+        static const char* ClassName(int op_class);
+
+        // Index into the class counters; matches Chip8::DecodeInstruction
+        static int OpClass(uint16_t opcode)
+        {
+            constexpr int UNKNOWN = CLASSES - 1;
+            switch (opcode >> 12)
+            {
+                case 0x0:
+                    switch (opcode)
+                    {
+                        case 0x00E0: return 0;
+                        case 0x00EE: return 1;
+                        case 0x00FB: return 36;
+                        case 0x00FC: return 37;
+                        case 0x00FD: return 38;
+                        case 0x00FE: return 39;
+                        case 0x00FF: return 40;
+                        default:
+                            switch (opcode & 0xFFF0)
+                            {
+                                case 0x00C0: return 35;
+                                case 0x00D0: return 44;
+                                default:     return 2;
+                            }
+                    }
+                case 0x5:
+                    return ((opcode & 0xF) == 0x2) ? 45 : ((opcode & 0xF) == 0x3) ? 46 : 7;
+                case 0x8:
+                {
+                    constexpr int8_t ALU[16] = {10, 11, 12, 13, 14, 15, 16, 17, -1, -1, -1, -1, -1, -1, 18, -1};
+                    const int8_t op_class = ALU[opcode & 0xF];
+                    return (op_class < 0) ? UNKNOWN : op_class;
+                }
+                case 0xE:
+                    return ((opcode & 0xFF) == 0x9E) ? 24 : ((opcode & 0xFF) == 0xA1) ? 25 : UNKNOWN;
+                case 0xF:
+                    switch (opcode & 0xFF)
+                    {
+                        case 0x00: return (opcode == 0xF000) ? 47 : UNKNOWN;
+                        case 0x01: return 48;
+                        case 0x02: return (opcode == 0xF002) ? 49 : UNKNOWN;
+                        case 0x07: return 26;
+                        case 0x0A: return 27;
+                        case 0x15: return 28;
+                        case 0x18: return 29;
+                        case 0x1E: return 30;
+                        case 0x29: return 31;
+                        case 0x30: return 41;
+                        case 0x33: return 32;
+                        case 0x3A: return 50;
+                        case 0x55: return 33;
+                        case 0x65: return 34;
+                        case 0x75: return 42;
+                        case 0x85: return 43;
+                        default:   return UNKNOWN;
+                    }
+                default:
+                {
+                    constexpr int8_t FIRST[16] = {0, 3, 4, 5, 6, 7, 8, 9, 0, 19, 20, 21, 22, 23, 0, 0};
+                    return FIRST[opcode >> 12];
+                }
+            }
+        }
+
+    private:
+        struct Node
+        {
+            uint32_t parent = 0;
+            uint16_t entry = 0;         // address of the subroutine
+            uint16_t depth = 0;
+            uint64_t instructions = 0;  // executed with this node on top of the stack
+            uint64_t display_wait = 0;
+            uint64_t key_wait = 0;
+        };
+
+        void Call(uint16_t target);
+        void Return();
+        std::string StackName(uint32_t node) const;
+
+        std::vector<uint64_t> _by_pc;
+        uint64_t _by_class[CLASSES] = {};
+        std::vector<Node> _nodes;                       // [0] is the ROM's entry point
+        std::unordered_map<uint64_t, uint32_t> _children; // (parent << 16 | entry) -> node
+        uint32_t _node = 0;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/*
+    Compatibility quirks
+
+    CHIP-8 interpreters disagree on a handful of instructions, and ROMs
+    written for one of them misbehave on the others. Each quirk set is a
+    policy: a struct of constexpr flags the instruction handlers are
+    templated on, so a specialization has no quirk tests at all, only the
+    behaviour it was built for.
+
+    VF_RESET          8XY1, 8XY2 and 8XY3 clear VF
+    SHIFT_VY          8XY6 and 8XYE shift VY into VX (otherwise VX in place)
+    MEMORY_INCREMENT  FX55 and FX65 leave I at I + X + 1 (otherwise unchanged)
+    WRAP_SPRITES      DXYN wraps sprites around the edges (otherwise clips)
+    DISPLAY_WAIT      DXYN waits for the vblank before the next instruction
+    JUMP_VX           BXNN jumps to VX + XNN (otherwise BNNN to V0 + NNN)
+
+    Each policy also describes the platform's memory and instruction set:
+
+    ADDRESS_MASK      addresses wrap at 4 KB (0x0FFF) or, on XO-CHIP, 64 KB
+    XO_CHIP           decodes the XO-CHIP instructions (00DN, 5XY2, 5XY3,
+                      F000 NNNN, FN01, F002, FX3A); skips step over the
+                      whole of a 4 byte F000 NNNN
+
+    Chip8::SetQuirks() picks the specialization at runtime, once per ROM;
+    ForRom() guesses the profile from the file extension the way most
+    emulators do (.sc8 SUPER-CHIP, .xo8 XO-CHIP, anything else COSMAC VIP).
+*/
+
+enum class QuirkProfile
+{
+    Vip,            // COSMAC VIP CHIP-8, the default
+    SuperChip,      // SUPER-CHIP 1.1 on the HP 48
+    XoChip          // XO-CHIP (Octo)
+};
+
+namespace quirks
+{
+    struct Vip
+    {
+        static constexpr QuirkProfile PROFILE = QuirkProfile::Vip;
+        static constexpr bool VF_RESET = true;
+        static constexpr bool SHIFT_VY = true;
+        static constexpr bool MEMORY_INCREMENT = true;
+        static constexpr bool WRAP_SPRITES = false;
+        static constexpr bool DISPLAY_WAIT = true;
+        static constexpr bool JUMP_VX = false;
+        static constexpr uint16_t ADDRESS_MASK = 0x0FFF;
+        static constexpr bool XO_CHIP = false;
+    };
+
+    struct SuperChip
+    {
+        static constexpr QuirkProfile PROFILE = QuirkProfile::SuperChip;
+        static constexpr bool VF_RESET = false;
+        static constexpr bool SHIFT_VY = false;
+        static constexpr bool MEMORY_INCREMENT = false;
+        static constexpr bool WRAP_SPRITES = false;
+        static constexpr bool DISPLAY_WAIT = false;
+        static constexpr bool JUMP_VX = true;
+        static constexpr uint16_t ADDRESS_MASK = 0x0FFF;
+        static constexpr bool XO_CHIP = false;
+    };
+
+    struct XoChip
+    {
+        static constexpr QuirkProfile PROFILE = QuirkProfile::XoChip;
+        static constexpr bool VF_RESET = false;
+        static constexpr bool SHIFT_VY = true;
+        static constexpr bool MEMORY_INCREMENT = true;
+        static constexpr bool WRAP_SPRITES = true;
+        static constexpr bool DISPLAY_WAIT = false;
+        static constexpr bool JUMP_VX = false;
+        static constexpr uint16_t ADDRESS_MASK = 0xFFFF;
+        static constexpr bool XO_CHIP = true;
+    };
+
+    // Calls f.template operator()<Q>() with the policy for profile, for
+    // picking specializations: f([]<typename Q>() { return &Handler<Q>; })
+    template <typename F>
+    decltype(auto) Dispatch(QuirkProfile profile, F&& f)
+    {
+        switch (profile)
+        {
+            case QuirkProfile::SuperChip:   return f.template operator()<SuperChip>();
+            case QuirkProfile::XoChip:      return f.template operator()<XoChip>();
+            default:                        return f.template operator()<Vip>();
+        }
+    }
+
+    inline const char* Name(QuirkProfile profile)
+    {
+        switch (profile)
+        {
+            case QuirkProfile::SuperChip:   return "schip";
+            case QuirkProfile::XoChip:      return "xochip";
+            default:                        return "vip";
+        }
+    }
+
+    inline bool Parse(std::string_view text, QuirkProfile& out)
+    {
+        if (text == "vip" || text == "chip8")
+        {
+            out = QuirkProfile::Vip;
+        }
+        else if (text == "schip" || text == "superchip")
+        {
+            out = QuirkProfile::SuperChip;
+        }
+        else if (text == "xochip")
+        {
+            out = QuirkProfile::XoChip;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    inline QuirkProfile ForRom(std::string_view path)
+    {
+        const size_t dot = path.find_last_of("./\\");
+        const std::string_view ext = (dot == std::string_view::npos || path[dot] != '.') ? "" : path.substr(dot + 1);
+        if (ext == "sc8" || ext == "sc" || ext == "SC8")
+        {
+            return QuirkProfile::SuperChip;
+        }
+        if (ext == "xo8" || ext == "XO8")
+        {
+            return QuirkProfile::XoChip;
+        }
+        return QuirkProfile::Vip;
+    }
+}
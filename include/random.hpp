@@ -5,12 +5,64 @@
 
 namespace rng
 {
-    inline uint8_t RandomNum_8Bit()
+    /*
+        xoshiro256** (Blackman and Vigna): 32 bytes of state and a handful of
+        shifts, rotates and adds per number. Each machine owns one, so CXNN is
+        reproducible from a seed, the generator state can be saved with the
+        rest of the machine, and instances on different threads share nothing.
+        Seeds are expanded with SplitMix64, so every seed, 0 included, gives a
+        valid (not all-zero) state.
+    */
+    struct Xoshiro256
     {
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_int_distribution<int> distr(0, 255);
+        uint64_t s[4] = {};
 
-        return static_cast<uint8_t>(distr(gen));
+        void Seed(uint64_t seed)
+        {
+            for (uint64_t& word : s)
+            {
+                seed += 0x9E3779B97F4A7C15ull;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        uint64_t Next()
+        {
+            const uint64_t result = Rotl(s[1] * 5, 7) * 9;
+            const uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = Rotl(s[3], 45);
+            return result;
+        }
+
+        // The high bits are the strongest ones
+        uint8_t NextByte()
+        {
+            return static_cast<uint8_t>(Next() >> 56);
+        }
+
+        bool Valid() const
+        {
+            return (s[0] | s[1] | s[2] | s[3]) != 0;
+        }
+
+        static uint64_t Rotl(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+    };
+
+    // Seed for machines that were not given one
+    inline uint64_t RandomSeed()
+    {
+        std::random_device rd;
+        return (static_cast<uint64_t>(rd()) << 32) ^ rd();
     }
-}
\ No newline at end of file
+}
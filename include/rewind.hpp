@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "save_state.hpp"
+
+/*
+    Rewind buffer
+
+    Holds one Chip8State per frame in a fixed-size byte ring, the Size()
+    bytes of it that are in use. Every
+    keyframe_interval frames the full state is stored as a keyframe; the
+    frames in between are stored as the XOR of the state with that keyframe.
+    Both are run-length encoded: a frame usually changes a few bytes of
+    memory, registers and display rows, so an XOR delta is almost all zeros
+    and shrinks to a few dozen bytes.
+
+    When the ring is full the oldest keyframe is dropped together with the
+    deltas that depend on it. Pop() hands the snapshots back newest first.
+*/
+
+class RewindBuffer
+{
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 1024 * 1024;
+        static constexpr uint32_t DEFAULT_KEYFRAME_INTERVAL = 60;
+
+        explicit RewindBuffer(size_t capacity = DEFAULT_CAPACITY,
+                              uint32_t keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+
+        void Push(const Chip8State& state);
+        bool Pop(Chip8State& out);
+        void Clear();
+
+        size_t Frames() const;
+        size_t BytesUsed() const;
+
+    private:
+        struct Entry
+        {
+            size_t offset = 0;
+            uint32_t size = 0;
+            uint32_t state_size = 0;        // Chip8State::Size() of the snapshot
+            bool keyframe = false;
+        };
+
+        std::vector<uint8_t> _ring;
+        std::deque<Entry> _entries;         // oldest first, in ring order
+        size_t _head = 0;                   // next write offset
+        size_t _used = 0;
+        uint32_t _keyframe_interval;
+        uint32_t _since_keyframe = 0;       // deltas stored after the newest keyframe
+        bool _key_valid = false;            // _key holds the newest keyframe in the ring
+        Chip8State _key;
+        std::vector<uint8_t> _scratch;
+
+        static void Encode(const uint8_t* data, const uint8_t* base, size_t size, std::vector<uint8_t>& out);
+        static void Decode(const uint8_t* in, size_t in_size, uint8_t* data, size_t size);
+
+        bool Store(const std::vector<uint8_t>& bytes, size_t state_size, bool keyframe);
+        void EvictFront();
+        bool LoadNewestKeyframe();
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "chip8.hpp"
+
+/*
+    Save states
+
+    Chip8State is the complete machine state as one flat, trivially copyable
+    block: Chip8::SaveState / LoadState fill and apply it with plain copies.
+    Only the memory the profile can address is saved, memory_pages pages of
+    it, and the bytes past Size() are not part of the state: a CHIP-8 or
+    SUPER-CHIP snapshot is about the cost of copying 4.5 KB, an XO-CHIP one
+    64 KB. Host-side settings (execution mode, caches, JIT code) are not
+    part of it.
+
+    The layout has no padding, so identical machines produce identical bytes
+    and the first Size() bytes of a state can be hashed or diffed directly.
+    Any layout change must bump VERSION. Files hold a small header with a
+    CRC-32 of those bytes, followed by them in host byte order.
+*/
+
+struct Chip8State
+{
+    static constexpr uint32_t MAGIC = 0x53533843;   // "C8SS"
+    static constexpr uint32_t VERSION = 5;          // 5: memory sized to the address space
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint64_t cycles = 0;
+    uint64_t frames = 0;
+    uint64_t next_vblank = 0;
+    uint64_t rng[4] = {};               // xoshiro256** state, never all zero
+    uint64_t gfx[framebuffer::BITPLANES][framebuffer::WORDS] = {};  // see framebuffer.hpp
+    uint32_t clock_hz = 0;
+    uint32_t frame_remainder = 0;
+    uint16_t I = 0;
+    uint16_t pc = 0;
+    uint16_t sp = 0;
+    uint16_t stack[16] = {};
+    uint8_t V[16] = {};
+    uint8_t key[16] = {};
+    uint8_t delay_timer = 0;
+    uint8_t sound_timer = 0;
+    uint8_t waiting_for_vblank = 0;
+    uint8_t waiting_for_key = 0;
+    uint8_t waiting_register = 0;
+    uint8_t hires = 0;
+    uint8_t planes = 0;
+    uint8_t pitch = 0;
+    uint8_t rpl[16] = {};
+    uint8_t audio_pattern[16] = {};
+    uint16_t memory_pages = 0;          // PagedMemory pages saved: RAM or XO_RAM worth
+    uint8_t memory[PagedMemory::SIZE] = {};
+
+    // Bytes in use, from magic to the end of the saved memory
+    size_t Size() const
+    {
+        return offsetof(Chip8State, memory) + std::min<size_t>(memory_pages, PagedMemory::PAGES) * PagedMemory::PAGE_SIZE;
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<Chip8State>, "save states are copied as raw bytes");
+static_assert(std::has_unique_object_representations_v<Chip8State>, "save states must not contain padding");
+
+namespace savestate
+{
+    uint32_t Crc32(const void* data, size_t size);
+
+    bool WriteFile(const std::string& path, const Chip8State& state);
+    bool ReadFile(const std::string& path, Chip8State& state);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Execution traces
+
+    A trace is one fixed-size record per executed instruction: the cycle it
+    ran on, PC and opcode, and the machine state right after it (I, V0-VF,
+    SP, timers) together with which registers it changed and which bytes of
+    memory it wrote. Two runs that should behave the same can be compared
+    record by record, and the first record that differs is the instruction
+    where they split.
+
+    The writer fills one large buffer while a background thread writes the
+    other one out, so recording costs a 40-byte store per instruction and the
+    emulation only waits on the disk if the disk is slower than both buffers.
+    Files start with a TraceHeader followed by records in host byte order;
+    the record count comes from the file size.
+
+    Chip8 records while a writer is attached with SetTrace(). Tracing runs
+    every instruction through the decoded handlers one at a time, also in
+    Block and Jit mode, so the trace shows the instructions' effects rather
+    than the native code's.
+*/
+
+struct TraceRecord
+{
+    static constexpr uint8_t DREW = 0x1;        // DXYN or 00E0
+    static constexpr uint8_t BLOCKED = 0x2;     // the CPU waits after this instruction
+
+    uint64_t cycle = 0;         // emulated cycle the instruction ran on
+    uint16_t pc = 0;
+    uint16_t opcode = 0;
+    uint16_t i = 0;             // I after the instruction
+    uint16_t v_changed = 0;     // bit r set when Vr changed
+    uint8_t v[16] = {};         // V0-VF after the instruction
+    uint16_t mem_addr = 0;      // first byte written, if mem_count != 0
+    uint8_t mem_count = 0;      // bytes written (FX33: 3, FX55: X + 1)
+    uint8_t sp = 0;
+    uint8_t delay_timer = 0;
+    uint8_t sound_timer = 0;
+    uint8_t flags = 0;
+    uint8_t reserved = 0;
+};
+
+struct TraceHeader
+{
+    static constexpr uint32_t MAGIC = 0x52543843;   // "C8TR"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t record_size = sizeof(TraceRecord);
+    uint32_t clock_hz = 0;
+    uint64_t rom_hash = 0;      // movie::HashFile of the ROM, 0 if unknown
+    uint64_t seed = 0;
+};
+
+class TraceWriter
+{
+    public:
+        static constexpr size_t BUFFER_RECORDS = 1 << 16;  // 2.5 MB per buffer
+
+        TraceWriter() = default;
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+        ~TraceWriter();
+
+        bool Open(const std::string& path, const TraceHeader& header);
+        bool Close();   // writes out what is buffered; false if any write failed
+
+        // The slot for the next record, to be filled in place; every field
+        // must be written, the slot holds whatever was there before
+        TraceRecord& Append()
+        {
+            if (_used == BUFFER_RECORDS)
+            {
+                Hand();
+            }
+            return _active[_used++];
+        }
+
+        uint64_t Records() const;
+
+    private:
+        void Hand();
+        void Loop();
+
+        FILE* _file = nullptr;
+        std::vector<TraceRecord> _buffers[2];
+        TraceRecord* _active = nullptr;
+        int _active_index = 0;
+        size_t _used = 0;
+        uint64_t _handed = 0;               // records given to the writer thread
+
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        size_t _pending = 0;                // records in the buffer being written, 0 when idle
+        bool _stop = false;
+        bool _failed = false;
+};
+
+class TraceReader
+{
+    public:
+        TraceReader() = default;
+        TraceReader(const TraceReader&) = delete;
+        TraceReader& operator=(const TraceReader&) = delete;
+        ~TraceReader();
+
+        bool Open(const std::string& path);
+        bool Next(TraceRecord& record);     // false at the end of the trace
+        const TraceHeader& Header() const;
+        uint64_t Records() const;           // in the whole file
+
+    private:
+        FILE* _file = nullptr;
+        TraceHeader _header;
+        uint64_t _records = 0;
+        std::vector<TraceRecord> _buffer;
+        size_t _pos = 0;
+        size_t _filled = 0;
+};
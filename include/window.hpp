@@ -12,8 +12,10 @@ class Window
     private:
         SDL_Window* _window;
         SDL_Renderer* _renderer;
-        SDL_Texture* _gfx_texture;
+        SDL_Texture* _gfx_texture;                  // HIRES_W x HIRES_H, holds either resolution
+        SDL_FRect _display_rect{0, 0, W, H};        // part of the texture the display occupies
         bool _running = false;
+        bool _redraw = true;    // window contents lost (exposed/resized), present again
     public:
         Window();
         ~Window();
@@ -21,10 +23,14 @@ class Window
         bool CreateWindow();
         bool CreateRenderer();
         bool CreateTexture();
+        void SetDisplaySize(int width, int height);
         bool Setup();
         bool Running();
         void Exit();
+        void RequestRedraw();
+        bool TakeRedraw();
         SDL_Window* GetWindow();
         SDL_Renderer* GetRenderer();
         SDL_Texture* GetGfxTexture();
+        const SDL_FRect* GetDisplayRect() const;
 };
\ No newline at end of file
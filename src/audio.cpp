@@ -0,0 +1,224 @@
+#include "audio.hpp"
+#include <algorithm>
+#include <string>
+#include "logger.hpp"
+
+size_t SampleRing::Push(const float* src, size_t n)
+{
+    const size_t head = _head.load(std::memory_order_relaxed);
+    const size_t tail = _tail.load(std::memory_order_acquire);
+    n = std::min(n, CAPACITY - (head - tail));
+    const size_t at = head & (CAPACITY - 1);
+    const size_t first = std::min(n, CAPACITY - at);
+    std::copy_n(src, first, _data + at);
+    std::copy_n(src + first, n - first, _data);
+    _head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+size_t SampleRing::Pop(float* dst, size_t n)
+{
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    const size_t head = _head.load(std::memory_order_acquire);
+    n = std::min(n, head - tail);
+    const size_t at = tail & (CAPACITY - 1);
+    const size_t first = std::min(n, CAPACITY - at);
+    std::copy_n(_data + at, first, dst);
+    std::copy_n(_data, n - first, dst + first);
+    _tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+size_t SampleRing::Size() const
+{
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+}
+
+Audio::Audio()
+{
+    logger::Info("Audio constructor called");
+}
+
+Audio::~Audio()
+{
+    logger::Info("Audio destructor called");
+    Close();
+}
+
+// Opens the default playback device. Without one the emulator still runs,
+// silently and paced by steady_clock.
+bool Audio::Open()
+{
+    if (!SDL_InitSubSystem(SDL_INIT_AUDIO))
+    {
+        logger::Warn("No audio: {}", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, std::to_string(DEVICE_FRAMES).c_str());
+    const SDL_AudioSpec spec{SDL_AUDIO_F32, 1, SAMPLE_RATE};
+    _stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, Callback, this);
+    if (!_stream)
+    {
+        logger::Warn("Failed to open audio device: {}", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    return true;
+}
+
+void Audio::Close()
+{
+    if (!_stream)
+    {
+        return;
+    }
+    SDL_DestroyAudioStream(_stream);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    _stream = nullptr;
+    _started = false;
+}
+
+bool Audio::IsOpen() const
+{
+    return _stream != nullptr;
+}
+
+// Renders the timer tick that ended at chip8's last vblank
+void Audio::Tick(const Chip8& chip8)
+{
+    Render(chip8.GetSoundOn(), chip8.GetAudioPattern(), chip8.GetPatternRate());
+}
+
+// A silent tick, for frames that were not emulated (rewinding)
+void Audio::Tick()
+{
+    static constexpr uint8_t SILENCE[16] = {};
+    Render(false, SILENCE, 0.0);
+}
+
+// Frames the emulator should run now when the audio device is the master
+// clock: enough to bring the ring back up to the target
+int Audio::TicksDue() const
+{
+    const size_t queued = _ring.Size();
+    if (queued >= _target)
+    {
+        return 0;
+    }
+    return static_cast<int>((_target - queued + TICK_SAMPLES - 1) / TICK_SAMPLES);
+}
+
+void Audio::SetMasterClock(bool master)
+{
+    _master_clock = master;
+}
+
+// Only an open device can pace the emulator
+bool Audio::IsMasterClock() const
+{
+    return _master_clock && _stream != nullptr;
+}
+
+void Audio::Render(bool on, const uint8_t (&pattern)[16], double rate)
+{
+    if (!_stream)
+    {
+        return;
+    }
+
+    const uint64_t first = _ticks * SAMPLE_RATE / Chip8::FRAME_HZ;
+    const uint64_t last = (_ticks + 1) * SAMPLE_RATE / Chip8::FRAME_HZ;
+    _ticks++;
+    Adapt();
+
+    // Paced by steady_clock, the tick is stretched or shrunk to steer the
+    // ring towards the target. A ring far above it (the emulator caught up
+    // on several frames at once) drops the tick instead of adding latency.
+    const size_t queued = _ring.Size();
+    int count = static_cast<int>(last - first);
+    if (!IsMasterClock())
+    {
+        if (queued > _target + 2 * TICK_SAMPLES)
+        {
+            return;
+        }
+        const long error = static_cast<long>(_target) - static_cast<long>(queued);
+        count += static_cast<int>(std::clamp(error / 16, -long{MAX_SKEW}, long{MAX_SKEW}));
+    }
+
+    // The pattern's 128 bits play from the first one whenever the sound starts
+    const double step = rate / SAMPLE_RATE;
+    for (int i = 0; i < count; i++)
+    {
+        if (!on)
+        {
+            _tick_buffer[i] = 0.0f;
+            continue;
+        }
+        const int bit = static_cast<int>(_phase);
+        _tick_buffer[i] = ((pattern[bit >> 3] >> (7 - (bit & 0x7))) & 0x1) ? VOLUME : -VOLUME;
+        _phase += step;
+        if (_phase >= 128.0)
+        {
+            _phase -= 128.0;
+        }
+    }
+    if (!on)
+    {
+        _phase = 0.0;
+    }
+    _ring.Push(_tick_buffer, static_cast<size_t>(count));
+
+    // Started only once there is something to play, so the device does
+    // not begin with an underrun
+    if (!_started)
+    {
+        _started = SDL_ResumeAudioStreamDevice(_stream);
+    }
+}
+
+// Raises the target after an underrun, lowers it again after a quiet spell
+void Audio::Adapt()
+{
+    static constexpr uint32_t QUIET_TICKS = 10 * Chip8::FRAME_HZ;
+    static constexpr size_t STEP = 32;
+
+    const uint32_t underruns = _underruns.load(std::memory_order_relaxed);
+    if (underruns != _underruns_seen)
+    {
+        _underruns_seen = underruns;
+        _quiet_ticks = 0;
+        _target = std::min(_target + 2 * STEP, MAX_TARGET);
+    }
+    else if (++_quiet_ticks >= QUIET_TICKS)
+    {
+        _quiet_ticks = 0;
+        _target = std::max(_target - std::min(_target, STEP), MIN_TARGET);
+    }
+}
+
+// Runs on SDL's audio thread: copies what the stream asks for out of the
+// ring, padding with silence if the ring runs dry
+void SDLCALL Audio::Callback(void* userdata, SDL_AudioStream* stream, int additional, int)
+{
+    auto* audio = static_cast<Audio*>(userdata);
+    size_t needed = static_cast<size_t>(additional) / sizeof(float);
+    bool underrun = false;
+    while (needed > 0)
+    {
+        const size_t n = std::min(needed, std::size(audio->_device_buffer));
+        const size_t got = audio->_ring.Pop(audio->_device_buffer, n);
+        if (got < n)
+        {
+            std::fill(audio->_device_buffer + got, audio->_device_buffer + n, 0.0f);
+            underrun = true;
+        }
+        SDL_PutAudioStreamData(stream, audio->_device_buffer, static_cast<int>(n * sizeof(float)));
+        needed -= n;
+    }
+    if (underrun)
+    {
+        audio->_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
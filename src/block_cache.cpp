@@ -0,0 +1,194 @@
+#include "block_cache.hpp"
+#include <algorithm>
+#include <utility>
+
+bool BlockCache::Allocated() const
+{
+    return !_entry.empty();
+}
+
+void BlockCache::Allocate(size_t memory_size)
+{
+    _blocks.clear();
+    _free.clear();
+    _entry.assign(memory_size, -1);
+    _code_bits.assign((memory_size + 63) / 64, 0);
+    _links.assign(memory_size, Link{});
+    _epoch++;
+}
+
+void BlockCache::Clear()
+{
+    _blocks.clear();
+    _free.clear();
+    std::fill(_entry.begin(), _entry.end(), -1);
+    std::fill(_code_bits.begin(), _code_bits.end(), 0);
+    std::fill(_links.begin(), _links.end(), Link{});
+    _epoch++;
+}
+
+BlockCache::Block* BlockCache::Find(uint16_t pc)
+{
+    const int32_t index = _entry[pc];
+    return (index < 0) ? nullptr : &_blocks[index];
+}
+
+BlockCache::Block& BlockCache::Insert(uint16_t start, uint32_t end, std::vector<Instruction>&& ops)
+{
+    int32_t index;
+    _epoch++;   // may move every block, or reuse a dropped one
+    if (!_free.empty())
+    {
+        index = static_cast<int32_t>(_free.back());
+        _free.pop_back();
+    }
+    else
+    {
+        index = static_cast<int32_t>(_blocks.size());
+        _blocks.emplace_back();
+    }
+
+    Block& block = _blocks[index];
+    block.start = start;
+    block.end = end;
+    block.live = true;
+    block.hits = 0;
+    block.native = nullptr;
+    block.ops = std::move(ops);
+    block.next = nullptr;
+    block.next_epoch = 0;
+
+    _entry[start] = index;
+    _links[start] = Link{};
+    MarkCode(start, end);
+    return block;
+}
+
+bool BlockCache::EndsBlock(uint16_t opcode)
+{
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            return opcode == 0x00EE || opcode == 0x00FD;   // 00FD never moves PC on
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xB:
+        case 0xD:
+        case 0xE:
+            return true;
+        case 0xF:
+            switch (opcode & 0x00FF)
+            {
+                case 0x0A:
+                case 0x33:
+                case 0x55:
+                    return true;
+                default:
+                    return false;
+            }
+        default:
+            return false;
+    }
+}
+
+size_t BlockCache::LiveBlocks() const
+{
+    return _blocks.size() - _free.size();
+}
+
+void BlockCache::SetNative(Block& block, NativeFn fn, const void* body)
+{
+    block.native = fn;
+    _links[block.start] = (fn != nullptr) ? Link{body, block.ops.size()} : Link{};
+}
+
+void BlockCache::DropNative()
+{
+    for (Block& block : _blocks)
+    {
+        block.native = nullptr;
+    }
+    std::fill(_links.begin(), _links.end(), Link{});
+}
+
+// Drops every block covering a byte in [start, end)
+void BlockCache::InvalidateRange(uint32_t start, uint32_t end)
+{
+    if (_code_bits.empty())
+    {
+        return;
+    }
+    for (uint32_t a = start; a < end; a++)
+    {
+        if ((_code_bits[a >> 6] >> (a & 63)) & 1)
+        {
+            Invalidate(static_cast<uint16_t>(a));
+        }
+    }
+}
+
+void BlockCache::Invalidate(uint16_t addr)
+{
+    // a block starts at most MAX_BLOCK_BYTES before any byte it covers,
+    // and each start address holds at most one block
+    const uint32_t first = (addr >= MAX_BLOCK_BYTES) ? addr - MAX_BLOCK_BYTES + 1 : 0;
+    uint32_t dropped_start = UINT32_MAX;
+    uint32_t dropped_end = 0;
+    for (uint32_t start = first; start <= addr; start++)
+    {
+        const int32_t index = _entry[start];
+        if (index < 0 || addr >= _blocks[index].end)
+        {
+            continue;
+        }
+
+        // ops are left in place: the store that got us here may be the
+        // last micro-op of this very block, still being executed
+        Block& block = _blocks[index];
+        block.live = false;
+        _entry[start] = -1;
+        _links[start] = Link{};
+        _free.push_back(static_cast<uint32_t>(index));
+        dropped_start = std::min(dropped_start, start);
+        dropped_end = std::max(dropped_end, block.end);
+    }
+
+    if (dropped_end == 0)
+    {
+        return;
+    }
+    _epoch++;
+
+    // blocks may overlap (a jump into the middle of another block), so the
+    // live ones that reach into the dropped range mark their bytes again
+    UnmarkCode(dropped_start, dropped_end);
+    const uint32_t from = (dropped_start >= MAX_BLOCK_BYTES) ? dropped_start - MAX_BLOCK_BYTES + 1 : 0;
+    for (uint32_t start = from; start < dropped_end; start++)
+    {
+        const int32_t index = _entry[start];
+        if (index >= 0 && _blocks[index].end > dropped_start)
+        {
+            MarkCode(std::max(start, dropped_start), std::min(_blocks[index].end, dropped_end));
+        }
+    }
+}
+
+void BlockCache::MarkCode(uint32_t start, uint32_t end)
+{
+    for (uint32_t a = start; a < end; a++)
+    {
+        _code_bits[a >> 6] |= uint64_t{1} << (a & 63);
+    }
+}
+
+void BlockCache::UnmarkCode(uint32_t start, uint32_t end)
+{
+    for (uint32_t a = start; a < end; a++)
+    {
+        _code_bits[a >> 6] &= ~(uint64_t{1} << (a & 63));
+    }
+}
@@ -3,13 +3,23 @@
 #include <iostream>
 #include <bitset>
 #include <cstdio>
-#include <chrono>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include "logger.hpp"
 #include "random.hpp"
+#include "save_state.hpp"
 
 Chip8::Chip8()
 {
     logger::Info("Chip8 constructor called");
+    if constexpr (Profiler::ENABLED)
+    {
+        _profiler = std::make_unique<Profiler>();
+    }
+    SetQuirks(QuirkProfile::Vip);
     Reset();
 }
 
@@ -37,18 +47,23 @@ bool Chip8::LoadROM(const std::string& filename)
 
     size_t bytes_read = fread(buffer, 1, file_size, file);
 
-    if (bytes_read == file_size)
+    if (bytes_read != file_size)
     {
-        for (size_t i = 0; i < bytes_read; i++)
-        {
-            _memory[rom_start + i] = buffer[i];
-        }
+        logger::Error("Failed to read ROM");
+        result = false;
     }
-    else
+    else if (bytes_read > size_t{_address_mask} + 1 - rom_start)
     {
-        logger::Error("Failed to read ROM");
+        logger::Error("ROM is {} bytes, at most {} fit in memory", bytes_read, size_t{_address_mask} + 1 - rom_start);
         result = false;
     }
+    else
+    {
+        for (size_t i = 0; i < bytes_read; i++)
+        {
+            _memory.Write(rom_start + i, buffer[i]);
+        }
+    }
 
     delete[] buffer;
     fclose(file);
@@ -57,32 +72,264 @@ bool Chip8::LoadROM(const std::string& filename)
 
 void Chip8::Cycle()
 {
+    // A blocked CPU still spends the cycle: the clock keeps running until
+    // the vblank (or the key) releases it
+    if (Blocked() != StopReason::Budget)
+    {
+        ProfileBlocked(1);
+    }
+    else if (_trace != nullptr)
+    {
+        ExecuteTraced(_cycles);
+    }
+    else
+    {
+        ExecuteOne();
+    }
+    AdvanceClock(1);
+}
+
+// Runs the next unit of work for the current execution mode: one instruction,
+// or in Block and Jit mode the basic blocks up to the next vblank or key event. A CPU blocked on the display
+// wait or FX0A skips straight to the next vblank. Returns the cycles that passed.
+size_t Chip8::Step()
+{
+    ApplyInput();
+    const uint64_t stop = std::min(_next_vblank, NextInputCycle());
+    if (Blocked() != StopReason::Budget)
+    {
+        const uint64_t idle = stop - _cycles;
+        ProfileBlocked(idle);
+        AdvanceClock(idle);
+        return static_cast<size_t>(idle);
+    }
 
-    if (_waiting_for_vblank)
+    if ((_mode == ExecutionMode::Block || _mode == ExecutionMode::Jit) && _trace == nullptr)
     {
-        MaybeTick_vblank();
-        return;
+        const size_t executed = RunBlocks(stop - _cycles);
+        AdvanceClock(executed);
+        return executed;
     }
 
-    
+    Cycle();
+    return 1;
+}
+
+// Runs opcode through the interpreter's Decode/Execute switch as if it had
+// been fetched at PC. Memory is not read for it, the clock does not move and
+// the display and key waits are not honoured: this is for timing handlers in
+// isolation (see bench/opcodes.cpp), not for running programs.
+void Chip8::ExecuteOpcode(uint16_t opcode)
+{
+    _opcode = opcode;
+    Decode();
+    Execute();
+}
+
+// Runs for at most n cycles. Returns early once an instruction executed by
+// this call blocks the CPU; if it was already blocked on entry, the idle
+// cycles up to the vblank (or a queued key event that may end an FX0A
+// wait) are spent first. Queued key events are applied on their cycles.
+RunResult Chip8::RunCycles(uint64_t n)
+{
+    const uint64_t start = _cycles;
+    const uint64_t end = _cycles + n;
+    uint64_t executed = 0;
+
+    while (_cycles < end)
+    {
+        ApplyInput();
+        const uint64_t stop = std::min({end, _next_vblank, NextInputCycle()});
+        if (Blocked() != StopReason::Budget)
+        {
+            if (executed != 0)
+            {
+                break;
+            }
+            const uint64_t idle = stop - _cycles;
+            ProfileBlocked(idle);
+            AdvanceClock(idle);
+            continue;
+        }
+        executed += Run(stop - _cycles);
+    }
+
+    return RunResult{Blocked(), _cycles - start, executed};
+}
+
+// Runs up to the next vblank. A ROM that blocks before then idles out the
+// rest of the frame, unless a queued key event ends its FX0A wait, so every
+// call advances the clock by exactly one frame; reason tells whether it
+// blocked on the way.
+RunResult Chip8::RunFrame()
+{
+    const uint64_t start = _cycles;
+    const uint64_t frame = _frames;
+
+    RunResult result = RunCycles(_next_vblank - _cycles);
+    while (_frames == frame)
+    {
+        result.executed += RunCycles(_next_vblank - _cycles).executed;
+    }
+    result.cycles = _cycles - start;
+    return result;
+}
+
+StopReason Chip8::Blocked() const
+{
+    if (_waiting_for_vblank)
+    {
+        return StopReason::DisplayWait;
+    }
     if (_waiting_for_key)
     {
-        UpdateTimers();
+        return StopReason::KeyWait;
+    }
+    return StopReason::Budget;
+}
+
+void Chip8::ExecuteOne()
+{
+    if (_mode != ExecutionMode::Interpreter)
+    {
+        const Instruction& in = FetchDecoded();
+        if constexpr (Profiler::ENABLED)
+        {
+            _profiler->OnExecute(_pc, in.opcode);
+        }
+        in.handler(*this, in);
         return;
     }
 
     Fetch();
+    if constexpr (Profiler::ENABLED)
+    {
+        _profiler->OnExecute(_pc, _opcode);
+    }
     Decode();
     /*
     logger::Debug("opcode: {:04X}", _opcode);
     logger::Debug("instruction: {:X}", _opcode >> 12);
-    logger::Debug("NNN: {:03X}", _NNN);
-    logger::Debug("NN: {:02X}", __NN);
-    logger::Debug("X: {:02X}", _X);
-    logger::Debug("Y: {:02X}", _Y);
+    logger::Debug("NNN: {:03X}", _instr.NNN);
+    logger::Debug("NN: {:02X}", _instr.NN);
+    logger::Debug("X: {:02X}", _instr.X);
+    logger::Debug("Y: {:02X}", _instr.Y);
     */
     Execute();
-    MaybeTick_vblank();
+}
+
+// Bit i set when byte i of now differs from byte i of before (bytes in
+// memory order; the multiply gathers the low bit of each byte into the top one)
+static uint16_t ChangedBytes(uint64_t before, const uint8_t* now)
+{
+    uint64_t diff;
+    std::memcpy(&diff, now, sizeof(diff));
+    diff ^= before;
+    diff |= diff >> 4;
+    diff |= diff >> 2;
+    diff |= diff >> 1;
+    diff &= 0x0101010101010101ull;
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        diff = std::byteswap(diff);
+    }
+    return static_cast<uint16_t>((diff * 0x0102040810204080ull) >> 56);
+}
+
+// ExecuteOne, recording the instruction and what it changed to the trace.
+// The only instructions that write memory are FX33, FX55 and XO-CHIP's 5XY2,
+// all at I, so the write is worked out from the opcode instead of watching
+// StoreByte.
+void Chip8::ExecuteTraced(uint64_t cycle)
+{
+    const uint16_t pc = _pc & _address_mask;
+    const uint16_t opcode = (_memory[pc] << 8) | _memory[(pc + 1) & _address_mask];
+    const uint16_t I = _I;
+    uint64_t before[2];
+    std::memcpy(before, _V, sizeof(before));
+
+    ExecuteOne();
+
+    TraceRecord& record = _trace->Append();
+    record.cycle = cycle;
+    record.pc = pc;
+    record.opcode = opcode;
+    record.i = _I;
+    std::memcpy(record.v, _V, sizeof(record.v));
+    record.v_changed = ChangedBytes(before[0], record.v) | ChangedBytes(before[1], record.v + 8) << 8;
+    record.mem_addr = 0;
+    record.mem_count = 0;
+    switch (opcode & 0xF0FF)
+    {
+        case 0xF033: record.mem_addr = I & _address_mask; record.mem_count = 3; break;
+        case 0xF055: record.mem_addr = I & _address_mask; record.mem_count = ((opcode >> 8) & 0xF) + 1; break;
+    }
+    if (_xo_chip && (opcode & 0xF00F) == 0x5002)
+    {
+        record.mem_addr = I & _address_mask;
+        record.mem_count = static_cast<uint8_t>(std::abs(((opcode >> 8) & 0xF) - ((opcode >> 4) & 0xF)) + 1);
+    }
+    record.sp = static_cast<uint8_t>(_sp);
+    record.delay_timer = _delay_timer;
+    record.sound_timer = _sound_timer;
+    record.flags = 0;
+    if ((opcode & 0xF000) == 0xD000 || opcode == 0x00E0)
+    {
+        record.flags |= TraceRecord::DREW;
+    }
+    if (Blocked() != StopReason::Budget)
+    {
+        record.flags |= TraceRecord::BLOCKED;
+    }
+    record.reserved = 0;
+}
+
+// Inner loop: executes up to limit instructions, stopping early if the CPU
+// blocks. limit never reaches past the next vblank, so the clock is only
+// advanced once at the end.
+uint64_t Chip8::Run(uint64_t limit)
+{
+    uint64_t done = 0;
+    if (_trace != nullptr)
+    {
+        // one instruction at a time in every mode, so each gets its record
+        while (done < limit && !_waiting_for_vblank && !_waiting_for_key)
+        {
+            ExecuteTraced(_cycles + done);
+            done++;
+        }
+        AdvanceClock(done);
+        return done;
+    }
+
+    switch (_mode)
+    {
+        case ExecutionMode::Interpreter:
+            while (done < limit && !_waiting_for_vblank && !_waiting_for_key)
+            {
+                ExecuteOne();
+                done++;
+            }
+            break;
+        case ExecutionMode::Cached:
+            while (done < limit && !_waiting_for_vblank && !_waiting_for_key)
+            {
+                const Instruction& in = FetchDecoded();
+                if constexpr (Profiler::ENABLED)
+                {
+                    _profiler->OnExecute(_pc, in.opcode);
+                }
+                in.handler(*this, in);
+                done++;
+            }
+            break;
+        case ExecutionMode::Block:
+        case ExecutionMode::Jit:
+            done = RunBlocks(limit);
+            break;
+    }
+    AdvanceClock(done);
+    return done;
 }
 
 void Chip8::Update()
@@ -92,24 +339,34 @@ void Chip8::Update()
 
 void Chip8::Fetch()
 {
-    _opcode = (_memory[_pc] << 8) | _memory[_pc + 1];
+    _pc &= _address_mask;
+    _opcode = (_memory[_pc] << 8) | _memory[(_pc + 1) & _address_mask];
 }
 
 void Chip8::Decode()
 {
-    _NNN = 0x0FFF & _opcode;
-    __NN = 0x00FF & _opcode;
-    ___N = 0x000F & _opcode;
+    _instr.opcode = _opcode;
+    _instr.NNN = 0x0FFF & _opcode;
+    _instr.NN = 0x00FF & _opcode;
+    _instr.N = 0x000F & _opcode;
     Get_X();
     Get_Y();
 }
 
+// Runs the decoded opcode through the interpreter's switch, specialized for
+// the current quirk profile
 void Chip8::Execute()
+{
+    (this->*_execute)();
+}
+
+template <typename Q>
+void Chip8::ExecuteAs()
 {
     switch (_opcode >> 12)
     {
         case 0x0:
-            Execute_0x0();
+            Execute_0x0<Q>();
             break;
         case 0x1:
             Execute_0x1();
@@ -118,13 +375,13 @@ void Chip8::Execute()
             Execute_0x2();
             break;
         case 0x3:
-            Execute_0x3();
+            Execute_0x3<Q>();
             break;
         case 0x4:
-            Execute_0x4();
+            Execute_0x4<Q>();
             break;
         case 0x5:
-            Execute_0x5();
+            Execute_0x5<Q>();
             break;
         case 0x6:
             Execute_0x6();
@@ -133,28 +390,28 @@ void Chip8::Execute()
             Execute_0x7();
             break;
         case 0x8:
-            Execute_0x8();
+            Execute_0x8<Q>();
             break;
         case 0x9:
-            Execute_0x9();
+            Execute_0x9<Q>();
             break;
         case 0xA:
             Execute_0xA();
             break;
         case 0xB:
-            Execute_0xB();
+            Execute_0xB<Q>();
             break;
         case 0xC:
             Execute_0xC();
             break;
         case 0xD:
-            Execute_0xD();
+            Execute_0xD<Q>();
             break;
         case 0xE:
-            Execute_0xE();
+            Execute_0xE<Q>();
             break;
         case 0xF:
-            Execute_0xF();
+            Execute_0xF<Q>();
             break;
     }
 }
@@ -164,29 +421,106 @@ bool Chip8::DrawFlag()
     return _draw_flag;
 }
 
+uint64_t Chip8::TakeDirtyRows()
+{
+    const uint64_t dirty = _dirty_rows;
+    _dirty_rows = 0;
+    _draw_flag = false;
+    return dirty;
+}
+
 void Chip8::Reset()
 {
-    std::fill(std::begin(_memory), std::end(_memory), 0);
+    _memory.Clear();
     std::fill(std::begin(_V), std::end(_V), 0);
     _I = 0;
     _pc = rom_start;
     _delay_timer = 0;
     _sound_timer = 0;
+    _sound_on = false;
+    _input.clear();
     std::fill(std::begin(_stack), std::end(_stack), 0);
     _sp = 0;
     std::fill(std::begin(_key), std::end(_key), 0);
-    std::fill(std::begin(_gfx), std::end(_gfx), 0);
+    std::fill(&_gfx[0][0], &_gfx[0][0] + std::size(_gfx) * framebuffer::WORDS, 0);
+    _hires = false;
+    _planes = 1;
+    std::fill(std::begin(_rpl), std::end(_rpl), 0);
+    std::fill(std::begin(_audio_pattern), std::end(_audio_pattern), DEFAULT_PATTERN);
+    _pitch = DEFAULT_PITCH;
     _opcode = 0;
-    _draw_flag = false;
-    bool _waiting_for_key = false;
-    uint8_t _waiting_register = -1;
+    _instr = Instruction{};
+    InvalidateCode();
+    // whole screen is redrawn after a reset
+    _draw_flag = true;
+    _dirty_rows = ~uint64_t{0};
+    _waiting_for_key = false;
+    _waiting_register = IDLE_REGISTER;
+    _waiting_for_vblank = false;
     InitFontset();
-    _next_vblank = std::chrono::steady_clock::now();
+    _rng.Seed(_seed);
+    _cycles = 0;
+    _frames = 0;
+    _next_vblank = 0;
+    _frame_remainder = 0;
+    ScheduleVBlank();
+    if constexpr (Profiler::ENABLED)
+    {
+        _profiler->Clear();
+    }
 }
 
+// Clears the selected bitplanes (only the first one outside XO-CHIP)
 void Chip8::ClearScreen()
 {
-    std::fill(std::begin(_gfx), std::end(_gfx), 0);
+    // only rows that had pixels lit change
+    uint64_t dirty = 0;
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        if (((_planes >> p) & 0x1) == 0)
+        {
+            continue;
+        }
+        uint64_t* rows = _gfx[p];
+        for (int y = 0; y < GetHeight(); y++)
+        {
+            dirty |= static_cast<uint64_t>((rows[y] | rows[framebuffer::PLANE + y]) != 0) << y;
+            rows[y] = 0;
+            rows[framebuffer::PLANE + y] = 0;
+        }
+    }
+    MarkDirty(dirty);
+}
+
+// Runs one of the framebuffer:: scrolls over the selected bitplanes
+void Chip8::Scroll(uint64_t (*scroll)(uint64_t*, int, int, int), int n)
+{
+    uint64_t dirty = 0;
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        if (((_planes >> p) & 0x1) != 0)
+        {
+            dirty |= scroll(_gfx[p], _hires ? 2 : 1, GetHeight(), n);
+        }
+    }
+    MarkDirty(dirty);
+}
+
+// Switches between the 64x32 and 128x64 display and clears it (every
+// bitplane), as SUPER-CHIP and XO-CHIP interpreters do. The host sees the
+// new size from GetWidth() / GetHeight() and every row of it is marked dirty.
+void Chip8::SetHiRes(bool hires)
+{
+    std::fill(&_gfx[0][0], &_gfx[0][0] + std::size(_gfx) * framebuffer::WORDS, 0);
+    _hires = hires;
+    _dirty_rows = ~uint64_t{0};
+    _draw_flag = true;
+}
+
+void Chip8::MarkDirty(uint64_t rows)
+{
+    _dirty_rows |= rows;
+    _draw_flag = _draw_flag || rows != 0;
 }
 
 void Chip8::Debug_Print(PrintMode pm = PrintMode::Hex)
@@ -263,22 +597,18 @@ void Chip8::Debug_Print(PrintMode pm = PrintMode::Hex)
 
 void Chip8::Debug_PrintGfx()
 {
-    auto idx = [&](int x, int y)
-    {
-        return (y * W) + x;
-    };
-    for (size_t col = 0; col < W; col++)
+    const int width = GetWidth();
+    for (int col = 0; col < width; col++)
     {
         logger::Print("_");
     }
     logger::Print("\n");
-    for (size_t row = 0; row < H; row++)
+    for (int row = 0; row < GetHeight(); row++)
     {
         logger::Print("|");
-        for (size_t col = 0; col < W; col++)
+        for (int col = 0; col < width; col++)
         {
-            int i = idx(col, row);
-            if (_gfx[i] != 0)
+            if (GetPixel(col, row))
             {
                 logger::Print("X");
             }
@@ -289,7 +619,7 @@ void Chip8::Debug_PrintGfx()
         }
         logger::Print("|\n");
     }
-    for (size_t col = 0; col < W; col++)
+    for (int col = 0; col < width; col++)
     {
         logger::Print("_");
     }
@@ -318,10 +648,7 @@ return sizeof(_fontset) / sizeof(_fontset[0]);
 
 void Chip8::IncrementProgramCounter(int n = 1)
 {
-    for (int i = 0; i < n; i++)
-    {
-        _pc += 2;
-    }
+    _pc += 2 * n;
 }
 
 uint8_t (&Chip8::GetRegisters())[16]
@@ -329,9 +656,91 @@ uint8_t (&Chip8::GetRegisters())[16]
     return _V;
 }
 
-uint8_t (&Chip8::GetGfx())[W * H]
+// Bitplane 0, the only one outside XO-CHIP
+uint64_t (&Chip8::GetGfx())[framebuffer::WORDS]
+{
+    return _gfx[0];
+}
+
+uint64_t (&Chip8::GetGfx(int bitplane))[framebuffer::WORDS]
+{
+    return _gfx[bitplane & 0x1];
+}
+
+bool Chip8::GetHiRes() const
+{
+    return _hires;
+}
+
+int Chip8::GetWidth() const
+{
+    return _hires ? HIRES_W : W;
+}
+
+int Chip8::GetHeight() const
+{
+    return _hires ? HIRES_H : H;
+}
+
+// framebuffer::Hash of the display at its current resolution; for 64x32
+// that is the first H words, so hashes of CHIP-8 programs are unchanged.
+// The second XO-CHIP bitplane is folded in only once something is on it.
+uint64_t Chip8::GetGfxHash() const
+{
+    const int words = _hires ? framebuffer::WORDS : H;
+    const uint64_t hash = framebuffer::Hash(_gfx[0], words);
+    const bool second = std::any_of(_gfx[1], _gfx[1] + words, [](uint64_t row) { return row != 0; });
+    return second ? framebuffer::Hash(_gfx[1], words, hash) : hash;
+}
+
+// True if the pixel is lit on either bitplane
+bool Chip8::GetPixel(int x, int y)
+{
+    x %= GetWidth();
+    y %= GetHeight();
+    const int word = (x < 64) ? y : framebuffer::PLANE + y;
+    return framebuffer::Pixel(_gfx[0][word] | _gfx[1][word], x % 64);
+}
+
+// Writes GetWidth() * GetHeight() bytes, row by row: the pixel's colour,
+// bit 0 from bitplane 0 and bit 1 from bitplane 1 (so 0 or 1 unless an
+// XO-CHIP program drew to the second one)
+void Chip8::UnpackGfx(uint8_t (&out)[HIRES_W * HIRES_H])
+{
+    const int width = GetWidth();
+    uint8_t second[W];
+    for (int y = 0; y < GetHeight(); y++)
+    {
+        for (int half = 0; half < width / W; half++)
+        {
+            uint8_t* dst = out + (y * width) + half * W;
+            const int word = half * framebuffer::PLANE + y;
+            framebuffer::UnpackRow(_gfx[0][word], dst, W);
+            framebuffer::UnpackRow(_gfx[1][word], second, W);
+            for (int x = 0; x < W; x++)
+            {
+                dst[x] |= second[x] << 1;
+            }
+        }
+    }
+}
+
+// The XO-CHIP sample loop: 128 one-bit samples, most significant bit of
+// byte 0 first, played while the sound timer is non-zero
+const uint8_t (&Chip8::GetAudioPattern() const)[16]
+{
+    return _audio_pattern;
+}
+
+uint8_t Chip8::GetPitch() const
+{
+    return _pitch;
+}
+
+// Samples of GetAudioPattern() played per second: 4000 * 2 ^ ((pitch - 64) / 48)
+double Chip8::GetPatternRate() const
 {
-    return _gfx;
+    return 4000.0 * std::exp2((static_cast<int>(_pitch) - 64) / 48.0);
 }
 
 uint8_t& Chip8::GetDelayTimer()
@@ -344,6 +753,13 @@ uint8_t& Chip8::GetSoundTimer()
     return _sound_timer;
 }
 
+// Whether the buzzer sounded for the timer tick that ended at the last
+// vblank: the sound timer was non-zero then, even if that tick took it to 0
+bool Chip8::GetSoundOn() const
+{
+    return _sound_on;
+}
+
 void Chip8::SetDelayTimer(uint8_t t)
 {
     _delay_timer = t;
@@ -368,7 +784,7 @@ void Chip8::OnKeyPressed(uint8_t k)
 {
     _key[k] = 0x1;
     
-    if (_waiting_for_key && _waiting_register != -1)
+    if (_waiting_for_key && _waiting_register != IDLE_REGISTER)
     {
         _V[_waiting_register] = k;
     }
@@ -383,330 +799,1211 @@ void Chip8::OnKeyReleased(uint8_t k)
         IncrementProgramCounter();
     }
     _waiting_for_key = false;
-    _waiting_register = -1;
+    _waiting_register = IDLE_REGISTER;
 }
 
-void Chip8::Execute_0x0()
+// Queues a key press or release for the given cycle. RunCycles, RunFrame and
+// Step apply it when the clock gets there, before the instruction on that
+// cycle, so input lands at the same point whatever the host's frame timing.
+// Events keep the order they were queued in: a cycle already passed, or
+// before the last queued event's, is moved up to it. Returns the cycle the
+// event will be applied on.
+uint64_t Chip8::QueueKey(uint64_t cycle, uint8_t k, bool down)
 {
-    if (_opcode == 0x00E0)
-    {
-        ClearScreen();
-        IncrementProgramCounter();
-    }
-    else if (_opcode == 0x00EE)
+    cycle = std::max({cycle, _cycles, _input.empty() ? 0 : _input.back().cycle});
+    _input.push_back(InputEvent{cycle, static_cast<uint8_t>(k & 0xF), down});
+    return cycle;
+}
+
+// Drops the key events not applied yet
+void Chip8::ClearInput()
+{
+    _input.clear();
+}
+
+void Chip8::ApplyInput()
+{
+    while (!_input.empty() && _input.front().cycle <= _cycles)
     {
-        if (_sp >= 0)
+        const InputEvent ev = _input.front();
+        _input.pop_front();
+        if (ev.down)
         {
-            _sp--;
+            OnKeyPressed(ev.key);
+        }
+        else
+        {
+            OnKeyReleased(ev.key);
         }
-        _pc = _stack[_sp];
-        _stack[_sp] = 0;
-        IncrementProgramCounter();
     }
-    else
+}
+
+// Cycle of the next queued key event, or never
+uint64_t Chip8::NextInputCycle() const
+{
+    return _input.empty() ? UINT64_MAX : _input.front().cycle;
+}
+
+template <typename Q>
+void Chip8::Execute_0x0()
+{
+    switch (_opcode)
     {
-        logger::Debug("This opcode {:04X}, is of 0x0NNN, and is ignored", _opcode);
-        IncrementProgramCounter();
+        case 0x00E0:
+            Op_00E0(*this, _instr);
+            break;
+        case 0x00EE:
+            Op_00EE(*this, _instr);
+            break;
+        case 0x00FB:
+            Op_00FB(*this, _instr);
+            break;
+        case 0x00FC:
+            Op_00FC(*this, _instr);
+            break;
+        case 0x00FD:
+            Op_00FD(*this, _instr);
+            break;
+        case 0x00FE:
+            Op_00FE(*this, _instr);
+            break;
+        case 0x00FF:
+            Op_00FF(*this, _instr);
+            break;
+        default:
+            if ((_opcode & 0xFFF0) == 0x00C0)
+            {
+                Op_00CN(*this, _instr);
+            }
+            else if (Q::XO_CHIP && (_opcode & 0xFFF0) == 0x00D0)
+            {
+                Op_00DN(*this, _instr);
+            }
+            else
+            {
+                Op_0NNN(*this, _instr);
+            }
+            break;
     }
 }
 
 void Chip8::Execute_0x1()
 {
-    _pc = _NNN;
+    Op_1NNN(*this, _instr);
 }
 
 void Chip8::Execute_0x2()
 {
-    if (_sp >= StackSize())
-    {
-        logger::Error("Stack Overflow: sp={:0X}", _sp);
-    }
-    _stack[_sp] = _pc;
-    _sp++;
-    _pc = _NNN;
+    Op_2NNN(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0x3()
 {
-    uint8_t n = 1;
-    uint16_t X = 0x0F00 & _opcode;
-    X >>= 8;
-    if (_V[X] == __NN)
-    {
-        n = 2; // skips the next instruction
-    }
-    IncrementProgramCounter(n);
+    Op_3XNN<Q>(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0x4()
 {
-    uint8_t n = 1;
-    if (_V[_X] != __NN)
-    {
-        n = 2; // skips the next instruction
-    }
-    IncrementProgramCounter(n);
+    Op_4XNN<Q>(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0x5()
 {
-    uint8_t n = 1;
-    if (_V[_X] == _V[_Y])
+    if (Q::XO_CHIP && (_opcode & 0x000F) == 0x2)
+    {
+        Op_5XY2(*this, _instr);
+    }
+    else if (Q::XO_CHIP && (_opcode & 0x000F) == 0x3)
+    {
+        Op_5XY3(*this, _instr);
+    }
+    else
     {
-        n = 2; // skips the next instruction
+        Op_5XY0<Q>(*this, _instr);
     }
-    IncrementProgramCounter(n);
 }
 
 void Chip8::Execute_0x6()
 {
-    _V[_X] = __NN;
-    IncrementProgramCounter();
+    Op_6XNN(*this, _instr);
 }
 
 void Chip8::Execute_0x7()
 {
-    _V[_X] += __NN;
-    IncrementProgramCounter();
+    Op_7XNN(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0x8()
 {
-
-    uint16_t option = 0xF00F & _opcode;
-    uint8_t Vx = _V[_X];
-    uint8_t Vy = _V[_Y];
-    switch (option)
+    switch (_opcode & 0x000F)
     {
-        case 0x8000:
-            _V[_X] = _V[_Y];
+        case 0x0:
+            Op_8XY0(*this, _instr);
             break;
-        case 0x8001:
-            _V[_X] |= _V[_Y];
-            VF_FlagClear(); // chip-8 compatibility
+        case 0x1:
+            Op_8XY1<Q>(*this, _instr);
             break;
-        case 0x8002:
-            _V[_X] &= _V[_Y];
-            VF_FlagClear(); // chip-8 compatibility
+        case 0x2:
+            Op_8XY2<Q>(*this, _instr);
             break;
-        case 0x8003:
-            _V[_X] ^= _V[_Y];
-            VF_FlagClear(); // chip-8 compatibility
+        case 0x3:
+            Op_8XY3<Q>(*this, _instr);
             break;
-        case 0x8004:
-        {
-            //_V[_X] += _V[_Y];
-            //(Vx + Vx > 255) ? VF_Flag() : VF_FlagClear();
-            const uint16_t sum = static_cast<uint16_t>(Vx) + static_cast<uint16_t>(Vy);
-
-            _V[_X] = static_cast<uint8_t>(sum);
-
-            if (sum > 0xFF)
-            {
-                VF_Flag();
-            }
-            else
-            {
-                VF_FlagClear();
-            }
-
+        case 0x4:
+            Op_8XY4(*this, _instr);
             break;
-        }
-        case 0x8005:
-        {
-            _V[_X] = Vx - Vy;
-            (Vx >= Vy) ? VF_Flag() : VF_FlagClear();
-            // doing this ordering to pass test cases because some ROMs use VF as VX
+        case 0x5:
+            Op_8XY5(*this, _instr);
             break;
-        }
-        case 0x8006:
-        {
-            _V[_X] = _V[_Y]; // chip-8 compatibility
-            Vx = _V[_X] & 0x01;
-            _V[_X] >>= 1;
-            _V[0xF] = Vx;
+        case 0x6:
+            Op_8XY6<Q>(*this, _instr);
             break;
-        } 
-        case 0x8007:
-        {
-            _V[_X] = Vy - Vx;
-            (Vy >= Vx) ? VF_Flag() : VF_FlagClear();
+        case 0x7:
+            Op_8XY7(*this, _instr);
             break;
-        }
-        case 0x800E:
-        {
-            _V[_X] = _V[_Y]; // chip-8 compatibility
-            Vx = (_V[_X] >> 7) & 0x01;
-            _V[_X] <<= 1;
-            _V[0xF] = Vx;
+        case 0xE:
+            Op_8XYE<Q>(*this, _instr);
             break;
-        }
         default:
-            logger::Warn("Unknown opcode {:04X}", _opcode);
+            Op_Unknown(*this, _instr);
             break;
     }
-   IncrementProgramCounter();
 }
 
+template <typename Q>
 void Chip8::Execute_0x9()
 {
-    uint8_t n = 1;
-    if (_V[_X] != _V[_Y])
-    {
-        n = 2; // skips the next instruction
-    }
-    IncrementProgramCounter(n);
+    Op_9XY0<Q>(*this, _instr);
 }
 
 void Chip8::Execute_0xA()
 {
-    _I = 0x0FFF & _NNN;
-    IncrementProgramCounter();
+    Op_ANNN(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0xB()
 {
-    _pc = _V[0x0] + _NNN;
+    Op_BNNN<Q>(*this, _instr);
 }
 
 void Chip8::Execute_0xC()
 {
-    uint8_t rand_num = rng::RandomNum_8Bit();
-    _V[_X] =  rand_num & __NN;
-    IncrementProgramCounter();
+    Op_CXNN(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0xD()
 {
-    uint16_t base_x = _V[_X] % W;
-    uint16_t base_y = _V[_Y] % H;
-    auto idx = [&](int x, int y)
-    {
-        return (y * W) + x;
-    };
-    _V[0xF] = 0x0;
-    for (size_t row = 0; row < ___N; row++)
-    {
-        uint8_t sprite = _memory[(_I + row) & 0xFFF];
-        for (size_t col = 0; col < 8; col++)
-        {
-            if ((sprite & (0x80 >> col)) == 0)
-            {
-                continue;
-            }
-
-            int x = static_cast<int>(base_x) + static_cast<int>(col);
-            int y = static_cast<int>(base_y) + static_cast<int>(row);
-            
-            int k; //= idx((x % W, y % H);
-            
-            // clipping
-            if (x < 0 || x >= W || y < 0 || y >= H)
-            {
-                continue;
-            }
-
-            k = idx(x, y);
-
-            if (_gfx[k] == 0x1)
-            {
-                VF_Flag();
-            }
-            _gfx[k] ^= 1;
-            
-        }
-    }
-    _waiting_for_vblank = true;
-    IncrementProgramCounter();
+    Op_DXYN<Q>(*this, _instr);
 }
 
+template <typename Q>
 void Chip8::Execute_0xE()
 {
-   uint8_t k = _V[_X];
-   k &= 0x0F;    // Only use lowest nibble of VX as key index
-   uint8_t n = 1;
-   switch (_opcode & 0x00FF)
-   {
+    switch (_opcode & 0x00FF)
+    {
         case 0x9E:
-            if (_key[k] == 0x1)
-            {
-                n = 2;
-            }
+            Op_EX9E<Q>(*this, _instr);
             break;
         case 0xA1:
-            if (_key[k] != 0x1)
-            {
-                n = 2;
-            }
+            Op_EXA1<Q>(*this, _instr);
             break;
         default:
-            logger::Warn("Unknown opcode {:04X}", _opcode);
+            Op_Unknown(*this, _instr);
             break;
-   }
-   IncrementProgramCounter(n);
+    }
 }
 
+template <typename Q>
 void Chip8::Execute_0xF()
 {
-    uint8_t n = 1;
-    int pressed = -1;
-    uint8_t font_char = 0x0;
     switch (_opcode & 0x00FF)
     {
+        case 0x00:
+            if (Q::XO_CHIP && _opcode == 0xF000)
+            {
+                Op_F000(*this, _instr);
+            }
+            else
+            {
+                Op_Unknown(*this, _instr);
+            }
+            break;
+        case 0x01:
+            if (Q::XO_CHIP)
+            {
+                Op_FN01(*this, _instr);
+            }
+            else
+            {
+                Op_Unknown(*this, _instr);
+            }
+            break;
+        case 0x02:
+            if (Q::XO_CHIP && _opcode == 0xF002)
+            {
+                Op_F002(*this, _instr);
+            }
+            else
+            {
+                Op_Unknown(*this, _instr);
+            }
+            break;
         case 0x07:
-            _V[_X] = GetDelayTimer();
+            Op_FX07(*this, _instr);
+            break;
+        case 0x0A:
+            Op_FX0A(*this, _instr);
             break;
-        case 0x0A:    
-            _waiting_for_key = true;
-            _waiting_register = _X;
-            return;
         case 0x15:
-            SetDelayTimer(_V[_X]);
+            Op_FX15(*this, _instr);
             break;
         case 0x18:
-            SetSoundTimer(_V[_X]);
+            Op_FX18(*this, _instr);
             break;
         case 0x1E:
-            _I += _V[_X];
+            Op_FX1E(*this, _instr);
             break;
         case 0x29:
-            font_char = _V[_X] & 0x0F;
-            _I = _fontset_start + (font_char * 0x05);
+            Op_FX29(*this, _instr);
+            break;
+        case 0x30:
+            Op_FX30(*this, _instr);
             break;
         case 0x33:
-            _memory[_I] = _V[_X] / 100;
-            _memory[_I + 1] = (_V[_X] / 10) % 10;
-            _memory[_I + 2] = _V[_X] % 10;
+            Op_FX33(*this, _instr);
             break;
-        case 0x55:
-            for (int X = 0; X <= _X; X++)
+        case 0x3A:
+            if (Q::XO_CHIP)
+            {
+                Op_FX3A(*this, _instr);
+            }
+            else
             {
-                _memory[_I + X] = _V[X];
+                Op_Unknown(*this, _instr);
             }
-            _I += _X + 1;
+            break;
+        case 0x55:
+            Op_FX55<Q>(*this, _instr);
             break;
         case 0x65:
-            for (int X = 0; X <= _X; X++)
+            Op_FX65<Q>(*this, _instr);
+            break;
+        case 0x75:
+            Op_FX75(*this, _instr);
+            break;
+        case 0x85:
+            Op_FX85(*this, _instr);
+            break;
+        default:
+            Op_Unknown(*this, _instr);
+            break;
+    }
+}
+
+/*
+    Decode cache
+
+    DecodeInstruction() resolves an opcode once into the handler for that
+    exact instruction plus its operands, so the cached path needs neither the
+    nibble switch in Execute() nor the second switch inside Execute_0x8,
+    Execute_0xE and Execute_0xF. Entries are indexed by PC / 2 and filled on
+    first use. A store into memory clears the entry that covers the byte.
+*/
+
+template <typename Q>
+Instruction Chip8::DecodeInstruction(uint16_t opcode)
+{
+    Instruction in;
+    in.opcode = opcode;
+    in.NNN = 0x0FFF & opcode;
+    in.NN = 0x00FF & opcode;
+    in.N = 0x000F & opcode;
+    in.X = (opcode & 0x0F00) >> 8;
+    in.Y = (opcode & 0x00F0) >> 4;
+
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            switch (opcode)
             {
-                _V[X] = _memory[_I + X];
+                case 0x00E0: in.handler = Op_00E0; break;
+                case 0x00EE: in.handler = Op_00EE; break;
+                case 0x00FB: in.handler = Op_00FB; break;
+                case 0x00FC: in.handler = Op_00FC; break;
+                case 0x00FD: in.handler = Op_00FD; break;
+                case 0x00FE: in.handler = Op_00FE; break;
+                case 0x00FF: in.handler = Op_00FF; break;
+                default:
+                    if ((opcode & 0xFFF0) == 0x00C0)
+                    {
+                        in.handler = Op_00CN;
+                    }
+                    else if (Q::XO_CHIP && (opcode & 0xFFF0) == 0x00D0)
+                    {
+                        in.handler = Op_00DN;
+                    }
+                    else
+                    {
+                        in.handler = Op_0NNN;
+                    }
+                    break;
             }
-            _I += _X + 1;
             break;
-        default:
-            logger::Warn("Unknown opcode {:04X}", _opcode);
+        case 0x1:
+            in.handler = Op_1NNN;
+            break;
+        case 0x2:
+            in.handler = Op_2NNN;
+            break;
+        case 0x3:
+            in.handler = Op_3XNN<Q>;
+            break;
+        case 0x4:
+            in.handler = Op_4XNN<Q>;
+            break;
+        case 0x5:
+            switch (Q::XO_CHIP ? (opcode & 0x000F) : 0x0)
+            {
+                case 0x2: in.handler = Op_5XY2; break;
+                case 0x3: in.handler = Op_5XY3; break;
+                default:  in.handler = Op_5XY0<Q>; break;
+            }
+            break;
+        case 0x6:
+            in.handler = Op_6XNN;
+            break;
+        case 0x7:
+            in.handler = Op_7XNN;
+            break;
+        case 0x8:
+            switch (opcode & 0x000F)
+            {
+                case 0x0: in.handler = Op_8XY0; break;
+                case 0x1: in.handler = Op_8XY1<Q>; break;
+                case 0x2: in.handler = Op_8XY2<Q>; break;
+                case 0x3: in.handler = Op_8XY3<Q>; break;
+                case 0x4: in.handler = Op_8XY4; break;
+                case 0x5: in.handler = Op_8XY5; break;
+                case 0x6: in.handler = Op_8XY6<Q>; break;
+                case 0x7: in.handler = Op_8XY7; break;
+                case 0xE: in.handler = Op_8XYE<Q>; break;
+                default:  in.handler = Op_Unknown; break;
+            }
+            break;
+        case 0x9:
+            in.handler = Op_9XY0<Q>;
+            break;
+        case 0xA:
+            in.handler = Op_ANNN;
+            break;
+        case 0xB:
+            in.handler = Op_BNNN<Q>;
+            break;
+        case 0xC:
+            in.handler = Op_CXNN;
+            break;
+        case 0xD:
+            in.handler = Op_DXYN<Q>;
+            break;
+        case 0xE:
+            switch (opcode & 0x00FF)
+            {
+                case 0x9E: in.handler = Op_EX9E<Q>; break;
+                case 0xA1: in.handler = Op_EXA1<Q>; break;
+                default:   in.handler = Op_Unknown; break;
+            }
+            break;
+        case 0xF:
+            switch (opcode & 0x00FF)
+            {
+                case 0x00: in.handler = (Q::XO_CHIP && opcode == 0xF000) ? Op_F000 : Op_Unknown; break;
+                case 0x01: in.handler = Q::XO_CHIP ? Op_FN01 : Op_Unknown; break;
+                case 0x02: in.handler = (Q::XO_CHIP && opcode == 0xF002) ? Op_F002 : Op_Unknown; break;
+                case 0x07: in.handler = Op_FX07; break;
+                case 0x0A: in.handler = Op_FX0A; break;
+                case 0x15: in.handler = Op_FX15; break;
+                case 0x18: in.handler = Op_FX18; break;
+                case 0x1E: in.handler = Op_FX1E; break;
+                case 0x29: in.handler = Op_FX29; break;
+                case 0x30: in.handler = Op_FX30; break;
+                case 0x33: in.handler = Op_FX33; break;
+                case 0x3A: in.handler = Q::XO_CHIP ? Op_FX3A : Op_Unknown; break;
+                case 0x55: in.handler = Op_FX55<Q>; break;
+                case 0x65: in.handler = Op_FX65<Q>; break;
+                case 0x75: in.handler = Op_FX75; break;
+                case 0x85: in.handler = Op_FX85; break;
+                default:   in.handler = Op_Unknown; break;
+            }
+            break;
+    }
+    return in;
+}
+
+const Instruction& Chip8::FetchDecoded()
+{
+    const uint16_t pc = _pc &= _address_mask;
+    if ((pc & 0x1) != 0 || pc >= RAM || _mode == ExecutionMode::Jit)
+    {
+        // odd PC, or XO-CHIP code past the first 4 KB: not cacheable,
+        // decode into the scratch slot. Nor in Jit mode, where native
+        // stores only drop the blocks they hit, not decoded instructions.
+        _instr = _decode((_memory[pc] << 8) | _memory[(pc + 1) & _address_mask]);
+        return _instr;
+    }
+
+    if (_decode_cache.empty())
+    {
+        _decode_cache.resize(RAM / 2);
+    }
+
+    Instruction& entry = _decode_cache[pc >> 1];
+    if (entry.handler == nullptr)
+    {
+        entry = _decode((_memory[pc] << 8) | _memory[pc + 1]);
+    }
+    return entry;
+}
+
+void Chip8::StoreByte(uint16_t addr, uint8_t value)
+{
+    addr &= _address_mask;
+    _memory.Write(addr, value);
+    if (addr >= RAM)
+    {
+        // XO-CHIP data: nothing is ever decoded from here
+        return;
+    }
+    if (!_decode_cache.empty())
+    {
+        _decode_cache[addr >> 1].handler = nullptr;
+    }
+    _blocks.OnStore(addr);
+}
+
+// Drops decoded instructions and blocks that read any byte in [start, end)
+void Chip8::InvalidateCodeRange(uint32_t start, uint32_t end)
+{
+    end = std::min<uint32_t>(end, RAM);
+    if (start >= end)
+    {
+        return;
+    }
+    if (!_decode_cache.empty())
+    {
+        std::fill(_decode_cache.begin() + start / 2, _decode_cache.begin() + (end + 1) / 2, Instruction{});
+    }
+    _blocks.InvalidateRange(start, end);
+}
+
+void Chip8::InvalidateCode()
+{
+    std::fill(_decode_cache.begin(), _decode_cache.end(), Instruction{});
+    _blocks.Clear();
+    if (_jit)
+    {
+        _jit->Reset();
+    }
+}
+
+BlockCache::Block& Chip8::TranslateBlock(uint16_t pc)
+{
+    std::vector<Instruction> ops;
+    uint32_t addr = pc;
+    while (ops.size() < BlockCache::MAX_BLOCK_LENGTH && addr + 1 < RAM)
+    {
+        const uint16_t opcode = (_memory[addr] << 8) | _memory[addr + 1];
+        const uint32_t length = (_xo_chip && opcode == 0xF000) ? 4 : 2;
+        if (addr + length > RAM)
+        {
+            break;
+        }
+        ops.push_back(_decode(opcode));
+        addr += length;
+        if (BlockCache::EndsBlock(opcode))
+        {
             break;
+        }
+    }
+
+    // Native code for a skip at the end of an XO-CHIP block has it built in
+    // whether the next word is an F000 to step over, so that word is part
+    // of the block too: a store to it drops the block
+    const uint32_t end = _xo_chip ? std::min<uint32_t>(addr + 2, RAM) : addr;
+    return _blocks.Insert(pc, end, std::move(ops));
+}
+
+// Runs basic blocks back to back for up to limit instructions, stopping
+// early once the CPU blocks. A block that does not fit in what is left of
+// limit is single-stepped instead, so the timers change on the exact cycle.
+// Returns the instructions executed; the caller advances the clock.
+size_t Chip8::RunBlocks(uint64_t limit)
+{
+    if (!_blocks.Allocated())
+    {
+        _blocks.Allocate(RAM);
+    }
+
+    size_t done = 0;
+    BlockCache::Block* prev = nullptr;  // the block just run, while its epoch lasts
+    uint32_t epoch = 0;
+    while (done < limit && !_waiting_for_vblank && !_waiting_for_key)
+    {
+        const uint16_t pc = _pc &= _address_mask;
+        if (pc + 4 > RAM)
+        {
+            // too close to the end of RAM for a block to be sure to hold a
+            // whole instruction (F000 NNNN takes 4 bytes), or XO-CHIP code
+            // beyond it
+            ExecuteOne();
+            done++;
+            prev = nullptr;
+            continue;
+        }
+
+        BlockCache::Block* block = (prev != nullptr && epoch == _blocks.Epoch()) ? _blocks.FindAfter(*prev, pc) : _blocks.Find(pc);
+        if (block == nullptr)
+        {
+            block = &TranslateBlock(pc);
+        }
+
+        const size_t length = block->ops.size();
+        if (length > limit - done)
+        {
+            // the block would run past the budget or across a vblank: single-step
+            // up to it
+            ExecuteOne();
+            done++;
+            prev = nullptr;
+            continue;
+        }
+
+        if (_mode == ExecutionMode::Jit && block->native == nullptr && ++block->hits == JIT_THRESHOLD)
+        {
+            CompileBlock(*block);
+        }
+
+        // a block that jumps back to its own start (a spin or polling loop)
+        // runs again in place for as long as it fits and stays valid
+        prev = block;
+        epoch = _blocks.Epoch();
+        do
+        {
+            if constexpr (Profiler::ENABLED)
+            {
+                // blocks always run to the end, so every op can be counted up front;
+                // this also covers native code, which has no hooks of its own
+                uint16_t at = pc;
+                for (size_t i = 0; i < length; i++)
+                {
+                    const uint16_t opcode = block->ops[i].opcode;
+                    _profiler->OnExecute(at, opcode);
+                    at += (_xo_chip && opcode == 0xF000) ? 4 : 2;
+                }
+            }
+
+            if (block->native != nullptr)
+            {
+                // native code goes on into the compiled blocks after this one
+                // while they fit, so the count can be more than length
+                done += block->native(this, limit - done);
+            }
+            else
+            {
+                const Instruction* op = block->ops.data();
+                for (size_t i = 0; i < length; i++)
+                {
+                    op[i].handler(*this, op[i]);
+                }
+                done += length;
+            }
+        } while (_pc == pc && epoch == _blocks.Epoch() && length <= limit - done && !_waiting_for_vblank && !_waiting_for_key);
+    }
+    return done;
+}
+
+void Chip8::CompileBlock(BlockCache::Block& block)
+{
+    if (!_jit)
+    {
+        _jit = std::make_unique<JitX64>();
+    }
+
+    BlockCache::NativeFn fn = _jit->Compile(*this, block);
+    if (fn == nullptr && _jit->Used() > 0)
+    {
+        // code buffer is full: throw away all native code and start over
+        _blocks.DropNative();
+        _jit->Reset();
+        fn = _jit->Compile(*this, block);
+    }
+    _blocks.SetNative(block, fn, (fn != nullptr) ? _jit->Body(fn) : nullptr);
+}
+
+void Chip8::SetExecutionMode(ExecutionMode mode)
+{
+    if ((_mode == ExecutionMode::Jit) != (mode == ExecutionMode::Jit))
+    {
+        // Jit mode does not keep the decode cache up to date
+        _decode_cache.clear();
+    }
+    _mode = mode;
+}
+
+ExecutionMode Chip8::GetExecutionMode()
+{
+    return _mode;
+}
+
+// Switches every execution mode to the handlers specialized for profile.
+// Decoded instructions, blocks and native code were built for the old one,
+// so they are all dropped.
+void Chip8::SetQuirks(QuirkProfile profile)
+{
+    _quirks = profile;
+    quirks::Dispatch(profile, [this]<typename Q>()
+    {
+        _decode = &DecodeInstruction<Q>;
+        _execute = &Chip8::ExecuteAs<Q>;
+        _address_mask = Q::ADDRESS_MASK;
+        _xo_chip = Q::XO_CHIP;
+    });
+    InvalidateCode();
+}
+
+QuirkProfile Chip8::GetQuirks() const
+{
+    return _quirks;
+}
+
+// nullptr unless built with CHIP8_PROFILE
+const Profiler* Chip8::GetProfiler() const
+{
+    return _profiler.get();
+}
+
+// Records every instruction executed from now on to trace, or stops
+// recording with nullptr. The writer must stay open while it is attached.
+void Chip8::SetTrace(TraceWriter* trace)
+{
+    _trace = trace;
+}
+
+/*
+    Instruction handlers
+
+    One handler per instruction. They are shared by the reference interpreter
+    (Execute_0x*) and the decode cache, and are responsible for advancing PC.
+*/
+
+void Chip8::Op_00E0(Chip8& c, const Instruction&)
+{
+    c.ClearScreen();
+    c._pc += 2;
+}
+
+void Chip8::Op_00EE(Chip8& c, const Instruction&)
+{
+    if (c._sp > 0)
+    {
+        c._sp--;
+    }
+    c._pc = c._stack[c._sp];
+    c._stack[c._sp] = 0;
+    c._pc += 2;
+}
+
+void Chip8::Op_0NNN(Chip8& c, const Instruction& in)
+{
+    logger::Debug("This opcode {:04X}, is of 0x0NNN, and is ignored", in.opcode);
+    c._pc += 2;
+}
+
+/*
+    SUPER-CHIP display instructions, plus XO-CHIP's 00DN. Scrolls move by
+    pixels of the current resolution (as on modern SUPER-CHIP and XO-CHIP,
+    not the half pixels of SUPER-CHIP 1.1 in low resolution) and only the
+    selected bitplanes; see framebuffer.hpp for how rows are moved.
+*/
+
+void Chip8::Op_00CN(Chip8& c, const Instruction& in)
+{
+    c.Scroll(framebuffer::ScrollDown, in.N);
+    c._pc += 2;
+}
+
+void Chip8::Op_00DN(Chip8& c, const Instruction& in)
+{
+    c.Scroll(framebuffer::ScrollUp, in.N);
+    c._pc += 2;
+}
+
+void Chip8::Op_00FB(Chip8& c, const Instruction&)
+{
+    c.Scroll(framebuffer::ScrollRight, 4);
+    c._pc += 2;
+}
+
+void Chip8::Op_00FC(Chip8& c, const Instruction&)
+{
+    c.Scroll(framebuffer::ScrollLeft, 4);
+    c._pc += 2;
+}
+
+void Chip8::Op_00FD(Chip8&, const Instruction&)
+{
+    // exits the interpreter: PC stays here, so the program stops for good
+}
+
+void Chip8::Op_00FE(Chip8& c, const Instruction&)
+{
+    c.SetHiRes(false);
+    c._pc += 2;
+}
+
+void Chip8::Op_00FF(Chip8& c, const Instruction&)
+{
+    c.SetHiRes(true);
+    c._pc += 2;
+}
+
+void Chip8::Op_1NNN(Chip8& c, const Instruction& in)
+{
+    c._pc = in.NNN;
+}
+
+void Chip8::Op_2NNN(Chip8& c, const Instruction& in)
+{
+    if (c._sp >= c.StackSize())
+    {
+        logger::Error("Stack Overflow: sp={:0X}", c._sp);
+        c._sp &= 0xF;
+    }
+    c._stack[c._sp] = c._pc;
+    c._sp++;
+    c._pc = in.NNN;
+}
+
+// How far a taken skip moves PC: past the next instruction, which on
+// XO-CHIP can be the 4 byte F000 NNNN
+template <typename Q>
+uint16_t Chip8::SkipLength() const
+{
+    if constexpr (Q::XO_CHIP)
+    {
+        const uint16_t next = _pc + 2;
+        if (_memory[next] == 0xF0 && _memory[static_cast<uint16_t>(next + 1)] == 0x00)
+        {
+            return 6;
+        }
+    }
+    return 4;
+}
+
+template <typename Q>
+void Chip8::Op_3XNN(Chip8& c, const Instruction& in)
+{
+    // skips the next instruction
+    c._pc += (c._V[in.X] == in.NN) ? c.SkipLength<Q>() : 2;
+}
+
+template <typename Q>
+void Chip8::Op_4XNN(Chip8& c, const Instruction& in)
+{
+    c._pc += (c._V[in.X] != in.NN) ? c.SkipLength<Q>() : 2;
+}
+
+template <typename Q>
+void Chip8::Op_5XY0(Chip8& c, const Instruction& in)
+{
+    c._pc += (c._V[in.X] == c._V[in.Y]) ? c.SkipLength<Q>() : 2;
+}
+
+// XO-CHIP register ranges: VX through VY (counting down if X > Y) are
+// stored to / loaded from memory at I, and I is left as it was
+void Chip8::Op_5XY2(Chip8& c, const Instruction& in)
+{
+    const int step = (in.X <= in.Y) ? 1 : -1;
+    const int count = std::abs(in.X - in.Y) + 1;
+    for (int i = 0; i < count; i++)
+    {
+        c.StoreByte(c._I + i, c._V[in.X + i * step]);
+    }
+    c._pc += 2;
+}
+
+void Chip8::Op_5XY3(Chip8& c, const Instruction& in)
+{
+    const int step = (in.X <= in.Y) ? 1 : -1;
+    const int count = std::abs(in.X - in.Y) + 1;
+    for (int i = 0; i < count; i++)
+    {
+        c._V[in.X + i * step] = c._memory[(c._I + i) & c._address_mask];
+    }
+    c._pc += 2;
+}
+
+void Chip8::Op_6XNN(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] = in.NN;
+    c._pc += 2;
+}
+
+void Chip8::Op_7XNN(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] += in.NN;
+    c._pc += 2;
+}
+
+void Chip8::Op_8XY0(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] = c._V[in.Y];
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_8XY1(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] |= c._V[in.Y];
+    if constexpr (Q::VF_RESET)
+    {
+        c.VF_FlagClear();
+    }
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_8XY2(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] &= c._V[in.Y];
+    if constexpr (Q::VF_RESET)
+    {
+        c.VF_FlagClear();
+    }
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_8XY3(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] ^= c._V[in.Y];
+    if constexpr (Q::VF_RESET)
+    {
+        c.VF_FlagClear();
+    }
+    c._pc += 2;
+}
+
+void Chip8::Op_8XY4(Chip8& c, const Instruction& in)
+{
+    const uint16_t sum = static_cast<uint16_t>(c._V[in.X]) + static_cast<uint16_t>(c._V[in.Y]);
+    c._V[in.X] = static_cast<uint8_t>(sum);
+    c._V[0xF] = (sum > 0xFF) ? 1 : 0;
+    c._pc += 2;
+}
+
+void Chip8::Op_8XY5(Chip8& c, const Instruction& in)
+{
+    // VF is written last because some ROMs use VF as VX
+    const uint8_t Vx = c._V[in.X];
+    const uint8_t Vy = c._V[in.Y];
+    c._V[in.X] = Vx - Vy;
+    c._V[0xF] = (Vx >= Vy) ? 1 : 0;
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_8XY6(Chip8& c, const Instruction& in)
+{
+    const uint8_t Vy = c._V[Q::SHIFT_VY ? in.Y : in.X];
+    c._V[in.X] = Vy >> 1;
+    c._V[0xF] = Vy & 0x01;
+    c._pc += 2;
+}
+
+void Chip8::Op_8XY7(Chip8& c, const Instruction& in)
+{
+    const uint8_t Vx = c._V[in.X];
+    const uint8_t Vy = c._V[in.Y];
+    c._V[in.X] = Vy - Vx;
+    c._V[0xF] = (Vy >= Vx) ? 1 : 0;
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_8XYE(Chip8& c, const Instruction& in)
+{
+    const uint8_t Vy = c._V[Q::SHIFT_VY ? in.Y : in.X];
+    c._V[in.X] = Vy << 1;
+    c._V[0xF] = (Vy >> 7) & 0x01;
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_9XY0(Chip8& c, const Instruction& in)
+{
+    c._pc += (c._V[in.X] != c._V[in.Y]) ? c.SkipLength<Q>() : 2;
+}
+
+void Chip8::Op_ANNN(Chip8& c, const Instruction& in)
+{
+    c._I = in.NNN;
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_BNNN(Chip8& c, const Instruction& in)
+{
+    // BXNN on SUPER-CHIP: the X nibble is both the register and part of the address
+    c._pc = (c._V[Q::JUMP_VX ? in.X : 0x0] + in.NNN) & Q::ADDRESS_MASK;
+}
+
+void Chip8::Op_CXNN(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] = c._rng.NextByte() & in.NN;
+    c._pc += 2;
+}
+
+// DXYN on the 128x64 display, DXY0's 16x16 sprites in either mode, and
+// XO-CHIP draws to any bitplanes but just the first. Each selected bitplane
+// gets its own sprite, stored one after the other from I (bitplane 0's
+// first), and VF reports a collision on any of them. Kept out of Op_DXYN so
+// the common 8 pixel wide low resolution case stays small.
+template <typename Q>
+uint64_t Chip8::DrawWide(const Instruction& in)
+{
+    const int width = GetWidth();
+    const int height = GetHeight();
+    const int x = _V[in.X] % width;
+    const int y = _V[in.Y] % height;
+    const int sprite_width = (in.N == 0) ? 16 : 8;
+    const int rows = (in.N == 0) ? 16 : in.N;
+    uint16_t I = _I;
+    bool collision = false;
+    uint64_t dirty = 0;
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        if (((_planes >> p) & 0x1) == 0)
+        {
+            continue;
+        }
+        bool hit = false;
+        dirty |= framebuffer::Draw<Q::WRAP_SPRITES>(
+            _gfx[p], width / 64, height, x, y, rows, sprite_width,
+            [this, I, sprite_width](int row)
+            {
+                if (sprite_width == 8)
+                {
+                    return static_cast<uint32_t>(_memory[(I + row) & Q::ADDRESS_MASK]);
+                }
+                return static_cast<uint32_t>((_memory[(I + 2 * row) & Q::ADDRESS_MASK] << 8) |
+                                             _memory[(I + 2 * row + 1) & Q::ADDRESS_MASK]);
+            },
+            hit);
+        collision = collision || hit;
+        I += rows * sprite_width / 8;
+    }
+    _V[0xF] = collision ? 1 : 0;
+    return dirty;
+}
+
+template <typename Q>
+void Chip8::Op_DXYN(Chip8& c, const Instruction& in)
+{
+    if (c._hires || in.N == 0 || (Q::XO_CHIP && c._planes != 1)) [[unlikely]]
+    {
+        c.MarkDirty(c.DrawWide<Q>(in));
+        c._waiting_for_vblank = Q::DISPLAY_WAIT;
+        c._pc += 2;
+        return;
+    }
+
+    // Each sprite row is one shift, one AND for collision and one XOR.
+    // Shifting the byte down from the top of the word clips at the right edge;
+    // rotating it wraps around to the left one.
+    const int x = c._V[in.X] % W;
+    const int base_y = c._V[in.Y] % H;
+    const int rows = Q::WRAP_SPRITES ? in.N : std::min<int>(in.N, H - base_y); // clipping at the bottom edge
+
+    uint64_t collision = 0;
+    uint64_t dirty = 0;
+    for (int row = 0; row < rows; row++)
+    {
+        const uint64_t sprite = static_cast<uint64_t>(c._memory[(c._I + row) & Q::ADDRESS_MASK]) << 56;
+        const uint64_t bits = Q::WRAP_SPRITES ? std::rotr(sprite, x) : sprite >> x;
+        const int y = Q::WRAP_SPRITES ? (base_y + row) % H : base_y + row;
+        uint64_t& line = c._gfx[0][y];
+        collision |= line & bits;
+        line ^= bits;
+        // XOR with a non-zero sprite row always changes the line
+        dirty |= static_cast<uint64_t>(bits != 0) << y;
+    }
+    c._V[0xF] = (collision != 0) ? 1 : 0;
+    c._dirty_rows |= dirty;
+    c._draw_flag = c._draw_flag || dirty != 0;
+    c._waiting_for_vblank = Q::DISPLAY_WAIT;
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_EX9E(Chip8& c, const Instruction& in)
+{
+    // Only use lowest nibble of VX as key index
+    c._pc += (c._key[c._V[in.X] & 0x0F] == 0x1) ? c.SkipLength<Q>() : 2;
+}
+
+template <typename Q>
+void Chip8::Op_EXA1(Chip8& c, const Instruction& in)
+{
+    c._pc += (c._key[c._V[in.X] & 0x0F] != 0x1) ? c.SkipLength<Q>() : 2;
+}
+
+// XO-CHIP long load, I = NNNN from the word after the opcode. The word is
+// read each time the instruction runs, as programs patch it like data.
+void Chip8::Op_F000(Chip8& c, const Instruction&)
+{
+    const uint16_t operand = c._pc + 2;
+    c._I = static_cast<uint16_t>((c._memory[operand] << 8) | c._memory[static_cast<uint16_t>(operand + 1)]);
+    c._pc += 4;
+}
+
+// Selects the bitplanes (bit 0 and 1 of N) later draws, clears and scrolls act on
+void Chip8::Op_FN01(Chip8& c, const Instruction& in)
+{
+    c._planes = in.X & 0x3;
+    c._pc += 2;
+}
+
+// Loads the 16 byte audio pattern from I; see GetAudioPattern()
+void Chip8::Op_F002(Chip8& c, const Instruction&)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        c._audio_pattern[i] = c._memory[(c._I + i) & c._address_mask];
+    }
+    c._pc += 2;
+}
+
+void Chip8::Op_FX07(Chip8& c, const Instruction& in)
+{
+    c._V[in.X] = c._delay_timer;
+    c._pc += 2;
+}
+
+void Chip8::Op_FX0A(Chip8& c, const Instruction& in)
+{
+    // PC is advanced by OnKeyReleased once the key comes back up
+    c._waiting_for_key = true;
+    c._waiting_register = in.X;
+}
+
+void Chip8::Op_FX15(Chip8& c, const Instruction& in)
+{
+    c._delay_timer = c._V[in.X];
+    c._pc += 2;
+}
+
+void Chip8::Op_FX18(Chip8& c, const Instruction& in)
+{
+    c._sound_timer = c._V[in.X];
+    c._pc += 2;
+}
+
+void Chip8::Op_FX1E(Chip8& c, const Instruction& in)
+{
+    c._I += c._V[in.X];
+    c._pc += 2;
+}
+
+void Chip8::Op_FX29(Chip8& c, const Instruction& in)
+{
+    const uint8_t font_char = c._V[in.X] & 0x0F;
+    c._I = c._fontset_start + (font_char * 0x05);
+    c._pc += 2;
+}
+
+void Chip8::Op_FX30(Chip8& c, const Instruction& in)
+{
+    const uint8_t font_char = c._V[in.X] & 0x0F;
+    c._I = c._big_fontset_start + (font_char * 10);
+    c._pc += 2;
+}
+
+void Chip8::Op_FX33(Chip8& c, const Instruction& in)
+{
+    const uint8_t Vx = c._V[in.X];
+    c.StoreByte(c._I, Vx / 100);
+    c.StoreByte(c._I + 1, (Vx / 10) % 10);
+    c.StoreByte(c._I + 2, Vx % 10);
+    c._pc += 2;
+}
+
+void Chip8::Op_FX3A(Chip8& c, const Instruction& in)
+{
+    c._pitch = c._V[in.X];
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_FX55(Chip8& c, const Instruction& in)
+{
+    for (int X = 0; X <= in.X; X++)
+    {
+        c.StoreByte(c._I + X, c._V[X]);
+    }
+    if constexpr (Q::MEMORY_INCREMENT)
+    {
+        c._I += in.X + 1;
+    }
+    c._pc += 2;
+}
+
+template <typename Q>
+void Chip8::Op_FX65(Chip8& c, const Instruction& in)
+{
+    for (int X = 0; X <= in.X; X++)
+    {
+        c._V[X] = c._memory[(c._I + X) & Q::ADDRESS_MASK];
+    }
+    if constexpr (Q::MEMORY_INCREMENT)
+    {
+        c._I += in.X + 1;
     }
-    IncrementProgramCounter(n);
+    c._pc += 2;
+}
+
+// The RPL flags live outside of memory, so neither needs StoreByte
+void Chip8::Op_FX75(Chip8& c, const Instruction& in)
+{
+    std::copy(c._V, c._V + in.X + 1, c._rpl);
+    c._pc += 2;
+}
+
+void Chip8::Op_FX85(Chip8& c, const Instruction& in)
+{
+    std::copy(c._rpl, c._rpl + in.X + 1, c._V);
+    c._pc += 2;
+}
+
+void Chip8::Op_Unknown(Chip8& c, const Instruction& in)
+{
+    logger::Warn("Unknown opcode {:04X}", in.opcode);
+    c._pc += 2;
 }
 
 void Chip8::Get_X()
 {
-    _X = (_opcode & 0x0F00) >> 8;
+    _instr.X = (_opcode & 0x0F00) >> 8;
 }
 
 void Chip8::Get_Y()
 {
-    _Y = (_opcode & 0x00F0) >> 4;
+    _instr.Y = (_opcode & 0x00F0) >> 4;
 }
 
 void Chip8::VF_Flag()
@@ -729,6 +2026,7 @@ void Chip8::UpdateDelayTimer()
 
 void Chip8::UpdateSoundTimer()
 {
+    _sound_on = _sound_timer > 0;
     if (_sound_timer > 0)
     {
         --_sound_timer;
@@ -745,25 +2043,314 @@ void Chip8::InitFontset()
 {
     for (int i = 0; i < FontsetSize(); i++)
     {
-        _memory[i] = _fontset[i];
+        _memory.Write(_fontset_start + i, _fontset[i]);
+    }
+    for (size_t i = 0; i < sizeof(_big_fontset); i++)
+    {
+        _memory.Write(_big_fontset_start + i, _big_fontset[i]);
     }
 }
 
-void Chip8::MaybeTick_vblank()
+void Chip8::SaveState(Chip8State& out) const
 {
-    using namespace std::chrono;
-    auto now = steady_clock::now();
-    if (now >= _next_vblank)
+    out.magic = Chip8State::MAGIC;
+    out.version = Chip8State::VERSION;
+    out.cycles = _cycles;
+    out.frames = _frames;
+    out.next_vblank = _next_vblank;
+    std::copy(std::begin(_rng.s), std::end(_rng.s), out.rng);
+    std::copy(&_gfx[0][0], &_gfx[0][0] + std::size(_gfx) * framebuffer::WORDS, &out.gfx[0][0]);
+    out.clock_hz = _clock_hz;
+    out.frame_remainder = _frame_remainder;
+    out.I = _I;
+    out.pc = _pc;
+    out.sp = _sp;
+    std::copy(std::begin(_stack), std::end(_stack), out.stack);
+    std::copy(std::begin(_V), std::end(_V), out.V);
+    std::copy(std::begin(_key), std::end(_key), out.key);
+    out.delay_timer = _delay_timer;
+    out.sound_timer = _sound_timer;
+    out.waiting_for_vblank = _waiting_for_vblank ? 1 : 0;
+    out.waiting_for_key = _waiting_for_key ? 1 : 0;
+    out.waiting_register = _waiting_register;
+    out.hires = _hires ? 1 : 0;
+    out.planes = _planes;
+    out.pitch = _pitch;
+    std::copy(std::begin(_rpl), std::end(_rpl), out.rpl);
+    std::copy(std::begin(_audio_pattern), std::end(_audio_pattern), out.audio_pattern);
+    out.memory_pages = static_cast<uint16_t>((_address_mask + size_t{1}) >> PagedMemory::PAGE_SHIFT);
+    _memory.CopyTo(out.memory, out.memory_pages);
+}
+
+bool Chip8::LoadState(const Chip8State& in)
+{
+    if (in.magic != Chip8State::MAGIC || in.version != Chip8State::VERSION)
     {
-        UpdateTimers();
+        logger::Error("Unsupported save state (magic {:08X}, version {})", in.magic, in.version);
+        return false;
+    }
+    if (in.clock_hz < FRAME_HZ || in.next_vblank <= in.cycles)
+    {
+        logger::Error("Corrupt save state: clock {} Hz, cycle {}, next vblank {}", in.clock_hz, in.cycles, in.next_vblank);
+        return false;
+    }
+    if ((in.rng[0] | in.rng[1] | in.rng[2] | in.rng[3]) == 0)
+    {
+        logger::Error("Corrupt save state: all-zero generator state");
+        return false;
+    }
+    // the stack pointer, FX0A's register and PC index arrays and memory
+    // directly, so a state that puts them out of range is refused
+    if (in.sp > std::size(_stack))
+    {
+        logger::Error("Corrupt save state: stack pointer {}", in.sp);
+        return false;
+    }
+    const bool waiting = in.waiting_for_key != 0;
+    if (waiting ? in.waiting_register > 0xF : (in.waiting_register > 0xF && in.waiting_register != IDLE_REGISTER))
+    {
+        logger::Error("Corrupt save state: FX0A register {}", in.waiting_register);
+        return false;
+    }
+    // only this profile's address space is saved, and it must be all of it
+    if (in.memory_pages != (_address_mask + size_t{1}) >> PagedMemory::PAGE_SHIFT)
+    {
+        logger::Error("Save state holds {} KB of memory, this profile addresses {} KB",
+                      in.memory_pages * PagedMemory::PAGE_SIZE / 1024, (_address_mask + 1) / 1024);
+        return false;
+    }
+    if (in.pc > _address_mask)
+    {
+        logger::Error("Corrupt save state: PC {:04X} outside the address space", in.pc);
+        return false;
+    }
 
-        _waiting_for_vblank = false;
+    // Memory is compared a page and then a word at a time and only changed
+    // bytes go through StoreByte, so the decode cache, blocks and JIT code
+    // for unchanged code survive the restore
+    for (size_t page = 0; page < in.memory_pages; page++)
+    {
+        const uint8_t* current = _memory.PageData(page);
+        const uint8_t* saved = in.memory + (page << PagedMemory::PAGE_SHIFT);
+        if (std::memcmp(current, saved, PagedMemory::PAGE_SIZE) == 0)
+        {
+            continue;
+        }
+        for (size_t offset = 0; offset < PagedMemory::PAGE_SIZE; offset += sizeof(uint64_t))
+        {
+            if (std::memcmp(current + offset, saved + offset, sizeof(uint64_t)) == 0)
+            {
+                continue;
+            }
+            for (size_t b = offset; b < offset + sizeof(uint64_t); b++)
+            {
+                // re-read: a store to a shared page moves it to a copy
+                if (_memory.PageData(page)[b] != saved[b])
+                {
+                    StoreByte(static_cast<uint16_t>((page << PagedMemory::PAGE_SHIFT) + b), saved[b]);
+                }
+            }
+        }
+    }
 
-        _next_vblank += duration_cast<steady_clock::duration>(duration<double>(1.0 / 60.0));
-    
-        while (now > _next_vblank)
+    uint64_t dirty = (_hires != (in.hires != 0)) ? ~uint64_t{0} : 0;
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        for (int y = 0; y < HIRES_H; y++)
+        {
+            const int right = framebuffer::PLANE + y;
+            dirty |= static_cast<uint64_t>(_gfx[p][y] != in.gfx[p][y] || _gfx[p][right] != in.gfx[p][right]) << y;
+            _gfx[p][y] = in.gfx[p][y];
+            _gfx[p][right] = in.gfx[p][right];
+        }
+    }
+    _hires = in.hires != 0;
+    _planes = in.planes & 0x3;
+    MarkDirty(dirty);
+
+    _cycles = in.cycles;
+    _frames = in.frames;
+    _next_vblank = in.next_vblank;
+    _clock_hz = in.clock_hz;
+    _frame_remainder = in.frame_remainder;
+    std::copy(std::begin(in.rng), std::end(in.rng), _rng.s);
+    _I = in.I;
+    _pc = in.pc;
+    _sp = in.sp;
+    std::copy(std::begin(in.stack), std::end(in.stack), _stack);
+    std::copy(std::begin(in.V), std::end(in.V), _V);
+    std::copy(std::begin(in.key), std::end(in.key), _key);
+    _delay_timer = in.delay_timer;
+    _sound_timer = in.sound_timer;
+    _sound_on = false;  // not saved, set again by the next vblank
+    _input.clear();     // queued for the timeline being left
+    _waiting_for_vblank = in.waiting_for_vblank != 0;
+    _waiting_for_key = in.waiting_for_key != 0;
+    _waiting_register = in.waiting_register;
+    std::copy(std::begin(in.rpl), std::end(in.rpl), _rpl);
+    std::copy(std::begin(in.audio_pattern), std::end(in.audio_pattern), _audio_pattern);
+    _pitch = in.pitch;
+    return true;
+}
+
+/*
+    Makes this instance a copy of parent. Memory pages are shared, not
+    copied, and each side copies a page only when it first writes to it, so
+    a fork costs the registers, the display and one reference per page.
+    Host-side settings (execution mode, clock caches) stay as they were;
+    code translated from pages that were already shared with the parent
+    stays valid, the rest is dropped.
+
+    Also serves as a snapshot: fork into a spare instance to save, fork back
+    to restore.
+*/
+void Chip8::ForkFrom(const Chip8& parent)
+{
+    if (&parent == this)
+    {
+        return;
+    }
+
+    for (size_t page = 0; page < PagedMemory::PAGES; page++)
+    {
+        if (!_memory.SharesPage(parent._memory, page))
+        {
+            InvalidateCodeRange(static_cast<uint32_t>(page * PagedMemory::PAGE_SIZE),
+                                static_cast<uint32_t>((page + 1) * PagedMemory::PAGE_SIZE));
+        }
+    }
+    _memory = parent._memory;
+
+    uint64_t dirty = (_hires != parent._hires) ? ~uint64_t{0} : 0;
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        for (int y = 0; y < HIRES_H; y++)
         {
-            _next_vblank += duration_cast<steady_clock::duration>(duration<double>(1.0 / 60.0));
+            const int right = framebuffer::PLANE + y;
+            dirty |= static_cast<uint64_t>(_gfx[p][y] != parent._gfx[p][y] || _gfx[p][right] != parent._gfx[p][right]) << y;
+            _gfx[p][y] = parent._gfx[p][y];
+            _gfx[p][right] = parent._gfx[p][right];
         }
     }
-}
\ No newline at end of file
+    _hires = parent._hires;
+    _planes = parent._planes;
+    MarkDirty(dirty);
+
+    _cycles = parent._cycles;
+    _frames = parent._frames;
+    _next_vblank = parent._next_vblank;
+    _clock_hz = parent._clock_hz;
+    _frame_remainder = parent._frame_remainder;
+    _rng = parent._rng;
+    _I = parent._I;
+    _pc = parent._pc;
+    _sp = parent._sp;
+    std::copy(std::begin(parent._stack), std::end(parent._stack), _stack);
+    std::copy(std::begin(parent._V), std::end(parent._V), _V);
+    std::copy(std::begin(parent._key), std::end(parent._key), _key);
+    _delay_timer = parent._delay_timer;
+    _sound_timer = parent._sound_timer;
+    _sound_on = parent._sound_on;
+    _input = parent._input;
+    _waiting_for_vblank = parent._waiting_for_vblank;
+    _waiting_for_key = parent._waiting_for_key;
+    _waiting_register = parent._waiting_register;
+    std::copy(std::begin(parent._rpl), std::end(parent._rpl), _rpl);
+    std::copy(std::begin(parent._audio_pattern), std::end(parent._audio_pattern), _audio_pattern);
+    _pitch = parent._pitch;
+    _opcode = parent._opcode;
+    _instr = parent._instr;
+}
+
+void Chip8::AdvanceClock(uint64_t cycles)
+{
+    _cycles += cycles;
+    while (_cycles >= _next_vblank)
+    {
+        VBlank();
+    }
+}
+
+void Chip8::VBlank()
+{
+    UpdateTimers();
+    _waiting_for_vblank = false;
+    _frames++;
+    ScheduleVBlank();
+}
+
+// Attributes idle cycles of a blocked CPU to the wait that blocked it
+void Chip8::ProfileBlocked(uint64_t cycles)
+{
+    if constexpr (Profiler::ENABLED)
+    {
+        if (_waiting_for_vblank)
+        {
+            _profiler->OnDisplayWait(cycles);
+        }
+        else if (_waiting_for_key)
+        {
+            _profiler->OnKeyWait(cycles);
+        }
+    }
+}
+
+void Chip8::ScheduleVBlank()
+{
+    // Frames alternate between floor and ceil of _clock_hz / FRAME_HZ cycles
+    // so that exactly _clock_hz cycles pass every FRAME_HZ frames
+    const uint32_t acc = _clock_hz + _frame_remainder;
+    _next_vblank += acc / FRAME_HZ;
+    _frame_remainder = acc % FRAME_HZ;
+}
+
+void Chip8::SetClockRate(uint32_t hz)
+{
+    if (hz < FRAME_HZ)
+    {
+        logger::Warn("Clock rate {} Hz is below one cycle per frame, using {} Hz", hz, FRAME_HZ);
+        hz = FRAME_HZ;
+    }
+    // takes effect from the next frame, or from the first one when nothing
+    // has run since the reset, so a rate set right after LoadROM() applies
+    // to the whole run
+    _clock_hz = hz;
+    if (_cycles == 0)
+    {
+        _next_vblank = 0;
+        _frame_remainder = 0;
+        ScheduleVBlank();
+    }
+}
+
+uint32_t Chip8::GetClockRate()
+{
+    return _clock_hz;
+}
+
+uint64_t Chip8::GetCycles()
+{
+    return _cycles;
+}
+
+uint64_t Chip8::GetFrames()
+{
+    return _frames;
+}
+
+uint64_t Chip8::GetNextVBlank()
+{
+    return _next_vblank;
+}
+
+// Reseeds the CXNN generator now and on every later Reset() / LoadROM()
+void Chip8::SetSeed(uint64_t seed)
+{
+    _seed = seed;
+    _rng.Seed(seed);
+}
+
+uint64_t Chip8::GetSeed()
+{
+    return _seed;
+}
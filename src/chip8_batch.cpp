@@ -0,0 +1,1260 @@
+#include "chip8_batch.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include "logger.hpp"
+#include "random.hpp"
+
+namespace
+{
+    // Lane-wise select on a 0x00/0xFF mask, written so that lane loops
+    // vectorize into blends
+    inline uint8_t Select(uint8_t mask, uint8_t a, uint8_t b)
+    {
+        return static_cast<uint8_t>((a & mask) | (b & ~mask));
+    }
+
+    inline uint16_t Select16(uint8_t mask, uint16_t a, uint16_t b)
+    {
+        const uint16_t wide = static_cast<uint16_t>(-static_cast<int16_t>(mask & 0x1));
+        return static_cast<uint16_t>((a & wide) | (b & ~wide));
+    }
+}
+
+Chip8Batch::Chip8Batch(size_t lanes)
+    : _lanes(std::max<size_t>(lanes, 1))
+{
+    _memory.resize(_lanes * _memory_size);
+    _V.resize(16 * _lanes);
+    _I.resize(_lanes);
+    _pc.resize(_lanes);
+    _stack.resize(16 * _lanes);
+    _sp.resize(_lanes);
+    _delay_timer.resize(_lanes);
+    _sound_timer.resize(_lanes);
+    _keys.resize(_lanes);
+    _gfx.resize(_lanes * framebuffer::BITPLANES * framebuffer::WORDS);
+    _hires.resize(_lanes);
+    _planes.resize(_lanes);
+    _rpl.resize(_lanes * 16);
+    _audio_pattern.resize(_lanes * 16);
+    _pitch.resize(_lanes);
+    _waiting_for_vblank.resize(_lanes);
+    _waiting_for_key.resize(_lanes);
+    _waiting_register.resize(_lanes);
+    _rng.resize(_lanes);
+    _seeds.resize(_lanes);
+    for (uint64_t& seed : _seeds)
+    {
+        seed = rng::RandomSeed();
+    }
+    _ones.assign(_lanes, 0xFF);
+    _mask.resize(_lanes);
+    _slots.resize(std::bit_ceil(2 * _lanes));
+    _entry_group.resize(_lanes);
+    SetQuirks(QuirkProfile::Vip);
+    Reset();
+}
+
+bool Chip8Batch::LoadROM(const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open ROM: {}", filename);
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(_memory_size - rom_start + 1);
+    const size_t bytes_read = fread(buffer.data(), 1, buffer.size(), file);
+    fclose(file);
+    return LoadROM(buffer.data(), bytes_read);
+}
+
+bool Chip8Batch::LoadROM(const uint8_t* data, size_t size)
+{
+    Reset();
+    if (size > _memory_size - rom_start)
+    {
+        logger::Error("ROM is too large: {} bytes", size);
+        return false;
+    }
+
+    for (size_t lane = 0; lane < _lanes; lane++)
+    {
+        std::copy(data, data + size, Mem(lane) + rom_start);
+    }
+    return true;
+}
+
+void Chip8Batch::Reset()
+{
+    std::fill(_memory.begin(), _memory.end(), 0);
+    for (size_t lane = 0; lane < _lanes; lane++)
+    {
+        std::copy(std::begin(Chip8::_fontset), std::end(Chip8::_fontset), Mem(lane) + Chip8::_fontset_start);
+        std::copy(std::begin(Chip8::_big_fontset), std::end(Chip8::_big_fontset), Mem(lane) + Chip8::_big_fontset_start);
+    }
+    std::fill(_V.begin(), _V.end(), 0);
+    std::fill(_I.begin(), _I.end(), 0);
+    std::fill(_pc.begin(), _pc.end(), rom_start);
+    std::fill(_stack.begin(), _stack.end(), 0);
+    std::fill(_sp.begin(), _sp.end(), 0);
+    std::fill(_delay_timer.begin(), _delay_timer.end(), 0);
+    std::fill(_sound_timer.begin(), _sound_timer.end(), 0);
+    std::fill(_keys.begin(), _keys.end(), 0);
+    std::fill(_gfx.begin(), _gfx.end(), 0);
+    std::fill(_hires.begin(), _hires.end(), 0);
+    std::fill(_planes.begin(), _planes.end(), 1);
+    std::fill(_rpl.begin(), _rpl.end(), 0);
+    std::fill(_audio_pattern.begin(), _audio_pattern.end(), Chip8::DEFAULT_PATTERN);
+    std::fill(_pitch.begin(), _pitch.end(), Chip8::DEFAULT_PITCH);
+    std::fill(_waiting_for_vblank.begin(), _waiting_for_vblank.end(), 0);
+    std::fill(_waiting_for_key.begin(), _waiting_for_key.end(), 0);
+    std::fill(_waiting_register.begin(), _waiting_register.end(), 0xFF);
+    for (size_t lane = 0; lane < _lanes; lane++)
+    {
+        _rng[lane].Seed(_seeds[lane]);
+    }
+    _cycles = 0;
+    _frames = 0;
+    _next_vblank = 0;
+    _frame_remainder = 0;
+    _stats = Stats{};
+    _page_uniform.assign(_memory_size >> PAGE_SHIFT, 1);
+    ScheduleVBlank();
+}
+
+RunResult Chip8Batch::RunCycles(uint64_t n)
+{
+    const uint64_t end = _cycles + n;
+    const uint64_t executed = _stats.executed;
+    while (_cycles < end)
+    {
+        // slices never cross a vblank, so the clock is advanced once per slice
+        const uint64_t slice = std::min(end, _next_vblank) - _cycles;
+        RunSlice(slice);
+        AdvanceClock(slice);
+    }
+    return RunResult{StopReason::Budget, n, _stats.executed - executed};
+}
+
+RunResult Chip8Batch::RunFrame()
+{
+    return RunCycles(_next_vblank - _cycles);
+}
+
+void Chip8Batch::RunSlice(uint64_t cycles)
+{
+    BeginSlice();
+    for (uint64_t i = 0; i < cycles; i++)
+    {
+        if (!Cycle(cycles - i))
+        {
+            // every lane is blocked, or has run the slice alone, until the
+            // vblank at the end of it
+            return;
+        }
+    }
+}
+
+// The next instruction of lane as PC << 16 | opcode. Lane 0's copy of a
+// uniform page stands for every lane's, so lanes in step there share it.
+uint32_t Chip8Batch::Fetch(size_t lane)
+{
+    const uint16_t pc = _pc[lane] &= _address_mask;
+    const uint16_t next = (pc + 1) & _address_mask;
+    const uint8_t* mem = (_page_uniform[pc >> PAGE_SHIFT] & _page_uniform[next >> PAGE_SHIFT]) ? Mem(0) : Mem(lane);
+    return (static_cast<uint32_t>(pc) << 16) | (mem[pc] << 8) | mem[next];
+}
+
+// Every lane not blocked starts the slice in lockstep again, grouped by the
+// instruction it runs next
+void Chip8Batch::BeginSlice()
+{
+    _split.clear();
+    for (size_t lane = 0; lane < _lanes; lane++)
+    {
+        if ((_waiting_for_vblank[lane] | _waiting_for_key[lane]) == 0)
+        {
+            _split.push_back((static_cast<uint64_t>(Fetch(lane)) << 32) | lane);
+        }
+    }
+    _groups.clear();
+    _order.clear();
+    AddGroups(_split.data(), _split.size(), _groups, _order);
+}
+
+// Appends one group per distinct key among count entries of key << 32 |
+// lane to groups, in the order the keys first appear, and their lanes to
+// order in the order of the entries
+void Chip8Batch::AddGroups(const uint64_t* entries, size_t count, std::vector<Group>& groups, std::vector<uint32_t>& order)
+{
+    if (++_stamp == 0)
+    {
+        std::fill(_slots.begin(), _slots.end(), Slot{});
+        _stamp = 1;
+    }
+
+    const size_t first = groups.size();
+    const size_t slot_mask = _slots.size() - 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t key = static_cast<uint32_t>(entries[i] >> 32);
+        const uint32_t lane = static_cast<uint32_t>(entries[i]);
+        size_t h = (key * 0x9E3779B1u) & slot_mask;
+        while (_slots[h].stamp == _stamp && _slots[h].key != key)
+        {
+            h = (h + 1) & slot_mask;
+        }
+        if (_slots[h].stamp != _stamp)
+        {
+            _slots[h] = Slot{key, _stamp, static_cast<uint32_t>(groups.size())};
+            groups.push_back(Group{key, 0, 0, lane, lane + 1});
+        }
+        Group& group = groups[_slots[h].group];
+        group.size++;
+        group.lo = std::min(group.lo, lane);
+        group.hi = std::max(group.hi, lane + 1);
+        _entry_group[i] = _slots[h].group;
+    }
+
+    uint32_t start = static_cast<uint32_t>(order.size());
+    for (size_t g = first; g < groups.size(); g++)
+    {
+        groups[g].start = start;
+        start += groups[g].size;
+        groups[g].size = 0;
+    }
+    order.resize(start);
+    for (size_t i = 0; i < count; i++)
+    {
+        Group& group = groups[_entry_group[i]];
+        order[group.start + group.size++] = static_cast<uint32_t>(entries[i]);
+    }
+}
+
+// Runs one cycle on every group of lanes in lockstep, and any lane left in a
+// group of its own alone for the rest of the slice (remaining cycles, this
+// one included); returns false once no group is left
+bool Chip8Batch::Cycle(uint64_t remaining)
+{
+    if (_groups.empty())
+    {
+        return false;
+    }
+    if (_groups.size() == 1)
+    {
+        _stats.converged++;
+    }
+    else
+    {
+        _stats.grouped++;
+    }
+
+    _next_groups.clear();
+    _next_order.clear();
+    for (const Group& group : _groups)
+    {
+        const uint32_t* lanes = _order.data() + group.start;
+        if (group.size == 1)
+        {
+            // a lane that has gone its own way does not come back into step
+            // before it blocks, so it runs on alone
+            RunAlone(lanes[0], remaining);
+            continue;
+        }
+
+        _stats.executed += group.size;
+        _lanes_blocked = false;
+        const uint16_t opcode = static_cast<uint16_t>(group.key);
+        if (group.hi - group.lo == group.size)
+        {
+            (this->*_execute)(opcode, group.lo, group.hi, _ones.data());
+        }
+        else if (group.hi - group.lo <= MAX_SPAN_PER_LANE * group.size)
+        {
+            for (uint32_t i = 0; i < group.size; i++)
+            {
+                _mask[lanes[i]] = 0xFF;
+            }
+            (this->*_execute)(opcode, group.lo, group.hi, _mask.data());
+            for (uint32_t i = 0; i < group.size; i++)
+            {
+                _mask[lanes[i]] = 0x00;
+            }
+        }
+        else
+        {
+            // too spread out for a masked pass to pay off
+            for (uint32_t i = 0; i < group.size; i++)
+            {
+                (this->*_execute)(opcode, lanes[i], lanes[i] + 1, _ones.data());
+            }
+        }
+        Regroup(group);
+    }
+
+    std::swap(_groups, _next_groups);
+    std::swap(_order, _next_order);
+    if (_groups.size() > 1)
+    {
+        Merge();
+    }
+    return true;
+}
+
+// Carries group's lanes over to the next cycle. They stay together if they
+// all reached the same PC, as after anything but a branch, and the opcode
+// there is on a uniform page or the same for each; otherwise they are split
+// by what they fetch. Lanes that blocked drop out until the next slice.
+void Chip8Batch::Regroup(const Group& group)
+{
+    const uint32_t* lanes = _order.data() + group.start;
+    const size_t start = _next_order.size();
+    if (_lanes_blocked)
+    {
+        for (uint32_t i = 0; i < group.size; i++)
+        {
+            if ((_waiting_for_vblank[lanes[i]] | _waiting_for_key[lanes[i]]) == 0)
+            {
+                _next_order.push_back(lanes[i]);
+            }
+        }
+    }
+    else
+    {
+        _next_order.insert(_next_order.end(), lanes, lanes + group.size);
+    }
+
+    uint32_t* kept = _next_order.data() + start;
+    const size_t count = _next_order.size() - start;
+    if (count == 0)
+    {
+        return;
+    }
+
+    const uint16_t pc = _pc[kept[0]] &= _address_mask;
+    uint16_t diff = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        diff |= (_pc[kept[i]] &= _address_mask) ^ pc;
+    }
+    const uint16_t next = (pc + 1) & _address_mask;
+    const uint32_t key = Fetch(kept[0]);
+    bool same = diff == 0;
+    if (same && (_page_uniform[pc >> PAGE_SHIFT] & _page_uniform[next >> PAGE_SHIFT]) == 0)
+    {
+        // the lanes' copies of the code may differ, so each one is read
+        for (size_t i = 1; i < count && same; i++)
+        {
+            same = Fetch(kept[i]) == key;
+        }
+    }
+    if (same)
+    {
+        _next_groups.push_back(Group{key, static_cast<uint32_t>(start), static_cast<uint32_t>(count),
+                                     count == group.size ? group.lo : *std::min_element(kept, kept + count),
+                                     count == group.size ? group.hi : *std::max_element(kept, kept + count) + 1});
+        return;
+    }
+
+    _split.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        _split.push_back((static_cast<uint64_t>(Fetch(kept[i])) << 32) | kept[i]);
+    }
+    _next_order.resize(start);
+    AddGroups(_split.data(), _split.size(), _next_groups, _next_order);
+}
+
+// Folds groups that have come to run the same instruction into one, as when
+// the two sides of a branch meet again
+void Chip8Batch::Merge()
+{
+    if (++_stamp == 0)
+    {
+        std::fill(_slots.begin(), _slots.end(), Slot{});
+        _stamp = 1;
+    }
+
+    const size_t slot_mask = _slots.size() - 1;
+    bool merged = false;
+    for (size_t g = 0; g < _groups.size(); g++)
+    {
+        const uint32_t key = _groups[g].key;
+        size_t h = (key * 0x9E3779B1u) & slot_mask;
+        while (_slots[h].stamp == _stamp && _slots[h].key != key)
+        {
+            h = (h + 1) & slot_mask;
+        }
+        if (_slots[h].stamp == _stamp)
+        {
+            merged = true;
+            break;
+        }
+        _slots[h] = Slot{key, _stamp, static_cast<uint32_t>(g)};
+    }
+    if (!merged)
+    {
+        return;
+    }
+
+    _split.clear();
+    for (const Group& group : _groups)
+    {
+        for (uint32_t i = 0; i < group.size; i++)
+        {
+            _split.push_back((static_cast<uint64_t>(group.key) << 32) | _order[group.start + i]);
+        }
+    }
+    _groups.clear();
+    _order.clear();
+    AddGroups(_split.data(), _split.size(), _groups, _order);
+}
+
+// Runs lane by itself for up to cycles cycles, stopping early if it blocks.
+// It sits out the lockstep cycles until the next slice, so blocked or not
+// it costs nothing more until then.
+void Chip8Batch::RunAlone(size_t lane, uint64_t cycles)
+{
+    uint64_t done = 0;
+    while (done < cycles && (_waiting_for_vblank[lane] | _waiting_for_key[lane]) == 0)
+    {
+        (this->*_execute)(static_cast<uint16_t>(Fetch(lane)), lane, lane + 1, _ones.data());
+        done++;
+    }
+    _stats.executed += done;
+    _stats.scalar += done;
+}
+
+// A page stays uniform only while every lane stores the same bytes at the
+// same addresses in it; count bytes were written from I - back by the lanes
+// in [lo, hi) set in m
+void Chip8Batch::CheckUniformStore(size_t lo, size_t hi, const uint8_t* m, int back, int count)
+{
+    const uint16_t I0 = _I[lo];
+    bool same = lo == 0 && hi == _lanes;
+    for (size_t l = lo; l < hi && same; l++)
+    {
+        same = m[l] && _I[l] == I0;
+    }
+    const uint8_t* mem0 = Mem(0);
+    for (size_t l = 1; l < _lanes && same; l++)
+    {
+        const uint8_t* mem = Mem(l);
+        for (int b = 0; b < count; b++)
+        {
+            const uint16_t addr = (I0 - back + b) & _address_mask;
+            same = same && mem[addr] == mem0[addr];
+        }
+    }
+    if (same)
+    {
+        return;
+    }
+
+    for (size_t l = lo; l < hi; l++)
+    {
+        if (m[l])
+        {
+            for (int b = 0; b < count; b++)
+            {
+                _page_uniform[((_I[l] - back + b) & _address_mask) >> PAGE_SHIFT] = 0;
+            }
+        }
+    }
+}
+
+// Chip8::SkipLength for one lane
+template <typename Q>
+uint16_t Chip8Batch::SkipLength(size_t lane)
+{
+    if constexpr (Q::XO_CHIP)
+    {
+        const uint8_t* mem = Mem(lane);
+        const uint16_t next = _pc[lane] + 2;
+        if (mem[next] == 0xF0 && mem[static_cast<uint16_t>(next + 1)] == 0x00)
+        {
+            return 6;
+        }
+    }
+    return 4;
+}
+
+// Chip8::Scroll for one lane
+void Chip8Batch::Scroll(size_t lane, uint64_t (*scroll)(uint64_t*, int, int, int), int n)
+{
+    for (int p = 0; p < framebuffer::BITPLANES; p++)
+    {
+        if (((_planes[lane] >> p) & 0x1) != 0)
+        {
+            scroll(Gfx(lane, p), _hires[lane] ? 2 : 1, _hires[lane] ? HIRES_H : H, n);
+        }
+    }
+}
+
+/*
+    Executes one opcode on the lanes in [lo, hi) whose mask m is 0xFF. Each
+    case mirrors the matching Chip8::Op_* handler; see chip8.cpp for the
+    quirk notes. Q is the quirk policy, see quirks.hpp.
+*/
+template <typename Q>
+void Chip8Batch::Execute(uint16_t opcode, size_t lo, size_t hi, const uint8_t* m)
+{
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x00FF;
+    const uint8_t N = opcode & 0x000F;
+    const int X = (opcode & 0x0F00) >> 8;
+    const int Y = (opcode & 0x00F0) >> 4;
+
+    uint16_t* pc = _pc.data();
+    uint16_t* I = _I.data();
+    uint8_t* vx = Reg(X);
+    uint8_t* vy = Reg(Y);
+    uint8_t* vf = Reg(0xF);
+
+    const auto advance = [&](uint16_t n)
+    {
+        for (size_t l = lo; l < hi; l++)
+        {
+            pc[l] += n & m[l];
+        }
+    };
+
+    const auto unknown = [&]()
+    {
+        logger::Warn("Unknown opcode {:04X}", opcode);
+        advance(2);
+    };
+
+    // a taken skip, past an XO-CHIP F000 NNNN if that comes next
+    const auto skip = [&](size_t l, bool taken) -> uint16_t
+    {
+        if constexpr (Q::XO_CHIP)
+        {
+            if (taken && m[l])
+            {
+                return SkipLength<Q>(l);
+            }
+        }
+        return (taken ? 4 : 2) & m[l];
+    };
+
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            if (opcode == 0x00E0)
+            {
+                for (size_t l = lo; l < hi; l++)
+                {
+                    for (int p = 0; p < framebuffer::BITPLANES; p++)
+                    {
+                        if (m[l] && ((_planes[l] >> p) & 0x1) != 0)
+                        {
+                            std::fill_n(Gfx(l, p), framebuffer::WORDS, 0);
+                        }
+                    }
+                }
+                advance(2);
+            }
+            else if ((opcode & 0xFFF0) == 0x00C0 || (Q::XO_CHIP && (opcode & 0xFFF0) == 0x00D0) ||
+                     opcode == 0x00FB || opcode == 0x00FC)
+            {
+                for (size_t l = lo; l < hi; l++)
+                {
+                    if (!m[l])
+                    {
+                        continue;
+                    }
+                    if (opcode == 0x00FB)
+                    {
+                        Scroll(l, framebuffer::ScrollRight, 4);
+                    }
+                    else if (opcode == 0x00FC)
+                    {
+                        Scroll(l, framebuffer::ScrollLeft, 4);
+                    }
+                    else if ((opcode & 0xFFF0) == 0x00D0)
+                    {
+                        Scroll(l, framebuffer::ScrollUp, N);
+                    }
+                    else
+                    {
+                        Scroll(l, framebuffer::ScrollDown, N);
+                    }
+                }
+                advance(2);
+            }
+            else if (opcode == 0x00FE || opcode == 0x00FF)
+            {
+                for (size_t l = lo; l < hi; l++)
+                {
+                    if (m[l])
+                    {
+                        std::fill_n(Gfx(l), framebuffer::BITPLANES * framebuffer::WORDS, 0);
+                        _hires[l] = (opcode == 0x00FF) ? 1 : 0;
+                    }
+                }
+                advance(2);
+            }
+            else if (opcode == 0x00FD)
+            {
+                // exit: PC stays put
+            }
+            else if (opcode == 0x00EE)
+            {
+                for (size_t l = lo; l < hi; l++)
+                {
+                    if (!m[l])
+                    {
+                        continue;
+                    }
+                    if (_sp[l] > 0)
+                    {
+                        _sp[l]--;
+                    }
+                    uint16_t& slot = _stack[_sp[l] * _lanes + l];
+                    pc[l] = slot + 2;
+                    slot = 0;
+                }
+            }
+            else
+            {
+                logger::Debug("This opcode {:04X}, is of 0x0NNN, and is ignored", opcode);
+                advance(2);
+            }
+            break;
+        case 0x1:
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] = Select16(m[l], NNN, pc[l]);
+            }
+            break;
+        case 0x2:
+            for (size_t l = lo; l < hi; l++)
+            {
+                if (!m[l])
+                {
+                    continue;
+                }
+                if (_sp[l] >= 16)
+                {
+                    logger::Error("Stack Overflow: sp={:0X}", _sp[l]);
+                    _sp[l] &= 0xF;
+                }
+                _stack[_sp[l] * _lanes + l] = pc[l];
+                _sp[l]++;
+                pc[l] = NNN;
+            }
+            break;
+        case 0x3:
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] += skip(l, vx[l] == NN);
+            }
+            break;
+        case 0x4:
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] += skip(l, vx[l] != NN);
+            }
+            break;
+        case 0x5:
+            if (Q::XO_CHIP && (N == 0x2 || N == 0x3))
+            {
+                // Chip8::Op_5XY2 / Op_5XY3
+                const int step = (X <= Y) ? 1 : -1;
+                const int count = std::abs(X - Y) + 1;
+                for (size_t l = lo; l < hi; l++)
+                {
+                    if (!m[l])
+                    {
+                        continue;
+                    }
+                    uint8_t* mem = Mem(l);
+                    for (int i = 0; i < count; i++)
+                    {
+                        uint8_t& cell = mem[(I[l] + i) & Q::ADDRESS_MASK];
+                        uint8_t& v = Reg(X + i * step)[l];
+                        if (N == 0x2)
+                        {
+                            cell = v;
+                        }
+                        else
+                        {
+                            v = cell;
+                        }
+                    }
+                }
+                if (N == 0x2)
+                {
+                    CheckUniformStore(lo, hi, m, 0, count);
+                }
+                advance(2);
+                break;
+            }
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] += skip(l, vx[l] == vy[l]);
+            }
+            break;
+        case 0x6:
+            for (size_t l = lo; l < hi; l++)
+            {
+                vx[l] = Select(m[l], NN, vx[l]);
+            }
+            advance(2);
+            break;
+        case 0x7:
+            for (size_t l = lo; l < hi; l++)
+            {
+                vx[l] = Select(m[l], static_cast<uint8_t>(vx[l] + NN), vx[l]);
+            }
+            advance(2);
+            break;
+        case 0x8:
+            switch (N)
+            {
+                case 0x0:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        vx[l] = Select(m[l], vy[l], vx[l]);
+                    }
+                    break;
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint8_t r = (N == 0x1) ? (vx[l] | vy[l]) : (N == 0x2) ? (vx[l] & vy[l]) : (vx[l] ^ vy[l]);
+                        vx[l] = Select(m[l], r, vx[l]);
+                        if constexpr (Q::VF_RESET)
+                        {
+                            vf[l] = Select(m[l], 0, vf[l]);
+                        }
+                    }
+                    break;
+                case 0x4:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint16_t sum = static_cast<uint16_t>(vx[l]) + vy[l];
+                        vx[l] = Select(m[l], static_cast<uint8_t>(sum), vx[l]);
+                        vf[l] = Select(m[l], sum > 0xFF ? 1 : 0, vf[l]);
+                    }
+                    break;
+                case 0x5:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint8_t a = vx[l];
+                        const uint8_t b = vy[l];
+                        vx[l] = Select(m[l], static_cast<uint8_t>(a - b), a);
+                        vf[l] = Select(m[l], a >= b ? 1 : 0, vf[l]);
+                    }
+                    break;
+                case 0x6:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint8_t b = Q::SHIFT_VY ? vy[l] : vx[l];
+                        vx[l] = Select(m[l], b >> 1, vx[l]);
+                        vf[l] = Select(m[l], b & 0x01, vf[l]);
+                    }
+                    break;
+                case 0x7:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint8_t a = vx[l];
+                        const uint8_t b = vy[l];
+                        vx[l] = Select(m[l], static_cast<uint8_t>(b - a), a);
+                        vf[l] = Select(m[l], b >= a ? 1 : 0, vf[l]);
+                    }
+                    break;
+                case 0xE:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        const uint8_t b = Q::SHIFT_VY ? vy[l] : vx[l];
+                        vx[l] = Select(m[l], static_cast<uint8_t>(b << 1), vx[l]);
+                        vf[l] = Select(m[l], (b >> 7) & 0x01, vf[l]);
+                    }
+                    break;
+                default:
+                    unknown();
+                    return;
+            }
+            advance(2);
+            break;
+        case 0x9:
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] += skip(l, vx[l] != vy[l]);
+            }
+            break;
+        case 0xA:
+            for (size_t l = lo; l < hi; l++)
+            {
+                I[l] = Select16(m[l], NNN, I[l]);
+            }
+            advance(2);
+            break;
+        case 0xB:
+        {
+            const uint8_t* v0 = Reg(Q::JUMP_VX ? X : 0x0);
+            for (size_t l = lo; l < hi; l++)
+            {
+                pc[l] = Select16(m[l], (v0[l] + NNN) & Q::ADDRESS_MASK, pc[l]);
+            }
+            break;
+        }
+        case 0xC:
+            for (size_t l = lo; l < hi; l++)
+            {
+                if (m[l])
+                {
+                    vx[l] = _rng[l].NextByte() & NN;
+                }
+            }
+            advance(2);
+            break;
+        case 0xD:
+            for (size_t l = lo; l < hi; l++)
+            {
+                if (!m[l])
+                {
+                    continue;
+                }
+                if (_hires[l] || N == 0 || (Q::XO_CHIP && _planes[l] != 1))
+                {
+                    // Chip8::DrawWide
+                    const int width = _hires[l] ? HIRES_W : W;
+                    const int height = _hires[l] ? HIRES_H : H;
+                    const int x = vx[l] % width;
+                    const int y = vy[l] % height;
+                    const int sprite_width = (N == 0) ? 16 : 8;
+                    const int rows = (N == 0) ? 16 : N;
+                    const uint8_t* mem = Mem(l);
+                    uint16_t base = I[l];
+                    bool collision = false;
+                    for (int p = 0; p < framebuffer::BITPLANES; p++)
+                    {
+                        if (((_planes[l] >> p) & 0x1) == 0)
+                        {
+                            continue;
+                        }
+                        bool hit = false;
+                        framebuffer::Draw<Q::WRAP_SPRITES>(
+                            Gfx(l, p), width / 64, height, x, y, rows, sprite_width,
+                            [mem, base, sprite_width](int row)
+                            {
+                                if (sprite_width == 8)
+                                {
+                                    return static_cast<uint32_t>(mem[(base + row) & Q::ADDRESS_MASK]);
+                                }
+                                return static_cast<uint32_t>((mem[(base + 2 * row) & Q::ADDRESS_MASK] << 8) |
+                                                             mem[(base + 2 * row + 1) & Q::ADDRESS_MASK]);
+                            },
+                            hit);
+                        collision = collision || hit;
+                        base += rows * sprite_width / 8;
+                    }
+                    vf[l] = collision ? 1 : 0;
+                    _waiting_for_vblank[l] = Q::DISPLAY_WAIT;
+                    continue;
+                }
+                const int x = vx[l] % W;
+                const int base_y = vy[l] % H;
+                const int rows = Q::WRAP_SPRITES ? N : std::min<int>(N, H - base_y);
+                const uint8_t* mem = Mem(l);
+                uint64_t* gfx = Gfx(l);
+
+                uint64_t collision = 0;
+                for (int row = 0; row < rows; row++)
+                {
+                    const uint64_t sprite = static_cast<uint64_t>(mem[(I[l] + row) & Q::ADDRESS_MASK]) << 56;
+                    const uint64_t bits = Q::WRAP_SPRITES ? std::rotr(sprite, x) : sprite >> x;
+                    uint64_t& line = gfx[Q::WRAP_SPRITES ? (base_y + row) % H : base_y + row];
+                    collision |= line & bits;
+                    line ^= bits;
+                }
+                vf[l] = (collision != 0) ? 1 : 0;
+                _waiting_for_vblank[l] = Q::DISPLAY_WAIT;
+            }
+            _lanes_blocked = _lanes_blocked || Q::DISPLAY_WAIT;
+            advance(2);
+            break;
+        case 0xE:
+            if (NN != 0x9E && NN != 0xA1)
+            {
+                unknown();
+                break;
+            }
+            for (size_t l = lo; l < hi; l++)
+            {
+                const bool down = ((_keys[l] >> (vx[l] & 0x0F)) & 0x1) != 0;
+                pc[l] += skip(l, down == (NN == 0x9E));
+            }
+            break;
+        case 0xF:
+            switch (NN)
+            {
+                case 0x00:
+                    if (!Q::XO_CHIP || opcode != 0xF000)
+                    {
+                        unknown();
+                        break;
+                    }
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (m[l])
+                        {
+                            const uint8_t* mem = Mem(l);
+                            const uint16_t operand = pc[l] + 2;
+                            I[l] = static_cast<uint16_t>((mem[operand] << 8) | mem[static_cast<uint16_t>(operand + 1)]);
+                        }
+                    }
+                    advance(4);
+                    break;
+                case 0x01:
+                    if (!Q::XO_CHIP)
+                    {
+                        unknown();
+                        break;
+                    }
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        _planes[l] = Select(m[l], X & 0x3, _planes[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x02:
+                    if (!Q::XO_CHIP || opcode != 0xF002)
+                    {
+                        unknown();
+                        break;
+                    }
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (m[l])
+                        {
+                            for (int i = 0; i < 16; i++)
+                            {
+                                _audio_pattern[l * 16 + i] = Mem(l)[(I[l] + i) & Q::ADDRESS_MASK];
+                            }
+                        }
+                    }
+                    advance(2);
+                    break;
+                case 0x07:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        vx[l] = Select(m[l], _delay_timer[l], vx[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x0A:
+                    // PC is advanced by OnKeyReleased once the key comes back up
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (m[l])
+                        {
+                            _waiting_for_key[l] = 1;
+                            _waiting_register[l] = static_cast<uint8_t>(X);
+                        }
+                    }
+                    _lanes_blocked = true;
+                    break;
+                case 0x15:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        _delay_timer[l] = Select(m[l], vx[l], _delay_timer[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x18:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        _sound_timer[l] = Select(m[l], vx[l], _sound_timer[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x1E:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        I[l] += vx[l] & m[l];
+                    }
+                    advance(2);
+                    break;
+                case 0x29:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        I[l] = Select16(m[l], static_cast<uint16_t>(Chip8::_fontset_start + (vx[l] & 0x0F) * 0x05), I[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x30:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        I[l] = Select16(m[l], static_cast<uint16_t>(Chip8::_big_fontset_start + (vx[l] & 0x0F) * 10), I[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x33:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (m[l])
+                        {
+                            uint8_t* mem = Mem(l);
+                            mem[I[l] & Q::ADDRESS_MASK] = vx[l] / 100;
+                            mem[(I[l] + 1) & Q::ADDRESS_MASK] = (vx[l] / 10) % 10;
+                            mem[(I[l] + 2) & Q::ADDRESS_MASK] = vx[l] % 10;
+                        }
+                    }
+                    CheckUniformStore(lo, hi, m, 0, 3);
+                    advance(2);
+                    break;
+                case 0x3A:
+                    if (!Q::XO_CHIP)
+                    {
+                        unknown();
+                        break;
+                    }
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        _pitch[l] = Select(m[l], vx[l], _pitch[l]);
+                    }
+                    advance(2);
+                    break;
+                case 0x55:
+                case 0x65:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (!m[l])
+                        {
+                            continue;
+                        }
+                        uint8_t* mem = Mem(l);
+                        for (int r = 0; r <= X; r++)
+                        {
+                            uint8_t& cell = mem[(I[l] + r) & Q::ADDRESS_MASK];
+                            uint8_t& v = Reg(r)[l];
+                            if (NN == 0x55)
+                            {
+                                cell = v;
+                            }
+                            else
+                            {
+                                v = cell;
+                            }
+                        }
+                        if constexpr (Q::MEMORY_INCREMENT)
+                        {
+                            I[l] += X + 1;
+                        }
+                    }
+                    if (NN == 0x55)
+                    {
+                        CheckUniformStore(lo, hi, m, Q::MEMORY_INCREMENT ? X + 1 : 0, X + 1);
+                    }
+                    advance(2);
+                    break;
+                case 0x75:
+                case 0x85:
+                    for (size_t l = lo; l < hi; l++)
+                    {
+                        if (!m[l])
+                        {
+                            continue;
+                        }
+                        for (int r = 0; r <= X; r++)
+                        {
+                            uint8_t& flag = _rpl[l * 16 + r];
+                            uint8_t& v = Reg(r)[l];
+                            if (NN == 0x75)
+                            {
+                                flag = v;
+                            }
+                            else
+                            {
+                                v = flag;
+                            }
+                        }
+                    }
+                    advance(2);
+                    break;
+                default:
+                    unknown();
+                    break;
+            }
+            break;
+    }
+}
+
+void Chip8Batch::OnKeyPressed(size_t lane, uint8_t k)
+{
+    _keys[lane] |= static_cast<uint16_t>(1u << (k & 0x0F));
+    if (_waiting_for_key[lane])
+    {
+        Reg(_waiting_register[lane])[lane] = k;
+    }
+}
+
+void Chip8Batch::OnKeyReleased(size_t lane, uint8_t k)
+{
+    _keys[lane] &= static_cast<uint16_t>(~(1u << (k & 0x0F)));
+    if (_waiting_for_key[lane])
+    {
+        _pc[lane] += 2;
+    }
+    _waiting_for_key[lane] = 0;
+    _waiting_register[lane] = 0xFF;
+}
+
+void Chip8Batch::AdvanceClock(uint64_t cycles)
+{
+    _cycles += cycles;
+    while (_cycles >= _next_vblank)
+    {
+        VBlank();
+    }
+}
+
+void Chip8Batch::VBlank()
+{
+    for (size_t l = 0; l < _lanes; l++)
+    {
+        _delay_timer[l] -= (_delay_timer[l] > 0) ? 1 : 0;
+        _sound_timer[l] -= (_sound_timer[l] > 0) ? 1 : 0;
+        _waiting_for_vblank[l] = 0;
+    }
+    _frames++;
+    ScheduleVBlank();
+}
+
+void Chip8Batch::ScheduleVBlank()
+{
+    // same frame boundaries as Chip8::ScheduleVBlank
+    const uint32_t acc = _clock_hz + _frame_remainder;
+    _next_vblank += acc / Chip8::FRAME_HZ;
+    _frame_remainder = acc % Chip8::FRAME_HZ;
+}
+
+// Same as Chip8::SetSeed for one lane: reseeds now and on every Reset()
+void Chip8Batch::SetSeed(size_t lane, uint64_t seed)
+{
+    _seeds[lane] = seed;
+    _rng[lane].Seed(seed);
+}
+
+// Like Chip8::SetQuirks; every lane runs the same profile. Each lane only
+// holds the memory the profile can address, so CHIP-8 lanes stay 4 KB apart.
+void Chip8Batch::SetQuirks(QuirkProfile profile)
+{
+    const uint32_t size = _memory_size;
+    quirks::Dispatch(profile, [this]<typename Q>()
+    {
+        _execute = &Chip8Batch::Execute<Q>;
+        _address_mask = Q::ADDRESS_MASK;
+        _memory_size = uint32_t{Q::ADDRESS_MASK} + 1;
+    });
+    if (_memory_size != size)
+    {
+        _memory.assign(_lanes * _memory_size, 0);
+        Reset();
+    }
+}
+
+void Chip8Batch::SetClockRate(uint32_t hz)
+{
+    if (hz < Chip8::FRAME_HZ)
+    {
+        logger::Warn("Clock rate {} Hz is below one cycle per frame, using {} Hz", hz, Chip8::FRAME_HZ);
+        hz = Chip8::FRAME_HZ;
+    }
+    _clock_hz = hz;
+    if (_cycles == 0)
+    {
+        _next_vblank = 0;
+        _frame_remainder = 0;
+        ScheduleVBlank();
+    }
+}
+
+size_t Chip8Batch::Lanes() const
+{
+    return _lanes;
+}
+
+uint64_t Chip8Batch::GetCycles() const
+{
+    return _cycles;
+}
+
+uint64_t Chip8Batch::GetFrames() const
+{
+    return _frames;
+}
+
+const Chip8Batch::Stats& Chip8Batch::GetStats() const
+{
+    return _stats;
+}
+
+uint8_t Chip8Batch::GetV(size_t lane, int reg) const
+{
+    return _V[(reg & 0xF) * _lanes + lane];
+}
+
+uint16_t Chip8Batch::GetI(size_t lane) const
+{
+    return _I[lane];
+}
+
+uint16_t Chip8Batch::GetPC(size_t lane) const
+{
+    return _pc[lane];
+}
+
+uint16_t Chip8Batch::GetSP(size_t lane) const
+{
+    return _sp[lane];
+}
+
+uint16_t Chip8Batch::GetStack(size_t lane, int level) const
+{
+    return _stack[(level & 0xF) * _lanes + lane];
+}
+
+uint8_t Chip8Batch::GetDelayTimer(size_t lane) const
+{
+    return _delay_timer[lane];
+}
+
+uint8_t Chip8Batch::GetSoundTimer(size_t lane) const
+{
+    return _sound_timer[lane];
+}
+
+bool Chip8Batch::WaitingForVBlank(size_t lane) const
+{
+    return _waiting_for_vblank[lane] != 0;
+}
+
+bool Chip8Batch::WaitingForKey(size_t lane) const
+{
+    return _waiting_for_key[lane] != 0;
+}
+
+const uint8_t* Chip8Batch::GetMemory(size_t lane) const
+{
+    return _memory.data() + lane * _memory_size;
+}
+
+const uint64_t* Chip8Batch::GetGfx(size_t lane, int bitplane) const
+{
+    return _gfx.data() + (lane * framebuffer::BITPLANES + (bitplane & 0x1)) * framebuffer::WORDS;
+}
+
+bool Chip8Batch::GetHiRes(size_t lane) const
+{
+    return _hires[lane] != 0;
+}
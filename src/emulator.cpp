@@ -2,6 +2,7 @@
 #include <emscripten.h>
 #endif
 #include "emulator.hpp"
+#include <bit>
 #include <iostream>
 #include <unordered_map>
 #include <chrono>
@@ -13,6 +14,7 @@
 Emulator::Emulator() : _event_handler(&_window)
 {
     logger::Info("Chip8 constructor called");
+    _event_handler.SetRecorder(&_recorder);
 }
 
 Emulator::~Emulator()
@@ -46,56 +48,112 @@ void Emulator::Run()
         //chip8.Debug_Print();
         //chip8.Debug_PrintGfx();
     }
+    SaveMovie();
 }
 
 #endif
 
 void Emulator::Tick()
 {
-    _event_handler.ProcessEvents(_chip8);
-
     const auto current = std::chrono::steady_clock::now();
     const double deltaTime =
         std::chrono::duration<double>(current - prev).count();
 
     prev = current;
 
-    cpu_accum += deltaTime;
     frame_accum += deltaTime;
 
-    while (cpu_accum >= SEC_PER_CPU)
+    // Frames are due by steady_clock, or, with the audio device as the
+    // master clock, whenever the sound card has played the last ones out
+    int frames = 0;
+    if (_audio.IsMasterClock())
+    {
+        frames = _audio.TicksDue();
+        frame_accum = 0.0;
+    }
+    for (; frame_accum >= SEC_PER_FRAME; frame_accum -= SEC_PER_FRAME)
     {
-        _chip8.Cycle();
-        cpu_accum -= SEC_PER_CPU;
+        frames++;
     }
 
-    if (frame_accum >= SEC_PER_FRAME)
+    // Emulated time trails the host by the frames about to run plus the
+    // part of a frame not run yet; key events are placed on that timeline
+    // by their timestamps, and applied by the core on those cycles
+    const double ahead = frames * SEC_PER_FRAME + frame_accum;
+    _event_handler.ProcessEvents(_chip8, _chip8.GetCycles() + static_cast<uint64_t>(ahead * _chip8.GetClockRate()));
+
+    if (frames > 0)
     {
-        _chip8.MaybeTick_vblank();
-        frame_accum -= SEC_PER_FRAME;
-
-        UploadGrid(fg_color, bg_color);
-
-        SDL_RenderClear(_window.GetRenderer());
-        SDL_RenderTexture(
-            _window.GetRenderer(),
-            _window.GetGfxTexture(),
-            nullptr,
-            nullptr
-        );
-        SDL_RenderPresent(_window.GetRenderer());
+        // One batched call per emulated frame; more than one only when the
+        // host fell behind. While rewinding, each frame restores the previous
+        // snapshot instead, and is silent. Every frame renders its timer tick
+        // of sound.
+        for (int f = 0; f < frames; f++)
+        {
+            if (_event_handler.RewindHeld())
+            {
+                if (_rewind.Pop(_snapshot) && _chip8.LoadState(_snapshot))
+                {
+                    _recorder.Rewind(_chip8);
+                }
+                _audio.Tick();
+            }
+            else
+            {
+                _chip8.RunFrame();
+                _chip8.SaveState(_snapshot);
+                _rewind.Push(_snapshot);
+                _recorder.OnFrame(_chip8);
+                _audio.Tick(_chip8);
+            }
+        }
+
+        // Nothing is uploaded or presented unless the display changed or
+        // the window contents were lost. A resolution change (00FE / 00FF)
+        // marks every row dirty, and only moves the window's source rectangle.
+        const uint64_t dirty_rows = _chip8.TakeDirtyRows();
+        if (_chip8.GetWidth() != _display_width)
+        {
+            _display_width = _chip8.GetWidth();
+            _window.SetDisplaySize(_chip8.GetWidth(), _chip8.GetHeight());
+        }
+        const bool redraw = _window.TakeRedraw();
+        if (dirty_rows != 0)
+        {
+            UploadGrid(palette, dirty_rows);
+        }
+
+        if (dirty_rows != 0 || redraw)
+        {
+            SDL_RenderClear(_window.GetRenderer());
+            SDL_RenderTexture(
+                _window.GetRenderer(),
+                _window.GetGfxTexture(),
+                _window.GetDisplayRect(),
+                nullptr
+            );
+            SDL_RenderPresent(_window.GetRenderer());
+        }
     }
 }
 
 bool Emulator::LoadRom(const std::string& filename)
 {
+    _chip8.SetQuirks(quirks::ForRom(filename));
     if (!_chip8.LoadROM(filename))
     {
         logger::Error("Emulator failed to load ROM: {}", filename);
         return false;
     }
 
-    cpu_accum = 0.0;
+    _chip8.SetClockRate(static_cast<uint32_t>(CPU_HZ));
+    _rewind.Clear();
+
+    uint64_t rom_hash = 0;
+    if (!_movie_path.empty() && movie::HashFile(filename, rom_hash))
+    {
+        _recorder.Start(_chip8, rom_hash);
+    }
     frame_accum = 0.0;
     prev = std::chrono::steady_clock::now();
 
@@ -103,28 +161,53 @@ bool Emulator::LoadRom(const std::string& filename)
     return true;
 }
 
-void Emulator::UploadGrid(uint32_t fg, uint32_t bg)
+void Emulator::UploadGrid(const uint32_t (&colors)[4], uint64_t dirty_rows)
 {
-    void* pixels;
-    int pitch;
-    if (!SDL_LockTexture(_window.GetGfxTexture(), nullptr, &pixels, &pitch))
+    // Only dirty rows are expanded into _pixels, then the span from the first
+    // to the last dirty row is uploaded. SDL_LockTexture cannot be used for
+    // partial updates: the locked pixels are write-only and may not hold the
+    // previous frame. A 128 pixel row is expanded one plane at a time, and
+    // the second bitplane is only looked at where it has pixels lit.
+    const uint64_t* g = _chip8.GetGfx(0);
+    const uint64_t* g1 = _chip8.GetGfx(1);
+    const int width = _chip8.GetWidth();
+    const int height = _chip8.GetHeight();
+    if (height < 64)
+    {
+        dirty_rows &= (uint64_t{1} << height) - 1;
+    }
+    if (dirty_rows == 0)
     {
-        logger::Error("LockTexture failed: {}", SDL_GetError());
         return;
     }
 
-    uint32_t* row = (uint32_t*)pixels;
-    int stride = pitch / 4;
-    const uint8_t *g = _chip8.GetGfx();
-    for (int y = 0; y < H; ++y) {
-        uint32_t *dst = row + y * stride;
-        for (int x = 0; x < W; ++x) {
-            uint32_t mask = (uint32_t)-((int)g[x]); 
-            dst[x] = bg ^ ((bg ^ fg) & mask);
+    const int first = std::countr_zero(dirty_rows);
+    const int last = 63 - std::countl_zero(dirty_rows);
+    for (int y = first; y <= last; ++y)
+    {
+        if ((dirty_rows >> y) & 0x1)
+        {
+            for (int half = 0; half < width / W; ++half)
+            {
+                const int word = half * framebuffer::PLANE + y;
+                uint32_t* dst = _pixels + y * width + half * W;
+                if (g1[word] == 0)
+                {
+                    framebuffer::ExpandRow(g[word], dst, W, colors[1], colors[0]);
+                }
+                else
+                {
+                    framebuffer::ExpandPlanes(g[word], g1[word], dst, W, colors);
+                }
+            }
         }
-        g += W;
     }
-    SDL_UnlockTexture(_window.GetGfxTexture());
+
+    const SDL_Rect rect{0, first, width, last - first + 1};
+    if (!SDL_UpdateTexture(_window.GetGfxTexture(), &rect, _pixels + first * width, width * 4))
+    {
+        logger::Error("UpdateTexture failed: {}", SDL_GetError());
+    }
 }
 
 bool Emulator::Setup(const std::string& rom_path)
@@ -137,6 +220,9 @@ bool Emulator::Setup(const std::string& rom_path)
         return false;
     }
 
+    // not fatal: without a device the emulator runs silently
+    _audio.Open();
+
     if (!LoadRom(rom_path))
     {
         logger::Error("Emulator failed to load ROM");
@@ -146,3 +232,29 @@ bool Emulator::Setup(const std::string& rom_path)
     return true;
 }
 
+// Recording starts with the next LoadRom
+void Emulator::RecordMovie(const std::string& path)
+{
+    _movie_path = path;
+}
+
+// Paces the emulator by the audio device instead of steady_clock, so the
+// two never drift apart; has no effect without an audio device
+void Emulator::UseAudioClock(bool enabled)
+{
+    _audio.SetMasterClock(enabled);
+}
+
+void Emulator::SaveMovie()
+{
+    if (!_recorder.Recording())
+    {
+        return;
+    }
+
+    _recorder.Stop();
+    if (movie::WriteFile(_movie_path, _recorder.GetMovie()))
+    {
+        logger::Info("Saved movie: {} ({} frames)", _movie_path, _recorder.GetMovie().frames);
+    }
+}
@@ -1,4 +1,5 @@
 #include "event_handler.hpp"
+#include <algorithm>
 #include <unordered_map>
 #include "window.hpp"
 
@@ -15,8 +16,16 @@ EventHandler::~EventHandler()
     logger::Info("~EventHandler destructor called");
 }
 
-void EventHandler::ProcessEvents(Chip8& chip8)
+/*
+    Key events are not applied as they are polled, which would put every
+    event of a frame on the same instruction boundary. Each one is queued on
+    the Chip8 for the cycle that matches its SDL timestamp: present_cycle is
+    the emulated cycle that corresponds to now, and an event that happened
+    t seconds ago goes t * clock rate cycles before it.
+*/
+void EventHandler::ProcessEvents(Chip8& chip8, uint64_t present_cycle)
 {
+    const Uint64 now = SDL_GetTicksNS();
     while (SDL_PollEvent(&_event))
     {
         auto it = _key_map.find(_event.key.key);
@@ -26,10 +35,19 @@ void EventHandler::ProcessEvents(Chip8& chip8)
             case SDL_EVENT_QUIT:
                 _window->Exit();
                 break;
+            case SDL_EVENT_WINDOW_EXPOSED:
+            case SDL_EVENT_WINDOW_RESIZED:
+            case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+                _window->RequestRedraw();
+                break;
             case SDL_EVENT_KEY_DOWN:
-                if (it != _key_map.end())
+                if (_event.key.key == REWIND_KEY)
+                {
+                    _rewind_held = true;
+                }
+                else if (it != _key_map.end())
                 {
-                    chip8.OnKeyPressed(it->second);
+                    QueueKey(chip8, present_cycle, now, it->second, true);
                 }
                 else
                 {
@@ -37,9 +55,13 @@ void EventHandler::ProcessEvents(Chip8& chip8)
                 }
                 break;
             case SDL_EVENT_KEY_UP:
-                if (it != _key_map.end())
+                if (_event.key.key == REWIND_KEY)
+                {
+                    _rewind_held = false;
+                }
+                else if (it != _key_map.end())
                 {
-                    chip8.OnKeyReleased(it->second);
+                    QueueKey(chip8, present_cycle, now, it->second, false);
                 }
                 else
                 {
@@ -50,11 +72,32 @@ void EventHandler::ProcessEvents(Chip8& chip8)
     }
 }
 
+void EventHandler::QueueKey(Chip8& chip8, uint64_t present_cycle, Uint64 now, uint8_t key, bool down)
+{
+    const uint64_t age = (now > _event.key.timestamp) ? now - _event.key.timestamp : 0;
+    const uint64_t back = age * chip8.GetClockRate() / 1'000'000'000;
+    const uint64_t cycle = chip8.QueueKey(present_cycle - std::min(back, present_cycle), key, down);
+    if (_recorder != nullptr)
+    {
+        _recorder->OnKey(cycle, key, down);
+    }
+}
+
+bool EventHandler::RewindHeld() const
+{
+    return _rewind_held;
+}
+
 void EventHandler::SetWindow(Window* window)
 {
     _window = window;
 }
 
+void EventHandler::SetRecorder(MovieRecorder* recorder)
+{
+    _recorder = recorder;
+}
+
 void EventHandler::InitKeyMap()
 {
     _key_map[SDLK_1] = 0x1; _key_map[SDLK_2] = 0x2; _key_map[SDLK_3] = 0x3; _key_map[SDLK_4] = 0xC;
@@ -0,0 +1,344 @@
+#include "framebuffer.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define CHIP8_EXPAND_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__wasm_simd128__)
+#define CHIP8_EXPAND_WASM 1
+#include <wasm_simd128.h>
+#endif
+
+/*
+    Each group of 8 pixels comes from one byte of the row. The byte is
+    broadcast to every lane, ANDed with the lane's bit and compared against
+    it, giving an all-ones mask for set pixels; the pixel is then
+    bg ^ ((bg ^ fg) & mask), as in the scalar version.
+
+    Two bitplanes give two masks, m0 and m1, and the pixel is
+    bg ^ (d1 & m0) ^ (d2 & m1) ^ (d3 & m0 & m1), with d1 = c1 ^ bg,
+    d2 = c2 ^ bg and d3 = c3 ^ c2 ^ c1 ^ bg: still selects and XORs only,
+    no per-pixel table lookup.
+*/
+
+namespace
+{
+    void ExpandTail(uint64_t row, uint32_t* dst, int from, int width, uint32_t fg, uint32_t bg)
+    {
+        const uint32_t diff = bg ^ fg;
+        for (int x = from; x < width; ++x)
+        {
+            const uint32_t mask = 0u - static_cast<uint32_t>((row >> (63 - x)) & 0x1);
+            dst[x] = bg ^ (diff & mask);
+        }
+    }
+
+    void ExpandPlanesTail(uint64_t p0, uint64_t p1, uint32_t* dst, int from, int width, const uint32_t (&palette)[4])
+    {
+        for (int x = from; x < width; ++x)
+        {
+            dst[x] = palette[((p0 >> (63 - x)) & 0x1) | (((p1 >> (63 - x)) & 0x1) << 1)];
+        }
+    }
+
+    inline int RowByte(uint64_t row, int x)
+    {
+        return static_cast<int>((row >> (56 - x)) & 0xFF);
+    }
+
+    // d1, d2 and d3 of the comment above
+    struct PlaneTerms
+    {
+        uint32_t bg, d1, d2, d3;
+
+        explicit PlaneTerms(const uint32_t (&palette)[4])
+            : bg(palette[0]),
+              d1(palette[1] ^ palette[0]),
+              d2(palette[2] ^ palette[0]),
+              d3(palette[3] ^ palette[2] ^ palette[1] ^ palette[0])
+        {
+        }
+    };
+
+#ifdef CHIP8_EXPAND_SSE2
+    void ExpandRowSSE2(uint64_t row, uint32_t* dst, int width, uint32_t fg, uint32_t bg)
+    {
+        const __m128i vbg = _mm_set1_epi32(static_cast<int>(bg));
+        const __m128i vdiff = _mm_set1_epi32(static_cast<int>(bg ^ fg));
+        const __m128i hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+        const __m128i lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i b = _mm_set1_epi32(RowByte(row, x));
+            const __m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(b, hi), hi);
+            const __m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(b, lo), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_xor_si128(vbg, _mm_and_si128(vdiff, m0)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 4), _mm_xor_si128(vbg, _mm_and_si128(vdiff, m1)));
+        }
+        ExpandTail(row, dst, x, width, fg, bg);
+    }
+
+    inline __m128i Compose(__m128i m0, __m128i m1, __m128i bg, __m128i d1, __m128i d2, __m128i d3)
+    {
+        const __m128i one = _mm_xor_si128(_mm_and_si128(d1, m0), _mm_and_si128(d2, m1));
+        return _mm_xor_si128(_mm_xor_si128(bg, one), _mm_and_si128(d3, _mm_and_si128(m0, m1)));
+    }
+
+    void ExpandPlanesSSE2(uint64_t p0, uint64_t p1, uint32_t* dst, int width, const uint32_t (&palette)[4])
+    {
+        const PlaneTerms t(palette);
+        const __m128i vbg = _mm_set1_epi32(static_cast<int>(t.bg));
+        const __m128i d1 = _mm_set1_epi32(static_cast<int>(t.d1));
+        const __m128i d2 = _mm_set1_epi32(static_cast<int>(t.d2));
+        const __m128i d3 = _mm_set1_epi32(static_cast<int>(t.d3));
+        const __m128i hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+        const __m128i lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i b0 = _mm_set1_epi32(RowByte(p0, x));
+            const __m128i b1 = _mm_set1_epi32(RowByte(p1, x));
+            const __m128i hi0 = _mm_cmpeq_epi32(_mm_and_si128(b0, hi), hi);
+            const __m128i hi1 = _mm_cmpeq_epi32(_mm_and_si128(b1, hi), hi);
+            const __m128i lo0 = _mm_cmpeq_epi32(_mm_and_si128(b0, lo), lo);
+            const __m128i lo1 = _mm_cmpeq_epi32(_mm_and_si128(b1, lo), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), Compose(hi0, hi1, vbg, d1, d2, d3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 4), Compose(lo0, lo1, vbg, d1, d2, d3));
+        }
+        ExpandPlanesTail(p0, p1, dst, x, width, palette);
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((target("avx2")))
+#endif
+    void ExpandRowAVX2(uint64_t row, uint32_t* dst, int width, uint32_t fg, uint32_t bg)
+    {
+        const __m256i vbg = _mm256_set1_epi32(static_cast<int>(bg));
+        const __m256i vdiff = _mm256_set1_epi32(static_cast<int>(bg ^ fg));
+        const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m256i b = _mm256_set1_epi32(RowByte(row, x));
+            const __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(b, bits), bits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_xor_si256(vbg, _mm256_and_si256(vdiff, m)));
+        }
+        ExpandTail(row, dst, x, width, fg, bg);
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((target("avx2")))
+#endif
+    void ExpandPlanesAVX2(uint64_t p0, uint64_t p1, uint32_t* dst, int width, const uint32_t (&palette)[4])
+    {
+        const PlaneTerms t(palette);
+        const __m256i vbg = _mm256_set1_epi32(static_cast<int>(t.bg));
+        const __m256i d1 = _mm256_set1_epi32(static_cast<int>(t.d1));
+        const __m256i d2 = _mm256_set1_epi32(static_cast<int>(t.d2));
+        const __m256i d3 = _mm256_set1_epi32(static_cast<int>(t.d3));
+        const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m256i m0 = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(RowByte(p0, x)), bits), bits);
+            const __m256i m1 = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(RowByte(p1, x)), bits), bits);
+            const __m256i one = _mm256_xor_si256(_mm256_and_si256(d1, m0), _mm256_and_si256(d2, m1));
+            const __m256i both = _mm256_and_si256(d3, _mm256_and_si256(m0, m1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_xor_si256(_mm256_xor_si256(vbg, one), both));
+        }
+        ExpandPlanesTail(p0, p1, dst, x, width, palette);
+    }
+
+    bool HasAVX2()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    using ExpandFn = void (*)(uint64_t, uint32_t*, int, uint32_t, uint32_t);
+
+    ExpandFn SelectExpand()
+    {
+        return HasAVX2() ? ExpandRowAVX2 : ExpandRowSSE2;
+    }
+
+    using ExpandPlanesFn = void (*)(uint64_t, uint64_t, uint32_t*, int, const uint32_t (&)[4]);
+
+    ExpandPlanesFn SelectExpandPlanes()
+    {
+        return HasAVX2() ? ExpandPlanesAVX2 : ExpandPlanesSSE2;
+    }
+#endif
+
+#ifdef CHIP8_EXPAND_WASM
+    void ExpandRowWasm(uint64_t row, uint32_t* dst, int width, uint32_t fg, uint32_t bg)
+    {
+        const v128_t vbg = wasm_i32x4_splat(static_cast<int32_t>(bg));
+        const v128_t vdiff = wasm_i32x4_splat(static_cast<int32_t>(bg ^ fg));
+        const v128_t hi = wasm_i32x4_make(0x80, 0x40, 0x20, 0x10);
+        const v128_t lo = wasm_i32x4_make(0x08, 0x04, 0x02, 0x01);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const v128_t b = wasm_i32x4_splat(RowByte(row, x));
+            const v128_t m0 = wasm_i32x4_eq(wasm_v128_and(b, hi), hi);
+            const v128_t m1 = wasm_i32x4_eq(wasm_v128_and(b, lo), lo);
+            wasm_v128_store(dst + x, wasm_v128_xor(vbg, wasm_v128_and(vdiff, m0)));
+            wasm_v128_store(dst + x + 4, wasm_v128_xor(vbg, wasm_v128_and(vdiff, m1)));
+        }
+        ExpandTail(row, dst, x, width, fg, bg);
+    }
+
+    void ExpandPlanesWasm(uint64_t p0, uint64_t p1, uint32_t* dst, int width, const uint32_t (&palette)[4])
+    {
+        const PlaneTerms t(palette);
+        const v128_t vbg = wasm_i32x4_splat(static_cast<int32_t>(t.bg));
+        const v128_t d1 = wasm_i32x4_splat(static_cast<int32_t>(t.d1));
+        const v128_t d2 = wasm_i32x4_splat(static_cast<int32_t>(t.d2));
+        const v128_t d3 = wasm_i32x4_splat(static_cast<int32_t>(t.d3));
+        const v128_t halves[2] = {wasm_i32x4_make(0x80, 0x40, 0x20, 0x10), wasm_i32x4_make(0x08, 0x04, 0x02, 0x01)};
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const v128_t b0 = wasm_i32x4_splat(RowByte(p0, x));
+            const v128_t b1 = wasm_i32x4_splat(RowByte(p1, x));
+            for (int h = 0; h < 2; ++h)
+            {
+                const v128_t m0 = wasm_i32x4_eq(wasm_v128_and(b0, halves[h]), halves[h]);
+                const v128_t m1 = wasm_i32x4_eq(wasm_v128_and(b1, halves[h]), halves[h]);
+                const v128_t one = wasm_v128_xor(wasm_v128_and(d1, m0), wasm_v128_and(d2, m1));
+                const v128_t both = wasm_v128_and(d3, wasm_v128_and(m0, m1));
+                wasm_v128_store(dst + x + 4 * h, wasm_v128_xor(wasm_v128_xor(vbg, one), both));
+            }
+        }
+        ExpandPlanesTail(p0, p1, dst, x, width, palette);
+    }
+#endif
+}
+
+void framebuffer::ExpandRow(uint64_t row, uint32_t* dst, int width, uint32_t fg, uint32_t bg)
+{
+#if defined(CHIP8_EXPAND_SSE2)
+    static const ExpandFn expand = SelectExpand();
+    expand(row, dst, width, fg, bg);
+#elif defined(CHIP8_EXPAND_WASM)
+    ExpandRowWasm(row, dst, width, fg, bg);
+#else
+    ExpandTail(row, dst, 0, width, fg, bg);
+#endif
+}
+
+void framebuffer::ExpandPlanes(uint64_t p0, uint64_t p1, uint32_t* dst, int width, const uint32_t (&palette)[4])
+{
+#if defined(CHIP8_EXPAND_SSE2)
+    static const ExpandPlanesFn expand = SelectExpandPlanes();
+    expand(p0, p1, dst, width, palette);
+#elif defined(CHIP8_EXPAND_WASM)
+    ExpandPlanesWasm(p0, p1, dst, width, palette);
+#else
+    ExpandPlanesTail(p0, p1, dst, 0, width, palette);
+#endif
+}
+
+/*
+    Scrolling moves whole row words: a vertical scroll copies each row from
+    the one n above it, a horizontal one shifts each word and carries the
+    bits that cross the middle of a 128 pixel row from one plane to the
+    other. No pixel is touched on its own.
+*/
+
+uint64_t framebuffer::ScrollUp(uint64_t* rows, int planes, int height, int n)
+{
+    uint64_t dirty = 0;
+    for (int p = 0; p < planes; ++p)
+    {
+        uint64_t* plane = rows + p * PLANE;
+        for (int y = 0; y < height; ++y)
+        {
+            const uint64_t moved = (y + n < height) ? plane[y + n] : 0;
+            dirty |= static_cast<uint64_t>(moved != plane[y]) << y;
+            plane[y] = moved;
+        }
+    }
+    return dirty;
+}
+
+uint64_t framebuffer::ScrollDown(uint64_t* rows, int planes, int height, int n)
+{
+    uint64_t dirty = 0;
+    for (int p = 0; p < planes; ++p)
+    {
+        uint64_t* plane = rows + p * PLANE;
+        for (int y = height - 1; y >= 0; --y)
+        {
+            const uint64_t moved = (y >= n) ? plane[y - n] : 0;
+            dirty |= static_cast<uint64_t>(moved != plane[y]) << y;
+            plane[y] = moved;
+        }
+    }
+    return dirty;
+}
+
+uint64_t framebuffer::ScrollLeft(uint64_t* rows, int planes, int height, int n)
+{
+    uint64_t dirty = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const uint64_t left = rows[y];
+        const uint64_t right = (planes == 2) ? rows[PLANE + y] : 0;
+        rows[y] = (left << n) | (right >> (64 - n));
+        if (planes == 2)
+        {
+            rows[PLANE + y] = right << n;
+        }
+        dirty |= static_cast<uint64_t>((left | right) != 0) << y;
+    }
+    return dirty;
+}
+
+uint64_t framebuffer::ScrollRight(uint64_t* rows, int planes, int height, int n)
+{
+    uint64_t dirty = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const uint64_t left = rows[y];
+        const uint64_t right = (planes == 2) ? rows[PLANE + y] : 0;
+        rows[y] = left >> n;
+        if (planes == 2)
+        {
+            rows[PLANE + y] = (right >> n) | (left << (64 - n));
+        }
+        dirty |= static_cast<uint64_t>((left | right) != 0) << y;
+    }
+    return dirty;
+}
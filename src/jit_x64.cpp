@@ -0,0 +1,1262 @@
+#include "jit_x64.hpp"
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <vector>
+#include "chip8.hpp"
+#include "profiler.hpp"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(__EMSCRIPTEN__)
+#define CHIP8_JIT_X64 1
+#endif
+
+#ifdef CHIP8_JIT_X64
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// The slow way for a native store: a shared page or one holding translated code
+void JitX64::Store(Chip8* c, uint32_t addr, uint32_t value)
+{
+    c->StoreByte(static_cast<uint16_t>(addr), static_cast<uint8_t>(value));
+}
+
+#ifdef CHIP8_JIT_X64
+
+namespace
+{
+    enum Reg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    enum Alu : uint8_t
+    {
+        ADD = 0x01,
+        OR  = 0x09,
+        AND = 0x21,
+        SUB = 0x29,
+        XOR = 0x31,
+        CMP = 0x39
+    };
+
+    enum Cond : uint8_t
+    {
+        CC_B  = 0x2,
+        CC_AE = 0x3,
+        CC_E  = 0x4,
+        CC_NE = 0x5,
+        CC_A  = 0x7
+    };
+
+    // the /digit of the 0xC1 / 0xD3 shift groups
+    enum Shift : uint8_t
+    {
+        ROL = 0,
+        ROR = 1,
+        SHL = 4,
+        SHR = 5
+    };
+
+    // Native code keeps two 8 byte slots in its frame: the budget it was
+    // entered with and what is left of it
+#ifdef _WIN32
+    constexpr Reg ARG0 = RCX;
+    constexpr Reg ARG1 = RDX;
+    constexpr Reg ARG2 = R8;
+    constexpr Reg SAVED[] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+    constexpr uint8_t FRAME_PAD = 56; // 32 bytes shadow space, the slots, alignment
+    constexpr int32_t START_SLOT = 32;
+#else
+    constexpr Reg ARG0 = RDI;
+    constexpr Reg ARG1 = RSI;
+    constexpr Reg ARG2 = RDX;
+    constexpr Reg SAVED[] = { RBX, RBP, R12, R13, R14, R15 };
+    constexpr uint8_t FRAME_PAD = 24; // the slots, alignment
+    constexpr int32_t START_SLOT = 0;
+#endif
+    constexpr int32_t BUDGET_SLOT = START_SLOT + 8;
+
+    // host registers that can hold a V register for the length of a block
+    constexpr Reg V_HOST[] = { RSI, RDI, RBP, R8, R9, R10, R12, R13, R14 };
+    constexpr Reg I_HOST = R15;
+    constexpr Reg STATE = RBX;
+    constexpr Reg TEMP = R11;       // scratch next to RAX, RCX and RDX
+
+    constexpr int32_t PAGE_REFS = offsetof(PagedMemory::Page, refs);
+
+    class Emitter
+    {
+        public:
+            std::vector<uint8_t> code;
+
+            void Byte(uint8_t b) { code.push_back(b); }
+            void Imm16(uint16_t v) { Byte(v & 0xFF); Byte(v >> 8); }
+            void Imm32(uint32_t v) { for (int i = 0; i < 4; i++) Byte((v >> (8 * i)) & 0xFF); }
+            void Imm64(uint64_t v) { for (int i = 0; i < 8; i++) Byte((v >> (8 * i)) & 0xFF); }
+
+            void Rex(bool w, uint8_t reg, uint8_t rm, bool force = false, uint8_t index = 0)
+            {
+                const uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((rm >> 3) & 1);
+                if (rex != 0x40 || force)
+                {
+                    Byte(rex);
+                }
+            }
+
+            void ModRM(uint8_t mod, uint8_t reg, uint8_t rm) { Byte((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+
+            // opcode bytes with a [base + disp32] or [base + index * 2^scale + disp32]
+            // operand; index < 0 for none. byte_reg asks for the REX prefix
+            // that selects SIL / DIL instead of DH / BH.
+            void OpMem(bool w, std::initializer_list<uint8_t> opcode, uint8_t reg, Reg base, int32_t disp,
+                       int index = -1, uint8_t scale = 0, bool byte_reg = false)
+            {
+                Rex(w, reg, base, byte_reg && reg >= 4, index >= 0 ? static_cast<uint8_t>(index) : 0);
+                for (uint8_t b : opcode)
+                {
+                    Byte(b);
+                }
+                if (index >= 0)
+                {
+                    ModRM(2, reg, 4);
+                    Byte((scale << 6) | ((index & 7) << 3) | (base & 7));
+                }
+                else if ((base & 7) == RSP)
+                {
+                    ModRM(2, reg, 4);
+                    Byte(0x24);
+                }
+                else
+                {
+                    ModRM(2, reg, base);
+                }
+                Imm32(static_cast<uint32_t>(disp));
+            }
+
+            // 32-bit register forms
+            void MovRR(Reg dst, Reg src) { Rex(false, src, dst); Byte(0x89); ModRM(3, src, dst); }
+            void MovRI(Reg dst, uint32_t imm) { Rex(false, 0, dst); Byte(0xB8 + (dst & 7)); Imm32(imm); }
+            void AluRR(Alu op, Reg dst, Reg src) { Rex(false, src, dst); Byte(op); ModRM(3, src, dst); }
+            void AluRI(Alu op, Reg dst, uint32_t imm)
+            {
+                // the /digit of the 0x81 group matches the 0x01..0x39 opcode row
+                Rex(false, 0, dst); Byte(0x81); ModRM(3, op >> 3, dst); Imm32(imm);
+            }
+            void ShrRI(Reg dst, uint8_t n) { Rex(false, 0, dst); Byte(0xC1); ModRM(3, SHR, dst); Byte(n); }
+            void ShlRI(Reg dst, uint8_t n) { Rex(false, 0, dst); Byte(0xC1); ModRM(3, SHL, dst); Byte(n); }
+            void ImulRRI(Reg dst, Reg src, uint8_t imm) { Rex(false, dst, src); Byte(0x6B); ModRM(3, dst, src); Byte(imm); }
+            void ImulRRI32(Reg dst, Reg src, uint32_t imm) { Rex(false, dst, src); Byte(0x69); ModRM(3, dst, src); Imm32(imm); }
+            void TestRR(Reg a, Reg b) { Rex(false, b, a); Byte(0x85); ModRM(3, b, a); }
+            void SetCC(Cond cc, Reg dst) { Rex(false, 0, dst, dst >= 4); Byte(0x0F); Byte(0x90 + cc); ModRM(3, 0, dst); }
+            void CmovCC(Cond cc, Reg dst, Reg src) { Rex(false, dst, src); Byte(0x0F); Byte(0x40 + cc); ModRM(3, dst, src); }
+            void Lea(Reg dst, Reg base, int32_t disp) { OpMem(false, {0x8D}, dst, base, disp); }
+
+            // [STATE + disp32] memory forms
+            void LoadByte(Reg dst, int32_t disp) { Rex(false, dst, STATE); Byte(0x0F); Byte(0xB6); ModRM(2, dst, STATE); Imm32(disp); }
+            void LoadWord(Reg dst, int32_t disp) { Rex(false, dst, STATE); Byte(0x0F); Byte(0xB7); ModRM(2, dst, STATE); Imm32(disp); }
+            void LoadByteIndexed(Reg dst, Reg index, int32_t disp)
+            {
+                Rex(false, dst, STATE, false, index); Byte(0x0F); Byte(0xB6); ModRM(2, dst, 4);
+                Byte(((index & 7) << 3) | (STATE & 7)); Imm32(disp);
+            }
+            void LoadQwordScaled(Reg dst, Reg index, int32_t disp)
+            {
+                // mov dst, [STATE + index * 8 + disp32]
+                Rex(true, dst, STATE, false, index); Byte(0x8B); ModRM(2, dst, 4);
+                Byte((3 << 6) | ((index & 7) << 3) | (STATE & 7)); Imm32(disp);
+            }
+            void StoreQwordScaled(Reg index, int32_t disp, Reg src) { OpMem(true, {0x89}, src, STATE, disp, index, 3); }
+            // [STATE + index * 2 + disp32], for the stack
+            void LoadWordScaled(Reg dst, Reg index, int32_t disp) { OpMem(false, {0x0F, 0xB7}, dst, STATE, disp, index, 1); }
+            void StoreWordScaledI(Reg index, int32_t disp, uint16_t imm)
+            {
+                Byte(0x66); OpMem(false, {0xC7}, 0, STATE, disp, index, 1); Imm16(imm);
+            }
+            // movzx dst, byte [base + index]; base must not be RBP or R13
+            void LoadByteBaseIndex(Reg dst, Reg base, Reg index)
+            {
+                Rex(false, dst, base, false, index); Byte(0x0F); Byte(0xB6); ModRM(0, dst, 4);
+                Byte(((index & 7) << 3) | (base & 7));
+            }
+            void StoreByteBaseIndex(Reg base, Reg index, Reg src) { OpMem(false, {0x88}, src, base, 0, index, 0, true); }
+            void StoreByte(int32_t disp, Reg src) { Rex(false, src, STATE, src >= 4); Byte(0x88); ModRM(2, src, STATE); Imm32(disp); }
+            void StoreByteI(int32_t disp, uint8_t imm) { Byte(0xC6); ModRM(2, 0, STATE); Imm32(disp); Byte(imm); }
+            void StoreWord(int32_t disp, Reg src) { Byte(0x66); Rex(false, src, STATE); Byte(0x89); ModRM(2, src, STATE); Imm32(disp); }
+            void StoreWordI(int32_t disp, uint16_t imm) { Byte(0x66); Byte(0xC7); ModRM(2, 0, STATE); Imm32(disp); Imm16(imm); }
+            void AluMR8(Alu op, int32_t disp, Reg src) { OpMem(false, {static_cast<uint8_t>(op - 1)}, src, STATE, disp, -1, 0, true); }
+            void CmpMI8(int32_t disp, uint8_t imm) { OpMem(false, {0x80}, CMP >> 3, STATE, disp); Byte(imm); }
+            void CmpMI32(Reg base, int32_t disp, uint32_t imm) { OpMem(false, {0x81}, CMP >> 3, base, disp); Imm32(imm); }
+
+            // 64-bit forms
+            void Load64(Reg dst, Reg base, int32_t disp) { OpMem(true, {0x8B}, dst, base, disp); }
+            void Store64(Reg base, int32_t disp, Reg src) { OpMem(true, {0x89}, src, base, disp); }
+            void AluMR64(Alu op, Reg base, int32_t disp, Reg src) { OpMem(true, {op}, src, base, disp); }
+            void AluRM64(Alu op, Reg dst, Reg base, int32_t disp) { OpMem(true, {static_cast<uint8_t>(op + 2)}, dst, base, disp); }
+            void AluMI64(Alu op, Reg base, int32_t disp, uint32_t imm) { OpMem(true, {0x81}, op >> 3, base, disp); Imm32(imm); }
+            void AluRR64(Alu op, Reg dst, Reg src) { Rex(true, src, dst); Byte(op); ModRM(3, src, dst); }
+            void TestRR64(Reg a, Reg b) { Rex(true, b, a); Byte(0x85); ModRM(3, b, a); }
+            void ShiftRI64(Shift op, Reg dst, uint8_t n) { Rex(true, 0, dst); Byte(0xC1); ModRM(3, op, dst); Byte(n); }
+            void ShiftRCl64(Shift op, Reg dst) { Rex(true, 0, dst); Byte(0xD3); ModRM(3, op, dst); }
+            void ShiftMI64(Shift op, Reg base, int32_t disp, uint8_t n) { OpMem(true, {0xC1}, op, base, disp); Byte(n); }
+            // lea dst, [base + index * 2^scale]
+            void LeaScaled(Reg dst, Reg base, Reg index, uint8_t scale) { OpMem(true, {0x8D}, dst, base, 0, index, scale); }
+            void CmovCC64(Cond cc, Reg dst, Reg src) { Rex(true, dst, src); Byte(0x0F); Byte(0x40 + cc); ModRM(3, dst, src); }
+            void BtsRR64(Reg dst, Reg bit) { Rex(true, bit, dst); Byte(0x0F); Byte(0xAB); ModRM(3, bit, dst); }
+            // bt [base], bit: CF = bit number bit of the bitmap at base
+            void BtM64(Reg base, Reg bit) { OpMem(true, {0x0F, 0xA3}, bit, base, 0); }
+
+            // 64-bit forms for the frame and calls
+            void Push(Reg r) { if (r >= 8) Byte(0x41); Byte(0x50 + (r & 7)); }
+            void Pop(Reg r) { if (r >= 8) Byte(0x41); Byte(0x58 + (r & 7)); }
+            void MovR64R64(Reg dst, Reg src) { Rex(true, src, dst); Byte(0x89); ModRM(3, src, dst); }
+            void MovR64I64(Reg dst, uint64_t imm) { Rex(true, 0, dst); Byte(0xB8 + (dst & 7)); Imm64(imm); }
+            void CallR(Reg r) { Rex(false, 0, r); Byte(0xFF); ModRM(3, 2, r); }
+            void JmpM(Reg base, int32_t disp) { OpMem(false, {0xFF}, 4, base, disp); }
+            void SubRsp(uint8_t n) { Byte(0x48); Byte(0x83); Byte(0xEC); Byte(n); }
+            void AddRsp(uint8_t n) { Byte(0x48); Byte(0x83); Byte(0xC4); Byte(n); }
+            void Ret() { Byte(0xC3); }
+
+            // Forward branches: emit with a zero displacement, Bind() once
+            // the target is reached
+            size_t Jcc(Cond cc) { Byte(0x0F); Byte(0x80 + cc); Imm32(0); return code.size() - 4; }
+            size_t Jmp() { Byte(0xE9); Imm32(0); return code.size() - 4; }
+            void Bind(size_t at)
+            {
+                const uint32_t rel = static_cast<uint32_t>(code.size() - (at + 4));
+                std::memcpy(code.data() + at, &rel, sizeof(rel));
+            }
+
+            // lea dst, [rip + literal]: a copy of in placed after the code by
+            // Finish(), so handlers get an Instruction that lives as long as
+            // the code does
+            void LeaLiteral(Reg dst, const Instruction& in)
+            {
+                Rex(true, dst, 0); Byte(0x8D); ModRM(0, dst, 5);
+                _literal_refs.push_back(code.size());
+                _literals.push_back(in);
+                Imm32(0);
+            }
+
+            void Finish()
+            {
+                while (code.size() % alignof(Instruction) != 0)
+                {
+                    Byte(0xCC);
+                }
+                for (size_t i = 0; i < _literals.size(); i++)
+                {
+                    const size_t at = _literal_refs[i];
+                    const uint32_t rel = static_cast<uint32_t>(code.size() - (at + 4));
+                    std::memcpy(code.data() + at, &rel, sizeof(rel));
+                    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&_literals[i]);
+                    code.insert(code.end(), bytes, bytes + sizeof(Instruction));
+                }
+            }
+
+        private:
+            std::vector<Instruction> _literals;
+            std::vector<size_t> _literal_refs;  // displacement to patch, per literal
+    };
+
+    struct Offsets
+    {
+        int32_t V;
+        int32_t I;
+        int32_t pc;
+        int32_t delay;
+        int32_t sound;
+        int32_t key;
+        int32_t memory;         // page table
+        int32_t fontset_start;
+        int32_t stack;
+        int32_t stack_size;     // in entries
+        int32_t sp;
+        int32_t rng;
+        int32_t gfx;
+        int32_t dirty_rows;
+        int32_t draw_flag;
+        int32_t hires;
+        int32_t planes;
+        int32_t waiting_for_vblank;
+        int32_t waiting_for_key;
+    };
+
+    // What the generated code calls and reads besides the Chip8 itself
+    struct Hooks
+    {
+        void (*store)(Chip8*, uint32_t, uint32_t);
+        const BlockCache::Link* links;
+        const uint64_t* code_bits;
+    };
+
+    // The frame every block shares, so chained blocks enter past it
+    void Prologue(Emitter& e)
+    {
+        for (Reg r : SAVED)
+        {
+            e.Push(r);
+        }
+        e.SubRsp(FRAME_PAD);
+        e.MovR64R64(STATE, ARG0);
+        e.Store64(RSP, START_SLOT, ARG1);
+        e.Store64(RSP, BUDGET_SLOT, ARG1);
+    }
+
+    // Q is the quirk policy (quirks.hpp) the block is compiled for
+    template <typename Q>
+    class BlockCompiler
+    {
+        public:
+            BlockCompiler(const Offsets& off, const Hooks& hooks, const PagedMemory& memory)
+                : _off(off), _hooks(hooks), _memory(memory)
+            {
+            }
+
+            std::vector<uint8_t> Compile(const BlockCache::Block& block)
+            {
+                _length = static_cast<uint32_t>(block.ops.size());
+                AssignHostRegisters(block);
+                Prologue(_e);
+
+                uint16_t pc = block.start;
+                bool open = true;
+                for (const Instruction& in : block.ops)
+                {
+                    if (!EmitInstruction(in, pc))
+                    {
+                        open = false;   // block exit already emitted
+                        break;
+                    }
+                    pc += (Q::XO_CHIP && in.opcode == 0xF000) ? 4 : 2;
+                }
+
+                if (open)
+                {
+                    _e.MovRI(RCX, pc);
+                    Exit();
+                }
+                _e.Finish();
+                return std::move(_e.code);
+            }
+
+        private:
+            struct VState
+            {
+                int8_t host = -1;
+                bool loaded = false;
+                bool dirty = false;
+            };
+
+            Emitter _e;
+            Offsets _off;
+            Hooks _hooks;
+            const PagedMemory& _memory;     // only read for words the block covers
+            uint32_t _length = 0;
+            VState _v[16];
+            bool _i_loaded = false;
+            bool _i_dirty = false;
+
+            void AssignHostRegisters(const BlockCache::Block& block)
+            {
+                int uses[16] = {};
+                for (const Instruction& in : block.ops)
+                {
+                    uses[in.X]++;
+                    uses[in.Y]++;
+                }
+                uses[0xF] += 2; // VF is written by most ALU ops
+
+                for (size_t h = 0; h < std::size(V_HOST); h++)
+                {
+                    int best = -1;
+                    for (int v = 0; v < 16; v++)
+                    {
+                        if (_v[v].host < 0 && uses[v] > 0 && (best < 0 || uses[v] > uses[best]))
+                        {
+                            best = v;
+                        }
+                    }
+                    if (best < 0)
+                    {
+                        break;
+                    }
+                    _v[best].host = static_cast<int8_t>(V_HOST[h]);
+                }
+            }
+
+            void Epilogue()
+            {
+                _e.AddRsp(FRAME_PAD);
+                for (size_t i = std::size(SAVED); i-- > 0;)
+                {
+                    _e.Pop(SAVED[i]);
+                }
+                _e.Ret();
+            }
+
+            Reg Host(uint8_t v)
+            {
+                VState& s = _v[v];
+                if (!s.loaded)
+                {
+                    _e.LoadByte(static_cast<Reg>(s.host), _off.V + v);
+                    s.loaded = true;
+                }
+                return static_cast<Reg>(s.host);
+            }
+
+            void Get(Reg dst, uint8_t v)
+            {
+                if (_v[v].host >= 0)
+                {
+                    _e.MovRR(dst, Host(v));
+                }
+                else
+                {
+                    _e.LoadByte(dst, _off.V + v);
+                }
+            }
+
+            void Set(uint8_t v, Reg src)
+            {
+                VState& s = _v[v];
+                if (s.host >= 0)
+                {
+                    _e.MovRR(static_cast<Reg>(s.host), src);
+                    s.loaded = true;
+                    s.dirty = true;
+                }
+                else
+                {
+                    _e.StoreByte(_off.V + v, src);
+                }
+            }
+
+            void SetImm(uint8_t v, uint8_t imm)
+            {
+                VState& s = _v[v];
+                if (s.host >= 0)
+                {
+                    _e.MovRI(static_cast<Reg>(s.host), imm);
+                    s.loaded = true;
+                    s.dirty = true;
+                }
+                else
+                {
+                    _e.StoreByteI(_off.V + v, imm);
+                }
+            }
+
+            void UseI()
+            {
+                if (!_i_loaded)
+                {
+                    _e.LoadWord(I_HOST, _off.I);
+                    _i_loaded = true;
+                }
+            }
+
+            void DirtyI()
+            {
+                _i_loaded = true;
+                _i_dirty = true;
+            }
+
+            // write every modified register back to the Chip8 object
+            void Flush()
+            {
+                for (uint8_t v = 0; v < 16; v++)
+                {
+                    if (_v[v].dirty)
+                    {
+                        _e.StoreByte(_off.V + v, static_cast<Reg>(_v[v].host));
+                        _v[v].dirty = false;
+                    }
+                }
+                if (_i_dirty)
+                {
+                    _e.StoreWord(_off.I, I_HOST);
+                    _i_dirty = false;
+                }
+            }
+
+            // after a call out, host copies may be stale or clobbered
+            void Forget()
+            {
+                for (VState& s : _v)
+                {
+                    s.loaded = false;
+                }
+                _i_loaded = false;
+            }
+
+            // after a call out on a path that rejoins the other one: the
+            // registers were flushed, so memory still holds their values
+            void Reload()
+            {
+                for (uint8_t v = 0; v < 16; v++)
+                {
+                    if (_v[v].loaded)
+                    {
+                        _e.LoadByte(static_cast<Reg>(_v[v].host), _off.V + v);
+                    }
+                }
+            }
+
+            // runs in through its decoded handler, as if fetched at pc
+            void CallHandler(const Instruction& in, uint16_t pc)
+            {
+                Flush();
+                _e.StoreWordI(_off.pc, pc);
+                _e.LeaLiteral(ARG1, in);
+                _e.MovR64R64(ARG0, STATE);
+                _e.MovR64I64(RAX, reinterpret_cast<uint64_t>(in.handler));
+                _e.CallR(RAX);
+                Forget();
+            }
+
+            // Leaves the block for the PC in ECX. Unless the CPU blocked,
+            // the next block's native code is entered directly when it has
+            // some and fits in what is left of the budget; otherwise returns
+            // the instructions run since the native code was entered.
+            void Exit()
+            {
+                Flush();
+                _e.StoreWord(_off.pc, RCX);
+                _e.AluMI64(SUB, RSP, BUDGET_SLOT, _length);
+                if constexpr (!Profiler::ENABLED)
+                {
+                    // the profiler counts every block from RunBlocks, so
+                    // nothing is chained when it is built in
+                    size_t out[5];
+                    _e.CmpMI8(_off.waiting_for_vblank, 0);
+                    out[0] = _e.Jcc(CC_NE);
+                    _e.CmpMI8(_off.waiting_for_key, 0);
+                    out[1] = _e.Jcc(CC_NE);
+                    _e.AluRI(CMP, RCX, RAM);
+                    out[2] = _e.Jcc(CC_AE);
+                    _e.MovRR(RAX, RCX);
+                    _e.ShlRI(RAX, 4);
+                    static_assert(sizeof(BlockCache::Link) == 16, "links are indexed by PC * 16");
+                    _e.MovR64I64(RDX, reinterpret_cast<uint64_t>(_hooks.links));
+                    _e.AluRR64(ADD, RDX, RAX);
+                    _e.Load64(RAX, RDX, offsetof(BlockCache::Link, length));
+                    _e.TestRR64(RAX, RAX);
+                    out[3] = _e.Jcc(CC_E);
+                    _e.AluRM64(CMP, RAX, RSP, BUDGET_SLOT);
+                    out[4] = _e.Jcc(CC_A);
+                    _e.JmpM(RDX, offsetof(BlockCache::Link, body));
+                    for (size_t at : out)
+                    {
+                        _e.Bind(at);
+                    }
+                }
+                _e.Load64(RAX, RSP, START_SLOT);
+                _e.AluRM64(SUB, RAX, RSP, BUDGET_SLOT);
+                Epilogue();
+            }
+
+            // after a handler that has set PC itself
+            void ExitFromHandler()
+            {
+                _e.LoadWord(RCX, _off.pc);
+                Exit();
+            }
+
+            uint16_t Word(uint16_t addr) const
+            {
+                return static_cast<uint16_t>((_memory[addr] << 8) | _memory[addr + 1]);
+            }
+
+            void ExitSkip(Cond skip_if, uint16_t pc)
+            {
+                // an XO-CHIP skip steps over a whole F000 NNNN; the word
+                // after the skip belongs to the block, see TranslateBlock
+                const bool long_skip = Q::XO_CHIP && Word(pc + 2) == 0xF000;
+                // flags are already set; mov does not touch them
+                _e.MovRI(RCX, pc + 2);
+                _e.MovRI(RDX, pc + (long_skip ? 6 : 4));
+                _e.CmovCC(skip_if, RCX, RDX);
+                Exit();
+            }
+
+            void SetVF(Reg src)
+            {
+                Set(0xF, src);
+            }
+
+            // Returns false once the block exit has been emitted
+            bool EmitInstruction(const Instruction& in, uint16_t pc)
+            {
+                const uint16_t op = in.opcode;
+                if (Q::XO_CHIP && pc + 4 > RAM)
+                {
+                    // the last word of RAM: what follows it is not covered
+                    // by the block, so leave it all to the handler
+                    CallHandler(in, pc);
+                    ExitFromHandler();
+                    return false;
+                }
+                switch (op >> 12)
+                {
+                    case 0x0:
+                        if (op == 0x00EE)
+                        {
+                            EmitReturn();
+                            return false;
+                        }
+                        break;
+                    case 0x1:
+                        _e.MovRI(RCX, in.NNN);
+                        Exit();
+                        return false;
+                    case 0x2:
+                        EmitCall(in, pc);
+                        return false;
+                    case 0x3:
+                        Get(RAX, in.X);
+                        _e.AluRI(CMP, RAX, in.NN);
+                        ExitSkip(CC_E, pc);
+                        return false;
+                    case 0x4:
+                        Get(RAX, in.X);
+                        _e.AluRI(CMP, RAX, in.NN);
+                        ExitSkip(CC_NE, pc);
+                        return false;
+                    case 0x5:
+                        if (Q::XO_CHIP && in.N != 0)
+                        {
+                            break;  // 5XY2 / 5XY3
+                        }
+                        Get(RAX, in.X);
+                        Get(RCX, in.Y);
+                        _e.AluRR(CMP, RAX, RCX);
+                        ExitSkip(CC_E, pc);
+                        return false;
+                    case 0x6:
+                        SetImm(in.X, in.NN);
+                        return true;
+                    case 0x7:
+                        Get(RAX, in.X);
+                        _e.AluRI(ADD, RAX, in.NN);
+                        _e.AluRI(AND, RAX, 0xFF);
+                        Set(in.X, RAX);
+                        return true;
+                    case 0x8:
+                        if (EmitAlu(in))
+                        {
+                            return true;
+                        }
+                        break;
+                    case 0x9:
+                        Get(RAX, in.X);
+                        Get(RCX, in.Y);
+                        _e.AluRR(CMP, RAX, RCX);
+                        ExitSkip(CC_NE, pc);
+                        return false;
+                    case 0xA:
+                        _e.MovRI(I_HOST, in.NNN);
+                        DirtyI();
+                        return true;
+                    case 0xB:
+                        Get(RCX, Q::JUMP_VX ? in.X : 0x0);
+                        _e.AluRI(ADD, RCX, in.NNN);
+                        _e.AluRI(AND, RCX, Q::ADDRESS_MASK);
+                        Exit();
+                        return false;
+                    case 0xC:
+                        EmitRandom(in);
+                        return true;
+                    case 0xD:
+                        if (in.N != 0)
+                        {
+                            EmitDraw(in, pc);
+                            return false;
+                        }
+                        break;
+                    case 0xE:
+                        if (in.NN == 0x9E || in.NN == 0xA1)
+                        {
+                            Get(RAX, in.X);
+                            _e.AluRI(AND, RAX, 0x0F);
+                            _e.LoadByteIndexed(RAX, RAX, _off.key);
+                            _e.AluRI(CMP, RAX, 0x1);
+                            ExitSkip(in.NN == 0x9E ? CC_E : CC_NE, pc);
+                            return false;
+                        }
+                        break;
+                    case 0xF:
+                        if (in.NN == 0x33 || in.NN == 0x55)
+                        {
+                            EmitStores(in, pc);
+                            return false;
+                        }
+                        if (EmitMisc(in, pc))
+                        {
+                            return true;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+
+                CallHandler(in, pc);
+                if (BlockCache::EndsBlock(op))
+                {
+                    ExitFromHandler();
+                    return false;
+                }
+                return true;
+            }
+
+            // 2NNN: pushes its own address, as Op_2NNN does; a full stack
+            // is left to the handler, which reports it
+            void EmitCall(const Instruction& in, uint16_t pc)
+            {
+                Flush();
+                _e.LoadWord(RAX, _off.sp);
+                _e.AluRI(CMP, RAX, static_cast<uint32_t>(_off.stack_size));
+                const size_t full = _e.Jcc(CC_AE);
+                _e.StoreWordScaledI(RAX, _off.stack, pc);
+                _e.AluRI(ADD, RAX, 1);
+                _e.StoreWord(_off.sp, RAX);
+                _e.MovRI(RCX, in.NNN);
+                Exit();
+
+                _e.Bind(full);
+                CallHandler(in, pc);
+                ExitFromHandler();
+            }
+
+            // 00EE: an empty stack returns through slot 0, as Op_00EE does
+            void EmitReturn()
+            {
+                Flush();
+                _e.LoadWord(RAX, _off.sp);
+                _e.Lea(RDX, RAX, -1);
+                _e.TestRR(RAX, RAX);
+                _e.CmovCC(CC_NE, RAX, RDX);
+                _e.StoreWord(_off.sp, RAX);
+                _e.LoadWordScaled(RCX, RAX, _off.stack);
+                _e.StoreWordScaledI(RAX, _off.stack, 0);
+                _e.AluRI(ADD, RCX, 2);
+                _e.AluRI(AND, RCX, 0xFFFF);
+                Exit();
+            }
+
+            // CXNN: one step of the machine's xoshiro256**, see random.hpp
+            void EmitRandom(const Instruction& in)
+            {
+                const int32_t s0 = _off.rng;
+                const int32_t s1 = _off.rng + 8;
+                const int32_t s2 = _off.rng + 16;
+                const int32_t s3 = _off.rng + 24;
+                _e.Load64(RAX, STATE, s1);
+                _e.LeaScaled(RAX, RAX, RAX, 2);         // * 5
+                _e.ShiftRI64(ROL, RAX, 7);
+                _e.LeaScaled(RAX, RAX, RAX, 3);         // * 9
+                _e.ShiftRI64(SHR, RAX, 56);             // NextByte takes the top byte
+                _e.Load64(RCX, STATE, s1);
+                _e.ShiftRI64(SHL, RCX, 17);
+                _e.Load64(RDX, STATE, s0);
+                _e.AluMR64(XOR, STATE, s2, RDX);
+                _e.Load64(RDX, STATE, s1);
+                _e.AluMR64(XOR, STATE, s3, RDX);
+                _e.Load64(RDX, STATE, s2);
+                _e.AluMR64(XOR, STATE, s1, RDX);
+                _e.Load64(RDX, STATE, s3);
+                _e.AluMR64(XOR, STATE, s0, RDX);
+                _e.AluMR64(XOR, STATE, s2, RCX);
+                _e.ShiftMI64(ROL, STATE, s3, 45);
+                _e.AluRI(AND, RAX, in.NN);
+                Set(in.X, RAX);
+            }
+
+            // DXYN in low resolution on the first bitplane, Op_DXYN's fast
+            // path unrolled over the rows; high resolution, other bitplanes
+            // and DXY0 go to the handler. Ends the block, so the host
+            // registers are free once the operands are read.
+            void EmitDraw(const Instruction& in, uint16_t pc)
+            {
+                Flush();
+                _e.CmpMI8(_off.hires, 0);
+                const size_t wide = _e.Jcc(CC_NE);
+                size_t planes = 0;
+                if constexpr (Q::XO_CHIP)
+                {
+                    _e.CmpMI8(_off.planes, 1);
+                    planes = _e.Jcc(CC_NE);
+                }
+
+                UseI();
+                Get(RCX, in.X);
+                Get(RSI, in.Y);
+                Forget();
+                _e.AluRI(AND, RCX, W - 1);              // x, for the shift
+                _e.AluRI(AND, RSI, H - 1);              // base y
+                _e.AluRR(XOR, RDI, RDI);                // collision
+                _e.AluRR(XOR, RBP, RBP);                // dirty rows
+                std::vector<size_t> clipped;
+                for (int row = 0; row < in.N; row++)
+                {
+                    if constexpr (!Q::WRAP_SPRITES)
+                    {
+                        // clipping at the bottom edge
+                        _e.AluRI(CMP, RSI, H - row);
+                        clipped.push_back(_e.Jcc(CC_AE));
+                    }
+                    _e.Lea(RAX, I_HOST, row);
+                    _e.AluRI(AND, RAX, Q::ADDRESS_MASK);
+                    _e.MovRR(RDX, RAX);
+                    _e.ShrRI(RDX, PagedMemory::PAGE_SHIFT);
+                    _e.LoadQwordScaled(RDX, RDX, _off.memory);
+                    _e.AluRI(AND, RAX, PagedMemory::PAGE_SIZE - 1);
+                    _e.LoadByteBaseIndex(RAX, RDX, RAX);
+                    _e.ShiftRI64(SHL, RAX, 56);
+                    _e.ShiftRCl64(Q::WRAP_SPRITES ? ROR : SHR, RAX);
+                    _e.Lea(RDX, RSI, row);
+                    if constexpr (Q::WRAP_SPRITES)
+                    {
+                        _e.AluRI(AND, RDX, H - 1);
+                    }
+                    _e.LoadQwordScaled(R8, RDX, _off.gfx);
+                    _e.MovR64R64(R9, R8);
+                    _e.AluRR64(AND, R9, RAX);
+                    _e.AluRR64(OR, RDI, R9);
+                    _e.AluRR64(XOR, R8, RAX);
+                    _e.StoreQwordScaled(RDX, _off.gfx, R8);
+                    // a non-zero sprite row always changes the line
+                    _e.AluRR(XOR, R9, R9);
+                    _e.BtsRR64(R9, RDX);
+                    _e.TestRR64(RAX, RAX);
+                    _e.CmovCC64(CC_E, R9, RAX);
+                    _e.AluRR64(OR, RBP, R9);
+                }
+                for (size_t at : clipped)
+                {
+                    _e.Bind(at);
+                }
+                _e.AluRR(XOR, RAX, RAX);
+                _e.TestRR64(RDI, RDI);
+                _e.SetCC(CC_NE, RAX);
+                _e.StoreByte(_off.V + 0xF, RAX);
+                _e.AluMR64(OR, STATE, _off.dirty_rows, RBP);
+                _e.TestRR64(RBP, RBP);
+                _e.SetCC(CC_NE, RAX);
+                _e.AluMR8(OR, _off.draw_flag, RAX);
+                _e.StoreByteI(_off.waiting_for_vblank, Q::DISPLAY_WAIT ? 1 : 0);
+                _e.MovRI(RCX, pc + 2);
+                Exit();
+
+                _e.Bind(wide);
+                if constexpr (Q::XO_CHIP)
+                {
+                    _e.Bind(planes);
+                }
+                CallHandler(in, pc);
+                ExitFromHandler();
+            }
+
+            // Stores TEMP's low byte at I + k. V and I are flushed, so the
+            // slow path can call out and reload them.
+            void EmitStoreByte(uint8_t k)
+            {
+                _e.MovRR(RAX, I_HOST);
+                _e.AluRI(ADD, RAX, k);
+                _e.AluRI(AND, RAX, Q::ADDRESS_MASK);
+                _e.MovRR(RDX, RAX);
+                _e.ShrRI(RDX, PagedMemory::PAGE_SHIFT);
+                _e.LoadQwordScaled(RDX, RDX, _off.memory);
+                // a shared page is copied first and a store into code drops
+                // it, both by StoreByte
+                _e.CmpMI32(RDX, PAGE_REFS, 1);
+                const size_t shared = _e.Jcc(CC_NE);
+                size_t data = 0;
+                if constexpr (Q::XO_CHIP)
+                {
+                    // nothing past RAM is ever translated
+                    _e.AluRI(CMP, RAX, RAM);
+                    data = _e.Jcc(CC_AE);
+                }
+                _e.MovR64I64(RCX, reinterpret_cast<uint64_t>(_hooks.code_bits));
+                _e.BtM64(RCX, RAX);
+                const size_t code = _e.Jcc(CC_B);
+                if constexpr (Q::XO_CHIP)
+                {
+                    _e.Bind(data);
+                }
+                _e.AluRI(AND, RAX, PagedMemory::PAGE_SIZE - 1);
+                _e.StoreByteBaseIndex(RDX, RAX, TEMP);
+                const size_t done = _e.Jmp();
+
+                _e.Bind(shared);
+                _e.Bind(code);
+                _e.MovRR(ARG2, TEMP);
+                _e.MovRR(ARG1, RAX);
+                _e.MovR64R64(ARG0, STATE);
+                _e.MovR64I64(RAX, reinterpret_cast<uint64_t>(_hooks.store));
+                _e.CallR(RAX);
+                Reload();
+                _e.Bind(done);
+            }
+
+            // FX33 and FX55; the digits are worked out with multiplies
+            // (x * 41 >> 12 is x / 100 and x * 205 >> 11 is x / 10 for any byte)
+            void EmitStores(const Instruction& in, uint16_t pc)
+            {
+                Flush();
+                UseI();
+                if (in.NN == 0x33)
+                {
+                    Get(TEMP, in.X);
+                    _e.ImulRRI(TEMP, TEMP, 41);
+                    _e.ShrRI(TEMP, 12);
+                    EmitStoreByte(0);
+                    for (uint8_t k = 1; k <= 2; k++)
+                    {
+                        Get(TEMP, in.X);
+                        if (k == 1)
+                        {
+                            _e.ImulRRI32(TEMP, TEMP, 205);
+                            _e.ShrRI(TEMP, 11);
+                        }
+                        _e.ImulRRI32(RAX, TEMP, 205);
+                        _e.ShrRI(RAX, 11);
+                        _e.ImulRRI(RAX, RAX, 10);
+                        _e.AluRR(SUB, TEMP, RAX);
+                        EmitStoreByte(k);
+                    }
+                }
+                else
+                {
+                    for (uint8_t v = 0; v <= in.X; v++)
+                    {
+                        Get(TEMP, v);
+                        EmitStoreByte(v);
+                    }
+                    if constexpr (Q::MEMORY_INCREMENT)
+                    {
+                        _e.AluRI(ADD, I_HOST, in.X + 1);
+                        _e.AluRI(AND, I_HOST, 0xFFFF);
+                        DirtyI();
+                    }
+                }
+                _e.MovRI(RCX, pc + 2);
+                Exit();
+            }
+
+            bool EmitAlu(const Instruction& in)
+            {
+                switch (in.N)
+                {
+                    case 0x0:
+                        Get(RAX, in.Y);
+                        Set(in.X, RAX);
+                        return true;
+                    case 0x1:
+                    case 0x2:
+                    case 0x3:
+                    {
+                        const Alu alu = (in.N == 0x1) ? OR : (in.N == 0x2) ? AND : XOR;
+                        Get(RAX, in.X);
+                        Get(RCX, in.Y);
+                        _e.AluRR(alu, RAX, RCX);
+                        Set(in.X, RAX);
+                        if constexpr (Q::VF_RESET)
+                        {
+                            _e.MovRI(RAX, 0);
+                            SetVF(RAX);
+                        }
+                        return true;
+                    }
+                    case 0x4:
+                        Get(RAX, in.X);
+                        Get(RCX, in.Y);
+                        _e.AluRR(ADD, RAX, RCX);
+                        _e.MovRR(RDX, RAX);
+                        _e.ShrRI(RDX, 8);
+                        _e.AluRI(AND, RAX, 0xFF);
+                        Set(in.X, RAX);
+                        SetVF(RDX);
+                        return true;
+                    case 0x5:
+                    case 0x7:
+                        // 8XY5: VX = VX - VY, 8XY7: VX = VY - VX; VF = no borrow
+                        Get(RAX, in.N == 0x5 ? in.X : in.Y);
+                        Get(RCX, in.N == 0x5 ? in.Y : in.X);
+                        _e.AluRR(XOR, RDX, RDX);
+                        _e.AluRR(CMP, RAX, RCX);
+                        _e.SetCC(CC_AE, RDX);
+                        _e.AluRR(SUB, RAX, RCX);
+                        _e.AluRI(AND, RAX, 0xFF);
+                        Set(in.X, RAX);
+                        SetVF(RDX);
+                        return true;
+                    case 0x6:
+                        Get(RAX, Q::SHIFT_VY ? in.Y : in.X);
+                        _e.MovRR(RDX, RAX);
+                        _e.AluRI(AND, RDX, 0x1);
+                        _e.ShrRI(RAX, 1);
+                        Set(in.X, RAX);
+                        SetVF(RDX);
+                        return true;
+                    case 0xE:
+                        Get(RAX, Q::SHIFT_VY ? in.Y : in.X);
+                        _e.MovRR(RDX, RAX);
+                        _e.ShrRI(RDX, 7);
+                        _e.ShlRI(RAX, 1);
+                        _e.AluRI(AND, RAX, 0xFF);
+                        Set(in.X, RAX);
+                        SetVF(RDX);
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            bool EmitMisc(const Instruction& in, uint16_t pc)
+            {
+                switch (in.NN)
+                {
+                    case 0x00:
+                        if (Q::XO_CHIP && in.X == 0)
+                        {
+                            // F000 NNNN: the operand is inside the block
+                            _e.MovRI(I_HOST, Word(pc + 2));
+                            DirtyI();
+                            return true;
+                        }
+                        return false;
+                    case 0x07:
+                        _e.LoadByte(RAX, _off.delay);
+                        Set(in.X, RAX);
+                        return true;
+                    case 0x15:
+                        Get(RAX, in.X);
+                        _e.StoreByte(_off.delay, RAX);
+                        return true;
+                    case 0x18:
+                        Get(RAX, in.X);
+                        _e.StoreByte(_off.sound, RAX);
+                        return true;
+                    case 0x1E:
+                        UseI();
+                        Get(RAX, in.X);
+                        _e.AluRR(ADD, I_HOST, RAX);
+                        _e.AluRI(AND, I_HOST, 0xFFFF);
+                        DirtyI();
+                        return true;
+                    case 0x29:
+                        Get(RAX, in.X);
+                        _e.AluRI(AND, RAX, 0x0F);
+                        _e.ImulRRI(I_HOST, RAX, 5);
+                        _e.AluRI(ADD, I_HOST, _off.fontset_start);
+                        _e.AluRI(AND, I_HOST, 0xFFFF);
+                        DirtyI();
+                        return true;
+                    case 0x65:
+                        UseI();
+                        for (uint8_t v = 0; v <= in.X; v++)
+                        {
+                            _e.MovRR(RAX, I_HOST);
+                            _e.AluRI(ADD, RAX, v);
+                            _e.AluRI(AND, RAX, Q::ADDRESS_MASK);
+                            // RDX = page table entry, RAX = offset in the page
+                            _e.MovRR(RDX, RAX);
+                            _e.ShrRI(RDX, PagedMemory::PAGE_SHIFT);
+                            _e.LoadQwordScaled(RDX, RDX, _off.memory);
+                            _e.AluRI(AND, RAX, PagedMemory::PAGE_SIZE - 1);
+                            _e.LoadByteBaseIndex(RAX, RDX, RAX);
+                            Set(v, RAX);
+                        }
+                        if constexpr (Q::MEMORY_INCREMENT)
+                        {
+                            _e.AluRI(ADD, I_HOST, in.X + 1);
+                            _e.AluRI(AND, I_HOST, 0xFFFF);
+                            DirtyI();
+                        }
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+    };
+
+    int32_t OffsetOf(const Chip8& c, const void* member)
+    {
+        return static_cast<int32_t>(reinterpret_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&c));
+    }
+
+    uint8_t* AllocateCode(size_t size)
+    {
+#ifdef _WIN32
+        return static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (p == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(p);
+#endif
+    }
+
+    void FreeCode(uint8_t* code, size_t size)
+    {
+#ifdef _WIN32
+        VirtualFree(code, 0, MEM_RELEASE);
+#else
+        munmap(code, size);
+#endif
+    }
+
+    // the buffer is only ever writable or executable, never both
+    bool SetWritable(uint8_t* code, size_t size, bool writable)
+    {
+#ifdef _WIN32
+        DWORD old;
+        const bool ok = VirtualProtect(code, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old) != 0;
+        if (ok && !writable)
+        {
+            FlushInstructionCache(GetCurrentProcess(), code, size);
+        }
+        return ok;
+#else
+        return mprotect(code, size, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) == 0;
+#endif
+    }
+}
+
+bool JitX64::Supported()
+{
+    return true;
+}
+
+JitX64::JitX64(size_t capacity)
+    : _capacity(capacity)
+{
+    _code = AllocateCode(_capacity);
+    if (_code == nullptr)
+    {
+        logger::Error("JIT: failed to allocate {} bytes of code memory", _capacity);
+        _capacity = 0;
+        return;
+    }
+    SetWritable(_code, _capacity, false);
+
+    Emitter prologue;
+    Prologue(prologue);
+    _body_offset = prologue.code.size();
+}
+
+JitX64::~JitX64()
+{
+    if (_code != nullptr)
+    {
+        FreeCode(_code, _capacity);
+    }
+}
+
+JitX64::BlockFn JitX64::Compile(Chip8& c, const BlockCache::Block& block)
+{
+    if (_code == nullptr)
+    {
+        return nullptr;
+    }
+
+    const Offsets off
+    {
+        OffsetOf(c, c._V),
+        OffsetOf(c, &c._I),
+        OffsetOf(c, &c._pc),
+        OffsetOf(c, &c._delay_timer),
+        OffsetOf(c, &c._sound_timer),
+        OffsetOf(c, c._key),
+        OffsetOf(c, c._memory.PageTable()),
+        static_cast<int32_t>(c._fontset_start),
+        OffsetOf(c, c._stack),
+        c.StackSize(),
+        OffsetOf(c, &c._sp),
+        OffsetOf(c, c._rng.s),
+        OffsetOf(c, c._gfx),
+        OffsetOf(c, &c._dirty_rows),
+        OffsetOf(c, &c._draw_flag),
+        OffsetOf(c, &c._hires),
+        OffsetOf(c, &c._planes),
+        OffsetOf(c, &c._waiting_for_vblank),
+        OffsetOf(c, &c._waiting_for_key)
+    };
+    const Hooks hooks
+    {
+        &JitX64::Store,
+        c._blocks.Links(),
+        c._blocks.CodeBits()
+    };
+
+    const std::vector<uint8_t> code = quirks::Dispatch(c._quirks, [&]<typename Q>()
+    {
+        return BlockCompiler<Q>(off, hooks, c._memory).Compile(block);
+    });
+    if (_used + code.size() > _capacity)
+    {
+        return nullptr;
+    }
+
+    if (!SetWritable(_code, _capacity, true))
+    {
+        return nullptr;
+    }
+    uint8_t* entry = _code + _used;
+    std::memcpy(entry, code.data(), code.size());
+    _used += (code.size() + 15) & ~size_t{15};
+    SetWritable(_code, _capacity, false);
+
+    return reinterpret_cast<BlockFn>(entry);
+}
+
+void JitX64::Reset()
+{
+    _used = 0;
+}
+
+const void* JitX64::Body(BlockFn fn) const
+{
+    return reinterpret_cast<const uint8_t*>(fn) + _body_offset;
+}
+
+#else
+
+bool JitX64::Supported()
+{
+    return false;
+}
+
+JitX64::JitX64(size_t)
+{
+}
+
+JitX64::~JitX64()
+{
+}
+
+JitX64::BlockFn JitX64::Compile(Chip8&, const BlockCache::Block&)
+{
+    return nullptr;
+}
+
+void JitX64::Reset()
+{
+}
+
+const void* JitX64::Body(BlockFn) const
+{
+    return nullptr;
+}
+
+#endif
+
+size_t JitX64::Used() const
+{
+    return _used;
+}
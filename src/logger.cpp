@@ -0,0 +1,349 @@
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define CHIP8_LOG_NO_THREADS
+#else
+#include <thread>
+#endif
+
+namespace
+{
+    /*
+        Rate limiting. Call sites hash into a fixed table by the address of
+        their format string; two sites sharing a slot share its budget. The
+        counters are relaxed atomics: under contention a window may let a
+        message or two more through, which is fine for a limit.
+    */
+    constexpr size_t SITES = 128;
+
+    struct Site
+    {
+        std::atomic<int64_t> window{-1};        // second the counts belong to
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> suppressed{0};
+        std::atomic<const char*> text{nullptr}; // format string of the last suppressed message
+        std::atomic<size_t> size{0};
+        std::atomic<logger::LogLevel> level{logger::LogLevel::Warn};
+    };
+
+    Site g_sites[SITES];
+
+    void ReportSuppressed(Site& slot, logger::LogLevel lvl, std::string_view site)
+    {
+        const uint32_t suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed != 0)
+        {
+            logger::Write(lvl, fmt::format("{} more messages like \"{}\" were suppressed", suppressed, site));
+        }
+    }
+
+    // Counts that no later message got to report, at the end of the program
+    void ReportAllSuppressed()
+    {
+        for (Site& slot : g_sites)
+        {
+            const char* text = slot.text.load(std::memory_order_relaxed);
+            if (text != nullptr)
+            {
+                ReportSuppressed(slot, slot.level.load(std::memory_order_relaxed),
+                    std::string_view(text, slot.size.load(std::memory_order_relaxed)));
+            }
+        }
+    }
+
+    void WriteNow(logger::LogLevel lvl, std::string_view text)
+    {
+        const bool line = lvl != logger::LogLevel::Default;
+        fmt::print(stderr, "{}{}{}", logger::prefix(lvl), text, line ? "\n" : "");
+    }
+
+#ifndef CHIP8_LOG_NO_THREADS
+    /*
+        Bounded multi-producer queue (Vyukov): each slot carries a sequence
+        number that says whether it is free for the producer at position pos
+        (seq == pos) or holds that producer's record (seq == pos + 1).
+        Producers claim a position with one CAS; the writer thread is the only
+        consumer.
+    */
+    struct Record
+    {
+        std::atomic<size_t> seq{0};
+        logger::LogLevel level = logger::LogLevel::Default;
+        uint16_t length = 0;
+        char text[logger::RECORD_TEXT];
+    };
+
+    class AsyncSink
+    {
+        public:
+            bool Start(size_t capacity)
+            {
+                if (_thread.joinable())
+                {
+                    return true;
+                }
+
+                size_t size = 16;
+                while (size < capacity)
+                {
+                    size *= 2;
+                }
+                _ring = std::make_unique<Record[]>(size);
+                _mask = size - 1;
+                for (size_t i = 0; i < size; i++)
+                {
+                    _ring[i].seq.store(i, std::memory_order_relaxed);
+                }
+                _head.store(0, std::memory_order_relaxed);
+                _tail = 0;
+                _running.store(true, std::memory_order_release);
+                _thread = std::thread([this] { Loop(); });
+                return true;
+            }
+
+            void Stop()
+            {
+                if (!_thread.joinable())
+                {
+                    return;
+                }
+                _running.store(false, std::memory_order_release);
+                _pending.fetch_add(1, std::memory_order_release);
+                _pending.notify_one();
+                _thread.join();
+            }
+
+            void Push(logger::LogLevel lvl, std::string_view text)
+            {
+                size_t pos = _head.load(std::memory_order_relaxed);
+                Record* record;
+                for (;;)
+                {
+                    record = &_ring[pos & _mask];
+                    const size_t seq = record->seq.load(std::memory_order_acquire);
+                    const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                    if (diff == 0)
+                    {
+                        if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if (diff < 0)
+                    {
+                        // full: the writer is behind, drop rather than wait
+                        _dropped.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    else
+                    {
+                        pos = _head.load(std::memory_order_relaxed);
+                    }
+                }
+
+                const size_t length = std::min(text.size(), logger::RECORD_TEXT);
+                std::memcpy(record->text, text.data(), length);
+                if (length < text.size())
+                {
+                    std::memcpy(record->text + length - 3, "...", 3);
+                }
+                record->level = lvl;
+                record->length = static_cast<uint16_t>(length);
+                record->seq.store(pos + 1, std::memory_order_release);
+
+                _pending.fetch_add(1, std::memory_order_release);
+                _pending.notify_one();
+            }
+
+        private:
+            void Loop()
+            {
+                for (;;)
+                {
+                    const uint32_t seen = _pending.load(std::memory_order_acquire);
+                    Drain();
+                    if (!_running.load(std::memory_order_acquire))
+                    {
+                        Drain();
+                        EndRepeats();
+                        Flush();
+                        return;
+                    }
+                    Flush();
+                    _pending.wait(seen, std::memory_order_acquire);
+                }
+            }
+
+            void Drain()
+            {
+                for (;;)
+                {
+                    Record& record = _ring[_tail & _mask];
+                    if (record.seq.load(std::memory_order_acquire) != _tail + 1)
+                    {
+                        break;
+                    }
+                    Emit(record.level, std::string_view(record.text, record.length));
+                    record.seq.store(_tail + _mask + 1, std::memory_order_release);
+                    _tail++;
+                }
+
+                const uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+                if (dropped != 0)
+                {
+                    EndRepeats();
+                    Append(logger::LogLevel::Warn, fmt::format("{} log messages dropped, the log queue was full", dropped));
+                }
+            }
+
+            // Runs of the same leveled message become one line and a count
+            void Emit(logger::LogLevel lvl, std::string_view text)
+            {
+                if (lvl != logger::LogLevel::Default && lvl == _last_level && text == _last)
+                {
+                    _repeats++;
+                    return;
+                }
+                EndRepeats();
+                if (lvl != logger::LogLevel::Default)
+                {
+                    _last_level = lvl;
+                    _last.assign(text);
+                }
+                Append(lvl, text);
+            }
+
+            void EndRepeats()
+            {
+                if (_repeats != 0)
+                {
+                    Append(_last_level, fmt::format("(previous message repeated {} times)", _repeats));
+                    _repeats = 0;
+                }
+                _last_level = logger::LogLevel::Default;
+                _last.clear();
+            }
+
+            void Append(logger::LogLevel lvl, std::string_view text)
+            {
+                _out += logger::prefix(lvl);
+                _out += text;
+                if (lvl != logger::LogLevel::Default)
+                {
+                    _out += '\n';
+                }
+            }
+
+            void Flush()
+            {
+                if (!_out.empty())
+                {
+                    fwrite(_out.data(), 1, _out.size(), stderr);
+                    fflush(stderr);
+                    _out.clear();
+                }
+            }
+
+            std::unique_ptr<Record[]> _ring;
+            size_t _mask = 0;
+            std::atomic<size_t> _head{0};
+            size_t _tail = 0;                       // writer thread only
+            std::atomic<uint32_t> _pending{0};      // bumped on every push, waited on by the writer
+            std::atomic<uint64_t> _dropped{0};
+            std::atomic<bool> _running{false};
+            std::thread _thread;
+
+            // writer thread only
+            std::string _out;
+            std::string _last;
+            logger::LogLevel _last_level = logger::LogLevel::Default;
+            uint64_t _repeats = 0;
+    };
+
+    AsyncSink g_sink;
+    std::atomic<AsyncSink*> g_async{nullptr};
+#endif
+
+    // Destroyed before g_sink: reports what was suppressed, writes out what
+    // is queued and sends anything logged later straight to stderr
+    struct StopAtExit
+    {
+        ~StopAtExit()
+        {
+            logger::StopAsync();
+        }
+    } g_stop_at_exit;
+}
+
+bool logger::Admit(LogLevel lvl, std::string_view site)
+{
+    const uintptr_t key = reinterpret_cast<uintptr_t>(site.data());
+    Site& slot = g_sites[(key * 0x9E3779B97F4A7C15ull >> 32) % SITES];
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = slot.window.load(std::memory_order_relaxed);
+    if (window != now && slot.window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+    {
+        slot.count.store(0, std::memory_order_relaxed);
+        ReportSuppressed(slot, lvl, site);
+    }
+
+    if (slot.count.fetch_add(1, std::memory_order_relaxed) < RATE_LIMIT)
+    {
+        return true;
+    }
+    slot.text.store(site.data(), std::memory_order_relaxed);
+    slot.size.store(site.size(), std::memory_order_relaxed);
+    slot.level.store(lvl, std::memory_order_relaxed);
+    slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void logger::Write(LogLevel lvl, std::string_view text)
+{
+#ifndef CHIP8_LOG_NO_THREADS
+    if (AsyncSink* sink = g_async.load(std::memory_order_acquire))
+    {
+        sink->Push(lvl, text);
+        return;
+    }
+#endif
+    WriteNow(lvl, text);
+}
+
+// Messages logged while StopAsync runs may be lost, so stop the threads
+// that log before calling it
+bool logger::StartAsync(size_t capacity)
+{
+#ifdef CHIP8_LOG_NO_THREADS
+    (void)capacity;
+    return false;
+#else
+    if (g_async.load(std::memory_order_acquire) != nullptr)
+    {
+        return true;
+    }
+    g_sink.Start(capacity);
+    g_async.store(&g_sink, std::memory_order_release);
+    return true;
+#endif
+}
+
+void logger::StopAsync()
+{
+    ReportAllSuppressed();
+#ifndef CHIP8_LOG_NO_THREADS
+    if (g_async.exchange(nullptr, std::memory_order_acq_rel) != nullptr)
+    {
+        g_sink.Stop();
+    }
+#endif
+}
@@ -1,5 +1,6 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
+#include <string_view>
 #include "emulator.hpp"
 #include "logger.hpp"
 
@@ -10,18 +11,36 @@
 int main(int argc, char* argv[])
 {
     static Emulator emulator;
+    logger::StartAsync();
 
 #ifdef __EMSCRIPTEN__
     SetActiveEmulator(&emulator);
     const char* rom_path = "roms/1-chip8-logo.ch8";
 #else
-    if (argc != 2)
+    if (argc < 2)
     {
-        logger::Error("Usage: Chip8 <rom-file>");
+        logger::Error("Usage: Chip8 <rom-file> [--record <movie-file>] [--audio-clock]");
         return 1;
     }
 
     const char* rom_path = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--record" && i + 1 < argc)
+        {
+            emulator.RecordMovie(argv[++i]);
+        }
+        else if (arg == "--audio-clock")
+        {
+            emulator.UseAudioClock(true);
+        }
+        else
+        {
+            logger::Error("Usage: Chip8 <rom-file> [--record <movie-file>] [--audio-clock]");
+            return 1;
+        }
+    }
 #endif
 
     if (!emulator.Setup(rom_path))
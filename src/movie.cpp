@@ -0,0 +1,298 @@
+#include "movie.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "framebuffer.hpp"
+#include "logger.hpp"
+#include "save_state.hpp"
+
+static_assert(sizeof(MovieEvent) == 16, "movie events are written as raw bytes");
+
+namespace
+{
+    struct FileHeader
+    {
+        static constexpr uint32_t MAGIC = 0x564D3843;   // "C8MV"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint64_t rom_hash = 0;
+        uint64_t seed = 0;
+        uint32_t clock_hz = 0;
+        uint32_t crc = 0;                   // CRC-32 of the events and frame hashes
+        uint64_t frames = 0;
+        uint64_t event_count = 0;
+        uint64_t hash_count = 0;
+    };
+
+    std::vector<uint8_t> Body(const Movie& movie)
+    {
+        const size_t event_bytes = movie.events.size() * sizeof(MovieEvent);
+        const size_t hash_bytes = movie.frame_hashes.size() * sizeof(uint64_t);
+        std::vector<uint8_t> body(event_bytes + hash_bytes);
+        if (event_bytes != 0)
+        {
+            std::memcpy(body.data(), movie.events.data(), event_bytes);
+        }
+        if (hash_bytes != 0)
+        {
+            std::memcpy(body.data() + event_bytes, movie.frame_hashes.data(), hash_bytes);
+        }
+        return body;
+    }
+}
+
+// FNV-1a over the file's bytes
+bool movie::HashFile(const std::string& path, uint64_t& hash)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open file for hashing: {}", path);
+        return false;
+    }
+
+    hash = 14695981039346656037ull;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) != 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    const bool ok = ferror(file) == 0;
+    fclose(file);
+    if (!ok)
+    {
+        logger::Error("Failed to read file for hashing: {}", path);
+    }
+    return ok;
+}
+
+bool movie::WriteFile(const std::string& path, const Movie& movie)
+{
+    const std::vector<uint8_t> body = Body(movie);
+
+    FileHeader header;
+    header.rom_hash = movie.rom_hash;
+    header.seed = movie.seed;
+    header.clock_hz = movie.clock_hz;
+    header.crc = savestate::Crc32(body.data(), body.size());
+    header.frames = movie.frames;
+    header.event_count = movie.events.size();
+    header.hash_count = movie.frame_hashes.size();
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open movie for writing: {}", path);
+        return false;
+    }
+
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                 && (body.empty() || fwrite(body.data(), body.size(), 1, file) == 1);
+    if (fclose(file) != 0 || !ok)
+    {
+        logger::Error("Failed to write movie: {}", path);
+        return false;
+    }
+    return true;
+}
+
+bool movie::ReadFile(const std::string& path, Movie& movie)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open movie: {}", path);
+        return false;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    const long file_size = ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    FileHeader header;
+    const bool read_header = fread(&header, sizeof(header), 1, file) == 1;
+    const bool matches = read_header
+                      && header.magic == FileHeader::MAGIC
+                      && header.version == FileHeader::VERSION;
+    if (!matches)
+    {
+        fclose(file);
+        logger::Error("Not a version {} movie: {}", FileHeader::VERSION, path);
+        return false;
+    }
+
+    // Counts are checked against the file size before anything is allocated
+    const uint64_t body_size = static_cast<uint64_t>(file_size) - sizeof(header);
+    const bool sized = header.event_count <= body_size / sizeof(MovieEvent)
+                    && header.hash_count <= body_size / sizeof(uint64_t)
+                    && header.event_count * sizeof(MovieEvent) + header.hash_count * sizeof(uint64_t) == body_size;
+    std::vector<uint8_t> body;
+    if (sized)
+    {
+        body.resize(static_cast<size_t>(body_size));
+    }
+    const bool read_body = sized && (body.empty() || fread(body.data(), body.size(), 1, file) == 1);
+    fclose(file);
+
+    if (!read_body)
+    {
+        logger::Error("Movie is truncated: {}", path);
+        return false;
+    }
+    if (savestate::Crc32(body.data(), body.size()) != header.crc)
+    {
+        logger::Error("Movie checksum mismatch: {}", path);
+        return false;
+    }
+
+    Movie loaded;
+    loaded.rom_hash = header.rom_hash;
+    loaded.seed = header.seed;
+    loaded.clock_hz = header.clock_hz;
+    loaded.frames = header.frames;
+    loaded.events.resize(static_cast<size_t>(header.event_count));
+    loaded.frame_hashes.resize(static_cast<size_t>(header.hash_count));
+    const size_t event_bytes = loaded.events.size() * sizeof(MovieEvent);
+    if (event_bytes != 0)
+    {
+        std::memcpy(loaded.events.data(), body.data(), event_bytes);
+    }
+    if (!loaded.frame_hashes.empty())
+    {
+        std::memcpy(loaded.frame_hashes.data(), body.data() + event_bytes, loaded.frame_hashes.size() * sizeof(uint64_t));
+    }
+
+    const bool ordered = std::is_sorted(loaded.events.begin(), loaded.events.end(),
+        [](const MovieEvent& a, const MovieEvent& b) { return a.cycle < b.cycle; });
+    const bool keys = std::all_of(loaded.events.begin(), loaded.events.end(),
+        [](const MovieEvent& ev) { return ev.key <= 0xF; });
+    if (!ordered || !keys || loaded.clock_hz < Chip8::FRAME_HZ)
+    {
+        logger::Error("Corrupt movie: {}", path);
+        return false;
+    }
+
+    movie = std::move(loaded);
+    return true;
+}
+
+/*
+    Runs frame by frame. The events that fall inside a frame are queued on
+    the Chip8 before it runs, which applies each one on exactly the cycle it
+    was recorded on, the same way the frontend applies live input.
+*/
+PlaybackResult movie::Play(Chip8& chip8, const Movie& movie, bool verify)
+{
+    chip8.SetSeed(movie.seed);
+    chip8.SetClockRate(movie.clock_hz);
+
+    PlaybackResult result;
+    size_t next = 0;
+    while (chip8.GetFrames() < movie.frames)
+    {
+        for (; next < movie.events.size() && movie.events[next].cycle < chip8.GetNextVBlank(); next++)
+        {
+            const MovieEvent& ev = movie.events[next];
+            chip8.QueueKey(ev.cycle, ev.key, ev.down != 0);
+        }
+
+        result.executed += chip8.RunFrame().executed;
+
+        const uint64_t frame = chip8.GetFrames() - 1;
+        if (verify && frame < movie.frame_hashes.size())
+        {
+            const uint64_t hash = chip8.GetGfxHash();
+            if (hash != movie.frame_hashes[frame])
+            {
+                result.divergent_frame = frame;
+                result.expected_hash = movie.frame_hashes[frame];
+                result.actual_hash = hash;
+                break;
+            }
+        }
+    }
+    result.frames = chip8.GetFrames();
+    return result;
+}
+
+void MovieRecorder::Start(Chip8& chip8, uint64_t rom_hash, bool frame_hashes)
+{
+    _movie = Movie{};
+    _movie.rom_hash = rom_hash;
+    _movie.seed = chip8.GetSeed();
+    _movie.clock_hz = chip8.GetClockRate();
+    _frame_hashes = frame_hashes;
+    _recording = true;
+}
+
+void MovieRecorder::Stop()
+{
+    _recording = false;
+}
+
+bool MovieRecorder::Recording() const
+{
+    return _recording;
+}
+
+void MovieRecorder::OnKey(uint64_t cycle, uint8_t key, bool down)
+{
+    if (!_recording)
+    {
+        return;
+    }
+
+    MovieEvent ev;
+    ev.cycle = cycle;
+    ev.key = key & 0xF;
+    ev.down = down ? 1 : 0;
+    _movie.events.push_back(ev);
+}
+
+void MovieRecorder::OnFrame(Chip8& chip8)
+{
+    if (!_recording)
+    {
+        return;
+    }
+
+    _movie.frames = chip8.GetFrames();
+    if (_frame_hashes && _movie.frames != 0)
+    {
+        _movie.frame_hashes.resize(static_cast<size_t>(_movie.frames - 1));
+        _movie.frame_hashes.push_back(chip8.GetGfxHash());
+    }
+}
+
+void MovieRecorder::Rewind(Chip8& chip8)
+{
+    if (!_recording)
+    {
+        return;
+    }
+
+    // A state restored at cycle C was captured before the events applied
+    // on C, so those are dropped as well
+    const uint64_t cycle = chip8.GetCycles();
+    while (!_movie.events.empty() && _movie.events.back().cycle >= cycle)
+    {
+        _movie.events.pop_back();
+    }
+    _movie.frames = std::min(_movie.frames, chip8.GetFrames());
+    if (_movie.frame_hashes.size() > _movie.frames)
+    {
+        _movie.frame_hashes.resize(static_cast<size_t>(_movie.frames));
+    }
+}
+
+const Movie& MovieRecorder::GetMovie() const
+{
+    return _movie;
+}
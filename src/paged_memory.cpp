@@ -0,0 +1,92 @@
+#include "paged_memory.hpp"
+#include <algorithm>
+#include <cstring>
+
+static_assert(offsetof(PagedMemory::Page, bytes) == 0, "the JIT treats a Page* as a pointer to its bytes");
+
+namespace
+{
+    // Shared by every page that is all zeros. Its count starts at 2 and is
+    // never changed, so it always looks shared and is never freed.
+    PagedMemory::Page ZERO_PAGE{{}, 2};
+}
+
+PagedMemory::PagedMemory()
+{
+    std::fill(std::begin(_pages), std::end(_pages), &ZERO_PAGE);
+}
+
+PagedMemory::PagedMemory(const PagedMemory& other)
+{
+    for (size_t i = 0; i < PAGES; i++)
+    {
+        _pages[i] = other._pages[i];
+        Retain(_pages[i]);
+    }
+}
+
+PagedMemory& PagedMemory::operator=(const PagedMemory& other)
+{
+    for (size_t i = 0; i < PAGES; i++)
+    {
+        if (_pages[i] != other._pages[i])
+        {
+            Retain(other._pages[i]);
+            Release(_pages[i]);
+            _pages[i] = other._pages[i];
+        }
+    }
+    return *this;
+}
+
+PagedMemory::~PagedMemory()
+{
+    for (Page* page : _pages)
+    {
+        Release(page);
+    }
+}
+
+void PagedMemory::Clear()
+{
+    for (Page*& page : _pages)
+    {
+        Release(page);
+        page = &ZERO_PAGE;
+    }
+}
+
+void PagedMemory::CopyTo(uint8_t* out, size_t pages) const
+{
+    for (size_t i = 0; i < pages; i++)
+    {
+        std::memcpy(out + i * PAGE_SIZE, _pages[i]->bytes, PAGE_SIZE);
+    }
+}
+
+// Gives this copy its own page before a write
+PagedMemory::Page* PagedMemory::Unshare(size_t page)
+{
+    Page* copy = new Page;
+    std::memcpy(copy->bytes, _pages[page]->bytes, PAGE_SIZE);
+    copy->refs.store(1, std::memory_order_relaxed);
+    Release(_pages[page]);
+    _pages[page] = copy;
+    return copy;
+}
+
+void PagedMemory::Retain(Page* page)
+{
+    if (page != &ZERO_PAGE)
+    {
+        page->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void PagedMemory::Release(Page* page)
+{
+    if (page != &ZERO_PAGE && page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete page;
+    }
+}
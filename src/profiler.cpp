@@ -0,0 +1,219 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <utility>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+
+namespace
+{
+    constexpr const char* CLASS_NAMES[Profiler::CLASSES] =
+    {
+        "00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+        "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+        "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1",
+        "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+        "00CN", "00FB", "00FC", "00FD", "00FE", "00FF", "FX30", "FX75", "FX85",
+        "00DN", "5XY2", "5XY3", "F000", "FN01", "F002", "FX3A",
+        "unknown"
+    };
+
+    bool WriteText(const std::string& path, const std::string& text)
+    {
+        std::ofstream file(path);
+        if (!(file << text))
+        {
+            logger::Error("Failed to write profile: {}", path);
+            return false;
+        }
+        return true;
+    }
+}
+
+Profiler::Profiler()
+{
+    Clear();
+}
+
+void Profiler::Clear()
+{
+    _by_pc.assign(ADDRESSES, 0);
+    std::fill(std::begin(_by_class), std::end(_by_class), 0);
+    _nodes.assign(1, Node{0, rom_start, 0});
+    _children.clear();
+    _node = 0;
+}
+
+void Profiler::Call(uint16_t target)
+{
+    const Node& node = _nodes[_node];
+    if (node.depth >= MAX_DEPTH)
+    {
+        return;
+    }
+
+    const uint64_t key = (static_cast<uint64_t>(_node) << 16) | target;
+    const auto it = _children.find(key);
+    if (it != _children.end())
+    {
+        _node = it->second;
+        return;
+    }
+    if (_nodes.size() >= MAX_NODES)
+    {
+        return;
+    }
+
+    const uint32_t child = static_cast<uint32_t>(_nodes.size());
+    _nodes.push_back(Node{_node, target, static_cast<uint16_t>(node.depth + 1)});
+    _children.emplace(key, child);
+    _node = child;
+}
+
+void Profiler::Return()
+{
+    // the root has no caller: a ROM returning from there only underflows
+    _node = _nodes[_node].parent;
+}
+
+uint64_t Profiler::Instructions() const
+{
+    uint64_t total = 0;
+    for (const uint64_t n : _by_class)
+    {
+        total += n;
+    }
+    return total;
+}
+
+uint64_t Profiler::ClassCount(int op_class) const
+{
+    return (op_class >= 0 && op_class < CLASSES) ? _by_class[op_class] : 0;
+}
+
+uint64_t Profiler::PcCount(uint16_t pc) const
+{
+    return _by_pc[pc & (ADDRESSES - 1)];
+}
+
+const char* Profiler::ClassName(int op_class)
+{
+    return (op_class >= 0 && op_class < CLASSES) ? CLASS_NAMES[op_class] : "";
+}
+
+std::string Profiler::StackName(uint32_t node) const
+{
+    std::vector<uint16_t> entries;
+    for (uint32_t n = node;; n = _nodes[n].parent)
+    {
+        entries.push_back(_nodes[n].entry);
+        if (n == 0)
+        {
+            break;
+        }
+    }
+
+    std::string name;
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+        name += fmt::format("{}sub_{:04X}", name.empty() ? "" : ";", *it);
+    }
+    return name;
+}
+
+std::string Profiler::Json() const
+{
+    uint64_t display_wait = 0;
+    uint64_t key_wait = 0;
+    for (const Node& node : _nodes)
+    {
+        display_wait += node.display_wait;
+        key_wait += node.key_wait;
+    }
+
+    std::vector<std::pair<uint64_t, int>> classes;
+    for (int c = 0; c < CLASSES; c++)
+    {
+        if (_by_class[c] != 0)
+        {
+            classes.emplace_back(_by_class[c], c);
+        }
+    }
+    std::sort(classes.begin(), classes.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<std::pair<uint64_t, int>> pcs;
+    for (int pc = 0; pc < ADDRESSES; pc++)
+    {
+        if (_by_pc[pc] != 0)
+        {
+            pcs.emplace_back(_by_pc[pc], pc);
+        }
+    }
+    std::sort(pcs.begin(), pcs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::string out = "{\n";
+    out += fmt::format("  \"instructions\": {},\n", Instructions());
+    out += fmt::format("  \"blocked_cycles\": {{\"display_wait\": {}, \"key_wait\": {}}},\n", display_wait, key_wait);
+
+    out += "  \"opcodes\": [\n";
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        out += fmt::format("    {{\"opcode\": \"{}\", \"count\": {}}}{}\n",
+            CLASS_NAMES[classes[i].second], classes[i].first, (i + 1 < classes.size()) ? "," : "");
+    }
+    out += "  ],\n";
+
+    out += "  \"pcs\": [\n";
+    for (size_t i = 0; i < pcs.size(); i++)
+    {
+        out += fmt::format("    {{\"pc\": \"0x{:03X}\", \"count\": {}}}{}\n",
+            pcs[i].second, pcs[i].first, (i + 1 < pcs.size()) ? "," : "");
+    }
+    out += "  ],\n";
+
+    out += "  \"stacks\": [\n";
+    bool first = true;
+    for (uint32_t n = 0; n < _nodes.size(); n++)
+    {
+        const Node& node = _nodes[n];
+        out += fmt::format("{}    {{\"stack\": \"{}\", \"instructions\": {}, \"display_wait\": {}, \"key_wait\": {}}}",
+            first ? "" : ",\n", StackName(n), node.instructions, node.display_wait, node.key_wait);
+        first = false;
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+std::string Profiler::Folded() const
+{
+    std::string out;
+    for (uint32_t n = 0; n < _nodes.size(); n++)
+    {
+        const Node& node = _nodes[n];
+        const std::string stack = StackName(n);
+        if (node.instructions != 0)
+        {
+            out += fmt::format("{} {}\n", stack, node.instructions);
+        }
+        if (node.display_wait != 0)
+        {
+            out += fmt::format("{};[display wait] {}\n", stack, node.display_wait);
+        }
+        if (node.key_wait != 0)
+        {
+            out += fmt::format("{};[key wait] {}\n", stack, node.key_wait);
+        }
+    }
+    return out;
+}
+
+bool Profiler::WriteJson(const std::string& path) const
+{
+    return WriteText(path, Json());
+}
+
+bool Profiler::WriteFolded(const std::string& path) const
+{
+    return WriteText(path, Folded());
+}
@@ -0,0 +1,282 @@
+#include "rewind.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // A literal run ends at this many zero bytes in a row; shorter gaps are
+    // cheaper to copy than to encode as a new run
+    constexpr size_t MIN_ZERO_RUN = 4;
+
+    void PutVarint(std::vector<uint8_t>& out, size_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    size_t GetVarint(const uint8_t*& in, const uint8_t* end)
+    {
+        size_t value = 0;
+        for (int shift = 0; in != end; shift += 7)
+        {
+            const uint8_t byte = *in++;
+            value |= static_cast<size_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        return value;
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t capacity, uint32_t keyframe_interval)
+    : _ring(capacity)
+    , _keyframe_interval(std::max<uint32_t>(keyframe_interval, 1))
+{
+    // Worst case: every byte is a literal, plus a token pair per run
+    _scratch.reserve(sizeof(Chip8State) + sizeof(Chip8State) / MIN_ZERO_RUN * 4);
+}
+
+/*
+    Encodes data ^ base (data alone when base is null) as a sequence of
+    <zero count> <literal count> <literal bytes> runs, counts as LEB128
+    varints. Trailing zeros are implied by the end of the stream.
+*/
+void RewindBuffer::Encode(const uint8_t* data, const uint8_t* base, size_t size, std::vector<uint8_t>& out)
+{
+    const auto x = [&](size_t i) -> uint8_t
+    {
+        return base != nullptr ? data[i] ^ base[i] : data[i];
+    };
+    const auto x64 = [&](size_t i) -> uint64_t
+    {
+        uint64_t a, b = 0;
+        std::memcpy(&a, data + i, 8);
+        if (base != nullptr)
+        {
+            std::memcpy(&b, base + i, 8);
+        }
+        return a ^ b;
+    };
+
+    out.clear();
+    size_t i = 0;
+    while (i < size)
+    {
+        const size_t zero_start = i;
+        while (i + 8 <= size && x64(i) == 0)
+        {
+            i += 8;
+        }
+        while (i < size && x(i) == 0)
+        {
+            i++;
+        }
+        if (i == size)
+        {
+            break;
+        }
+
+        const size_t literal_start = i;
+        size_t literal_end = i;
+        for (size_t j = i; j < size; j++)
+        {
+            if (x(j) != 0)
+            {
+                literal_end = j + 1;
+            }
+            else if (j + 1 - literal_end >= MIN_ZERO_RUN)
+            {
+                break;
+            }
+        }
+
+        PutVarint(out, literal_start - zero_start);
+        PutVarint(out, literal_end - literal_start);
+        for (size_t k = literal_start; k < literal_end; k++)
+        {
+            out.push_back(x(k));
+        }
+        i = literal_end;
+    }
+}
+
+// XORs an encoded stream into data
+void RewindBuffer::Decode(const uint8_t* in, size_t in_size, uint8_t* data, size_t size)
+{
+    const uint8_t* end = in + in_size;
+    size_t pos = 0;
+    while (in < end)
+    {
+        pos += GetVarint(in, end);
+        const size_t count = GetVarint(in, end);
+        if (pos + count > size || count > static_cast<size_t>(end - in))
+        {
+            return;
+        }
+        for (size_t k = 0; k < count; k++)
+        {
+            data[pos + k] ^= in[k];
+        }
+        in += count;
+        pos += count;
+    }
+}
+
+void RewindBuffer::Push(const Chip8State& state)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+    const size_t size = state.Size();
+
+    // a profile change resizes the state, and a delta needs a keyframe of its size
+    if (_key_valid && _since_keyframe + 1 < _keyframe_interval && _key.Size() == size)
+    {
+        Encode(bytes, reinterpret_cast<const uint8_t*>(&_key), size, _scratch);
+        if (Store(_scratch, size, false))
+        {
+            _since_keyframe++;
+            return;
+        }
+        // Making room evicted the keyframe this delta was taken against
+    }
+
+    Encode(bytes, nullptr, size, _scratch);
+    if (Store(_scratch, size, true))
+    {
+        std::memcpy(&_key, &state, size);
+        _key_valid = true;
+        _since_keyframe = 0;
+    }
+}
+
+bool RewindBuffer::Pop(Chip8State& out)
+{
+    if (_entries.empty())
+    {
+        return false;
+    }
+
+    const Entry entry = _entries.back();
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&out);
+    if (entry.keyframe)
+    {
+        std::memset(bytes, 0, entry.state_size);
+        _key_valid = false;
+        _since_keyframe = 0;
+    }
+    else
+    {
+        if (!_key_valid && !LoadNewestKeyframe())
+        {
+            return false;
+        }
+        std::memcpy(bytes, &_key, entry.state_size);
+        _since_keyframe--;
+    }
+    Decode(_ring.data() + entry.offset, entry.size, bytes, entry.state_size);
+
+    _entries.pop_back();
+    _used -= entry.size;
+    _head = _entries.empty() ? 0 : _entries.back().offset + _entries.back().size;
+    return true;
+}
+
+void RewindBuffer::Clear()
+{
+    _entries.clear();
+    _head = 0;
+    _used = 0;
+    _since_keyframe = 0;
+    _key_valid = false;
+}
+
+size_t RewindBuffer::Frames() const
+{
+    return _entries.size();
+}
+
+size_t RewindBuffer::BytesUsed() const
+{
+    return _used;
+}
+
+/*
+    Entries are laid out in ring order: everything at or past _head is left
+    over from the previous lap and older than everything before it. A record
+    that does not fit before the end of the ring starts over at offset 0,
+    dropping the previous lap's tail.
+
+    Returns false when the record cannot be stored: it is larger than the
+    ring, or it is a delta and making room evicted its keyframe.
+*/
+bool RewindBuffer::Store(const std::vector<uint8_t>& bytes, size_t state_size, bool keyframe)
+{
+    const size_t size = bytes.size();
+    if (size > _ring.size())
+    {
+        return false;
+    }
+
+    if (_head + size > _ring.size())
+    {
+        while (!_entries.empty() && _entries.front().offset >= _head)
+        {
+            EvictFront();
+        }
+        _head = 0;
+    }
+    while (!_entries.empty() && _entries.front().offset >= _head && _entries.front().offset < _head + size)
+    {
+        EvictFront();
+    }
+
+    if (!keyframe && !_key_valid)
+    {
+        return false;
+    }
+
+    std::copy(bytes.begin(), bytes.end(), _ring.begin() + static_cast<std::ptrdiff_t>(_head));
+    _entries.push_back(Entry{_head, static_cast<uint32_t>(size), static_cast<uint32_t>(state_size), keyframe});
+    _head += size;
+    _used += size;
+    return true;
+}
+
+// Drops the oldest entry and any deltas left without their keyframe
+void RewindBuffer::EvictFront()
+{
+    do
+    {
+        _used -= _entries.front().size;
+        _entries.pop_front();
+    } while (!_entries.empty() && !_entries.front().keyframe);
+
+    if (_entries.empty())
+    {
+        _key_valid = false;
+        _since_keyframe = 0;
+    }
+}
+
+bool RewindBuffer::LoadNewestKeyframe()
+{
+    for (size_t i = _entries.size(); i-- > 0;)
+    {
+        const Entry& entry = _entries[i];
+        if (entry.keyframe)
+        {
+            uint8_t* bytes = reinterpret_cast<uint8_t*>(&_key);
+            std::memset(bytes, 0, entry.state_size);
+            Decode(_ring.data() + entry.offset, entry.size, bytes, entry.state_size);
+            _since_keyframe = static_cast<uint32_t>(_entries.size() - 1 - i);
+            _key_valid = true;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,112 @@
+#include "save_state.hpp"
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include "logger.hpp"
+
+namespace
+{
+    // File header in front of the Size() bytes of a Chip8State
+    struct FileHeader
+    {
+        static constexpr uint32_t MAGIC = 0x46533843;   // "C8SF"
+
+        uint32_t magic = MAGIC;
+        uint32_t version = Chip8State::VERSION;
+        uint32_t size = 0;
+        uint32_t crc = 0;
+    };
+
+    constexpr std::array<uint32_t, 256> MakeCrcTable()
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint32_t, 256> CRC_TABLE = MakeCrcTable();
+}
+
+// CRC-32 (IEEE 802.3, as used by zip and png)
+uint32_t savestate::Crc32(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = CRC_TABLE[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool savestate::WriteFile(const std::string& path, const Chip8State& state)
+{
+    FileHeader header;
+    header.size = static_cast<uint32_t>(state.Size());
+    header.crc = Crc32(&state, header.size);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open save state for writing: {}", path);
+        return false;
+    }
+
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                 && fwrite(&state, header.size, 1, file) == 1;
+    if (fclose(file) != 0 || !ok)
+    {
+        logger::Error("Failed to write save state: {}", path);
+        return false;
+    }
+    return true;
+}
+
+bool savestate::ReadFile(const std::string& path, Chip8State& state)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        logger::Error("Failed to open save state: {}", path);
+        return false;
+    }
+
+    FileHeader header;
+    auto loaded = std::make_unique<Chip8State>();
+    const bool read_header = fread(&header, sizeof(header), 1, file) == 1;
+    const bool matches = read_header
+                      && header.magic == FileHeader::MAGIC
+                      && header.version == Chip8State::VERSION
+                      && header.size >= offsetof(Chip8State, memory)
+                      && header.size <= sizeof(Chip8State);
+    const bool read_state = matches && fread(loaded.get(), header.size, 1, file) == 1;
+    fclose(file);
+
+    if (!read_header || !matches)
+    {
+        logger::Error("Not a version {} save state: {}", Chip8State::VERSION, path);
+        return false;
+    }
+    if (!read_state)
+    {
+        logger::Error("Save state is truncated: {}", path);
+        return false;
+    }
+    if (Crc32(loaded.get(), header.size) != header.crc || loaded->Size() != header.size)
+    {
+        logger::Error("Save state checksum mismatch: {}", path);
+        return false;
+    }
+
+    std::memcpy(&state, loaded.get(), header.size);
+    return true;
+}
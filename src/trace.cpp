@@ -0,0 +1,193 @@
+#include "trace.hpp"
+#include "logger.hpp"
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define CHIP8_TRACE_NO_THREADS
+#endif
+
+static_assert(sizeof(TraceRecord) == 40, "trace records are written as raw bytes");
+static_assert(sizeof(TraceHeader) == 32, "trace headers are written as raw bytes");
+
+TraceWriter::~TraceWriter()
+{
+    Close();
+}
+
+bool TraceWriter::Open(const std::string& path, const TraceHeader& header)
+{
+    Close();
+
+    _file = fopen(path.c_str(), "wb");
+    if (_file == nullptr)
+    {
+        logger::Error("Failed to open trace for writing: {}", path);
+        return false;
+    }
+    if (fwrite(&header, sizeof(header), 1, _file) != 1)
+    {
+        logger::Error("Failed to write trace: {}", path);
+        fclose(_file);
+        _file = nullptr;
+        return false;
+    }
+
+    for (std::vector<TraceRecord>& buffer : _buffers)
+    {
+        buffer.resize(BUFFER_RECORDS);
+    }
+    _active_index = 0;
+    _active = _buffers[0].data();
+    _used = 0;
+    _handed = 0;
+    _pending = 0;
+    _stop = false;
+    _failed = false;
+#ifndef CHIP8_TRACE_NO_THREADS
+    _thread = std::thread([this] { Loop(); });
+#endif
+    return true;
+}
+
+// Gives the full buffer to the writer thread and carries on in the other
+// one, once the writer is done with it
+void TraceWriter::Hand()
+{
+#ifdef CHIP8_TRACE_NO_THREADS
+    _failed = _failed || fwrite(_active, sizeof(TraceRecord), _used, _file) != _used;
+    _handed += _used;
+    _used = 0;
+    return;
+#endif
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this] { return _pending == 0; });
+    _pending = _used;
+    _handed += _used;
+    _active_index ^= 1;
+    _active = _buffers[_active_index].data();
+    _used = 0;
+    lock.unlock();
+    _cv.notify_all();
+}
+
+void TraceWriter::Loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _cv.wait(lock, [this] { return _pending != 0 || _stop; });
+        if (_pending == 0)
+        {
+            return;
+        }
+
+        // the full buffer is the one that is not active
+        const TraceRecord* records = _buffers[_active_index ^ 1].data();
+        const size_t count = _pending;
+        lock.unlock();
+        const bool ok = fwrite(records, sizeof(TraceRecord), count, _file) == count;
+        lock.lock();
+
+        _failed = _failed || !ok;
+        _pending = 0;
+        _cv.notify_all();
+    }
+}
+
+bool TraceWriter::Close()
+{
+    if (_file == nullptr)
+    {
+        return true;
+    }
+
+    if (_used != 0)
+    {
+        Hand();
+    }
+#ifndef CHIP8_TRACE_NO_THREADS
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+#endif
+
+    const bool ok = !_failed && fclose(_file) == 0;
+    _file = nullptr;
+    if (!ok)
+    {
+        logger::Error("Failed to write trace ({} records)", _handed);
+    }
+    return ok;
+}
+
+uint64_t TraceWriter::Records() const
+{
+    return _handed + _used;
+}
+
+TraceReader::~TraceReader()
+{
+    if (_file != nullptr)
+    {
+        fclose(_file);
+    }
+}
+
+bool TraceReader::Open(const std::string& path)
+{
+    _file = fopen(path.c_str(), "rb");
+    if (_file == nullptr)
+    {
+        logger::Error("Failed to open trace: {}", path);
+        return false;
+    }
+
+    const bool read = fread(&_header, sizeof(_header), 1, _file) == 1;
+    if (!read || _header.magic != TraceHeader::MAGIC || _header.version != TraceHeader::VERSION
+        || _header.record_size != sizeof(TraceRecord))
+    {
+        logger::Error("Not a version {} trace: {}", TraceHeader::VERSION, path);
+        return false;
+    }
+
+    // 64-bit seek: traces of a few hundred million cycles pass 4 GB
+#ifdef _WIN32
+    _fseeki64(_file, 0, SEEK_END);
+    const int64_t size = _ftelli64(_file);
+    _fseeki64(_file, sizeof(_header), SEEK_SET);
+#else
+    fseeko(_file, 0, SEEK_END);
+    const int64_t size = ftello(_file);
+    fseeko(_file, sizeof(_header), SEEK_SET);
+#endif
+    _records = static_cast<uint64_t>(size - static_cast<int64_t>(sizeof(_header))) / sizeof(TraceRecord);
+    _buffer.resize(4096);
+    return true;
+}
+
+bool TraceReader::Next(TraceRecord& record)
+{
+    if (_pos == _filled)
+    {
+        _filled = fread(_buffer.data(), sizeof(TraceRecord), _buffer.size(), _file);
+        _pos = 0;
+        if (_filled == 0)
+        {
+            return false;
+        }
+    }
+    record = _buffer[_pos++];
+    return true;
+}
+
+const TraceHeader& TraceReader::Header() const
+{
+    return _header;
+}
+
+uint64_t TraceReader::Records() const
+{
+    return _records;
+}
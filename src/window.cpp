@@ -44,9 +44,11 @@ bool Window::CreateRenderer()
     );
 }
 
+// The texture is made once, big enough for the 128x64 display; a 64x32
+// display uses its top-left corner, see SetDisplaySize()
 bool Window::CreateTexture()
 {
-    _gfx_texture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, W, H);
+    _gfx_texture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, HIRES_W, HIRES_H);
     if(!_gfx_texture)
     {
         logger::Error("Failed to create graphics texture: {}", SDL_GetError());
@@ -55,11 +57,20 @@ bool Window::CreateTexture()
     }
 
     SDL_SetTextureScaleMode(_gfx_texture, SDL_SCALEMODE_NEAREST);
-    SDL_SetRenderLogicalPresentation(_renderer, W, H, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE);
+    // both resolutions are 2:1, so either one fills the same logical area
+    SDL_SetRenderLogicalPresentation(_renderer, HIRES_W, HIRES_H, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE);
 
     return true;
 }
 
+// Switches to a display of width x height; only the source rectangle
+// changes, no SDL object is recreated
+void Window::SetDisplaySize(int width, int height)
+{
+    _display_rect = SDL_FRect{0, 0, static_cast<float>(width), static_cast<float>(height)};
+    _redraw = true;
+}
+
 bool Window::Setup()
 {
     _running = true;
@@ -77,6 +88,18 @@ void Window::Exit()
     _running = false;
 }
 
+void Window::RequestRedraw()
+{
+    _redraw = true;
+}
+
+bool Window::TakeRedraw()
+{
+    const bool redraw = _redraw;
+    _redraw = false;
+    return redraw;
+}
+
 SDL_Window* Window::GetWindow()
 {
     return _window;
@@ -92,5 +115,10 @@ SDL_Texture* Window::GetGfxTexture()
     return _gfx_texture;
 }
 
+const SDL_FRect* Window::GetDisplayRect() const
+{
+    return &_display_rect;
+}
+
 
 
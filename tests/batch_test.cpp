@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "chip8_batch.hpp"
+#include "logger.hpp"
+#include "save_state.hpp"
+
+/*
+    batch_test: every Chip8Batch lane must match a Chip8 run of the same ROM
+    with the same seed and keys. Registers, stack, timers, memory and both
+    bitplanes are compared after every frame, for every bundled ROM under
+    every quirk profile. The lanes are given different seeds and keys so
+    they diverge and exercise the grouped and scalar paths, and the oracles
+    cycle through the execution modes.
+*/
+
+namespace
+{
+    constexpr size_t LANES = 8;
+    constexpr int FRAMES = 300;
+
+    // lane's key is held for a stretch of frames, at a different time per lane
+    bool KeyDown(size_t lane, int frame)
+    {
+        const int start = 20 + static_cast<int>(lane) * 15;
+        return frame >= start && frame < start + 30;
+    }
+
+    uint8_t KeyOf(size_t lane)
+    {
+        return static_cast<uint8_t>((lane * 5 + 4) & 0xF);
+    }
+
+    // Names the first field where lane differs from the oracle's state,
+    // or returns nullptr
+    const char* Compare(const Chip8Batch& batch, size_t lane, const Chip8State& s, uint32_t memory_size)
+    {
+        for (int r = 0; r < 16; r++)
+        {
+            if (batch.GetV(lane, r) != s.V[r])
+            {
+                return "V";
+            }
+        }
+        if (batch.GetI(lane) != s.I || batch.GetPC(lane) != s.pc || batch.GetSP(lane) != s.sp)
+        {
+            return "I, PC or SP";
+        }
+        for (int l = 0; l < s.sp; l++)
+        {
+            if (batch.GetStack(lane, l) != s.stack[l])
+            {
+                return "stack";
+            }
+        }
+        if (batch.GetDelayTimer(lane) != s.delay_timer || batch.GetSoundTimer(lane) != s.sound_timer)
+        {
+            return "timers";
+        }
+        if (batch.WaitingForKey(lane) != (s.waiting_for_key != 0) || batch.GetHiRes(lane) != (s.hires != 0))
+        {
+            return "FX0A wait or resolution";
+        }
+        if (std::memcmp(batch.GetMemory(lane), s.memory, memory_size) != 0)
+        {
+            return "memory";
+        }
+        for (int p = 0; p < framebuffer::BITPLANES; p++)
+        {
+            if (!std::equal(s.gfx[p], s.gfx[p] + framebuffer::WORDS, batch.GetGfx(lane, p)))
+            {
+                return "framebuffer";
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the number of lanes that diverged from their oracle
+    int RunRom(const std::string& rom, QuirkProfile profile, const char* profile_name)
+    {
+        static constexpr ExecutionMode MODES[] = {
+            ExecutionMode::Interpreter, ExecutionMode::Cached, ExecutionMode::Block, ExecutionMode::Jit,
+        };
+
+        Chip8Batch batch(LANES);
+        batch.SetQuirks(profile);
+        for (size_t lane = 0; lane < LANES; lane++)
+        {
+            batch.SetSeed(lane, 100 + lane);
+        }
+        if (!batch.LoadROM(rom))
+        {
+            return static_cast<int>(LANES);
+        }
+
+        std::vector<std::unique_ptr<Chip8>> oracles;
+        for (size_t lane = 0; lane < LANES; lane++)
+        {
+            auto& chip8 = oracles.emplace_back(std::make_unique<Chip8>());
+            chip8->SetQuirks(profile);
+            chip8->SetSeed(100 + lane);
+            chip8->SetExecutionMode(MODES[lane % std::size(MODES)]);
+            if (!chip8->LoadROM(rom))
+            {
+                return static_cast<int>(LANES);
+            }
+        }
+
+        const uint32_t memory_size = profile == QuirkProfile::XoChip ? XO_RAM : RAM;
+        auto state = std::make_unique<Chip8State>();
+        std::vector<bool> diverged(LANES, false);
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            for (size_t lane = 0; lane < LANES; lane++)
+            {
+                if (KeyDown(lane, frame) == KeyDown(lane, frame - 1))
+                {
+                    continue;
+                }
+                if (KeyDown(lane, frame))
+                {
+                    batch.OnKeyPressed(lane, KeyOf(lane));
+                    oracles[lane]->OnKeyPressed(KeyOf(lane));
+                }
+                else
+                {
+                    batch.OnKeyReleased(lane, KeyOf(lane));
+                    oracles[lane]->OnKeyReleased(KeyOf(lane));
+                }
+            }
+
+            batch.RunFrame();
+            for (size_t lane = 0; lane < LANES; lane++)
+            {
+                if (diverged[lane])
+                {
+                    continue;
+                }
+                oracles[lane]->RunFrame();
+                oracles[lane]->SaveState(*state);
+                if (const char* field = Compare(batch, lane, *state, memory_size))
+                {
+                    fmt::print("FAIL: {} ({}) lane {}: {} differs at frame {}\n",
+                               std::filesystem::path(rom).filename().string(), profile_name, lane, field, frame);
+                    diverged[lane] = true;
+                }
+            }
+        }
+        return static_cast<int>(std::count(diverged.begin(), diverged.end(), true));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: batch_test <rom-dir>");
+        return 1;
+    }
+
+    struct Profile
+    {
+        QuirkProfile profile;
+        const char* name;
+    };
+    static constexpr Profile PROFILES[] = {
+        {QuirkProfile::Vip, "vip"},
+        {QuirkProfile::SuperChip, "schip"},
+        {QuirkProfile::XoChip, "xochip"},
+    };
+
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    int failures = 0;
+    int runs = 0;
+    for (const Profile& p : PROFILES)
+    {
+        for (const std::string& rom : roms)
+        {
+            failures += RunRom(rom, p.profile, p.name);
+            runs += static_cast<int>(LANES);
+        }
+    }
+
+    fmt::print("{} of {} lanes diverged\n", failures, runs);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "paged_memory.hpp"
+#include "save_state.hpp"
+
+/*
+    fork_test: a write to one copy of copy-on-write memory must never show
+    in another. First on PagedMemory itself, writing one copy then the other
+    and checking both every time. Then on Chip8::ForkFrom for every bundled
+    ROM: the child runs on with keys held while the parent's state must not
+    move, and the parent then runs on and must match an instance that was
+    never forked.
+*/
+
+namespace
+{
+    constexpr int WARMUP_FRAMES = 60;
+    constexpr int FORK_FRAMES = 120;
+
+    // Returns false if a write to either copy showed in the other
+    bool CheckPagedMemory()
+    {
+        PagedMemory original;
+        for (size_t addr = 0; addr < 4096; addr++)
+        {
+            original.Write(addr, static_cast<uint8_t>(addr * 7));
+        }
+
+        PagedMemory copy = original;
+        for (size_t page = 0; page < PagedMemory::PAGES; page++)
+        {
+            if (!copy.SharesPage(original, page))
+            {
+                fmt::print("FAIL: PagedMemory copy does not share page {}\n", page);
+                return false;
+            }
+        }
+
+        // one byte per page, so every page is unshared, zero page included
+        for (size_t addr = 3; addr < PagedMemory::SIZE; addr += PagedMemory::PAGE_SIZE)
+        {
+            const uint8_t before = original[addr];
+            copy.Write(addr, static_cast<uint8_t>(before ^ 0xA5));
+            if (original[addr] != before || copy[addr] != (before ^ 0xA5) || copy.SharesPage(original, addr >> PagedMemory::PAGE_SHIFT))
+            {
+                fmt::print("FAIL: write to a PagedMemory copy at {:04X} reached the original\n", addr);
+                return false;
+            }
+            const uint8_t copied = copy[addr + 1];
+            original.Write(addr + 1, static_cast<uint8_t>(copied ^ 0x5A));
+            if (copy[addr + 1] != copied || original[addr + 1] != (copied ^ 0x5A))
+            {
+                fmt::print("FAIL: write to a PagedMemory original at {:04X} reached the copy\n", addr + 1);
+                return false;
+            }
+        }
+
+        // the bytes no one wrote since the copy still agree
+        for (size_t addr = 0; addr < PagedMemory::SIZE; addr++)
+        {
+            const size_t offset = addr & (PagedMemory::PAGE_SIZE - 1);
+            if (offset != 3 && offset != 4 && original[addr] != copy[addr])
+            {
+                fmt::print("FAIL: PagedMemory copies differ at untouched {:04X}\n", addr);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void RunFrames(Chip8& chip8, int frames, int key)
+    {
+        if (key >= 0)
+        {
+            chip8.OnKeyPressed(static_cast<uint8_t>(key));
+        }
+        for (int f = 0; f < frames; f++)
+        {
+            chip8.RunFrame();
+        }
+        if (key >= 0)
+        {
+            chip8.OnKeyReleased(static_cast<uint8_t>(key));
+        }
+    }
+
+    // Returns false if the child's run leaked into the parent
+    bool CheckFork(const std::string& rom, ExecutionMode mode)
+    {
+        const std::string name = std::filesystem::path(rom).filename().string();
+        Chip8 parent;
+        Chip8 reference;
+        Chip8 child;
+        for (Chip8* chip8 : {&parent, &reference, &child})
+        {
+            chip8->SetSeed(3);
+            chip8->SetExecutionMode(mode);
+        }
+        if (!parent.LoadROM(rom) || !reference.LoadROM(rom) || !child.LoadROM(rom))
+        {
+            return false;
+        }
+        RunFrames(parent, WARMUP_FRAMES, -1);
+        RunFrames(reference, WARMUP_FRAMES, -1);
+
+        auto before = std::make_unique<Chip8State>();
+        auto after = std::make_unique<Chip8State>();
+        parent.SaveState(*before);
+        child.ForkFrom(parent);
+        RunFrames(child, FORK_FRAMES, 5);
+        parent.SaveState(*after);
+        if (std::memcmp(before.get(), after.get(), before->Size()) != 0)
+        {
+            fmt::print("FAIL: {}: running a fork changed the parent\n", name);
+            return false;
+        }
+
+        RunFrames(parent, FORK_FRAMES, -1);
+        RunFrames(reference, FORK_FRAMES, -1);
+        parent.SaveState(*before);
+        reference.SaveState(*after);
+        if (std::memcmp(before.get(), after.get(), before->Size()) != 0)
+        {
+            fmt::print("FAIL: {}: parent diverged from an unforked run after its fork ran\n", name);
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: fork_test <rom-dir>");
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    int failures = CheckPagedMemory() ? 0 : 1;
+    int runs = 1;
+    for (ExecutionMode mode : {ExecutionMode::Interpreter, ExecutionMode::Jit})
+    {
+        for (const std::string& rom : roms)
+        {
+            failures += CheckFork(rom, mode) ? 0 : 1;
+            runs++;
+        }
+    }
+
+    fmt::print("{} of {} fork checks failed\n", failures, runs);
+    return failures == 0 ? 0 : 1;
+}
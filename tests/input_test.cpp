@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "save_state.hpp"
+
+/*
+    input_test: a key event queued for cycle C must be applied on exactly
+    cycle C, in every execution mode.
+
+    First on a polling loop whose exit shows the cycle the key was first
+    seen on: queued for each of three consecutive cycles, an event applied a
+    cycle early or late changes how many times the loop ran. Then on every
+    bundled ROM: queueing a series of presses and releases and running frame
+    by frame must end in the same state as running to each event's cycle and
+    pressing or releasing the key there by hand.
+*/
+
+namespace
+{
+    constexpr ExecutionMode MODES[] = {
+        ExecutionMode::Interpreter, ExecutionMode::Cached, ExecutionMode::Block, ExecutionMode::Jit,
+    };
+
+    // V1 counts the passes (mod 256), one instruction per cycle from cycle 0:
+    //   200: 7101   V1 += 1            cycle 3j
+    //   202: E0A1   skip if 0 is up    cycle 3j + 1
+    //   204: 1204   done, spin here
+    //   206: 1200   next pass          cycle 3j + 2
+    constexpr uint8_t POLL_ROM[] = {0x71, 0x01, 0xE0, 0xA1, 0x12, 0x04, 0x12, 0x00};
+
+    // Runs until the clock reads cycle, splitting the run wherever the CPU blocks
+    void RunTo(Chip8& chip8, uint64_t cycle)
+    {
+        while (chip8.GetCycles() < cycle)
+        {
+            chip8.RunCycles(cycle - chip8.GetCycles());
+        }
+    }
+
+    // Returns the number of key cycles whose press was seen on the wrong cycle
+    int CheckPolling(const std::string& path)
+    {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(POLL_ROM), sizeof(POLL_ROM));
+
+        const uint64_t frame = Chip8::DEFAULT_CLOCK_HZ / Chip8::FRAME_HZ;
+        const uint64_t bases[] = {1, 2, 100, frame - 2, frame, 7 * frame - 1, 20 * frame + 5};
+        auto state = std::make_unique<Chip8State>();
+        int failures = 0;
+        for (ExecutionMode mode : MODES)
+        {
+            for (uint64_t base : bases)
+            {
+                for (uint64_t cycle = base; cycle < base + 3; cycle++)
+                {
+                    Chip8 chip8;
+                    chip8.SetExecutionMode(mode);
+                    if (!chip8.LoadROM(path))
+                    {
+                        return 1;
+                    }
+                    chip8.QueueKey(cycle, 0, true);
+                    RunTo(chip8, cycle + 10 * frame);
+                    chip8.SaveState(*state);
+
+                    // the first E0A1 on or after the cycle sees the key; V1 wraps
+                    const uint8_t expected = static_cast<uint8_t>((cycle + 1) / 3 + 1);
+                    if (state->V[1] != expected || state->pc != 0x204)
+                    {
+                        fmt::print("FAIL: polling loop, mode {}: key queued for cycle {} seen after {} passes, not {}\n",
+                                   static_cast<int>(mode), cycle, state->V[1], expected);
+                        failures++;
+                    }
+                }
+            }
+        }
+        return failures;
+    }
+
+    // Returns false if the queued run and the hand-driven one ended apart
+    bool CheckRom(const std::string& rom, ExecutionMode mode)
+    {
+        const std::string name = std::filesystem::path(rom).filename().string();
+        Chip8 queued;
+        Chip8 manual;
+        for (Chip8* chip8 : {&queued, &manual})
+        {
+            chip8->SetSeed(5);
+            chip8->SetExecutionMode(mode);
+            if (!chip8->LoadROM(rom))
+            {
+                return false;
+            }
+        }
+
+        // a press and a release at odd cycles every few frames, some pressed
+        // on a whole multiple of the frame length
+        const uint64_t frame = Chip8::DEFAULT_CLOCK_HZ / Chip8::FRAME_HZ;
+        std::vector<InputEvent> events;
+        uint64_t noise = 0xD1B54A32D192ED03ull;
+        for (uint64_t at = 2 * frame; at < 150 * frame; )
+        {
+            noise ^= noise << 13;
+            noise ^= noise >> 7;
+            noise ^= noise << 17;
+            const uint8_t key = static_cast<uint8_t>(noise & 0xF);
+            const uint64_t press = (noise >> 8) % 3 == 0 ? (at + frame - 1) / frame * frame : at;
+            events.push_back(InputEvent{press, key, true});
+            events.push_back(InputEvent{press + 1 + (noise >> 16) % (3 * frame), key, false});
+            at = events.back().cycle + 1 + (noise >> 32) % (2 * frame);
+        }
+
+        for (const InputEvent& ev : events)
+        {
+            if (queued.QueueKey(ev.cycle, ev.key, ev.down) != ev.cycle)
+            {
+                fmt::print("FAIL: {}: key event for cycle {} was moved\n", name, ev.cycle);
+                return false;
+            }
+        }
+        const uint64_t end = events.back().cycle + 30 * frame;
+        while (queued.GetCycles() < end)
+        {
+            queued.RunFrame();
+        }
+
+        for (const InputEvent& ev : events)
+        {
+            RunTo(manual, ev.cycle);
+            if (ev.down)
+            {
+                manual.OnKeyPressed(ev.key);
+            }
+            else
+            {
+                manual.OnKeyReleased(ev.key);
+            }
+        }
+        RunTo(manual, queued.GetCycles());
+
+        auto a = std::make_unique<Chip8State>();
+        auto b = std::make_unique<Chip8State>();
+        queued.SaveState(*a);
+        manual.SaveState(*b);
+        if (a->Size() != b->Size() || std::memcmp(a.get(), b.get(), a->Size()) != 0)
+        {
+            fmt::print("FAIL: {}, mode {}: queued keys ended in another state than keys applied by hand\n",
+                       name, static_cast<int>(mode));
+            return false;
+        }
+
+        // an event for a cycle already run is applied on the current one
+        if (queued.QueueKey(0, 1, true) != queued.GetCycles())
+        {
+            fmt::print("FAIL: {}: a key event in the past was not moved to the present\n", name);
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: input_test <rom-dir>");
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    const std::string poll_path = (std::filesystem::temp_directory_path() / "chip8_input_test.ch8").string();
+    int failures = CheckPolling(poll_path);
+    std::filesystem::remove(poll_path);
+
+    for (ExecutionMode mode : MODES)
+    {
+        for (const std::string& rom : roms)
+        {
+            failures += CheckRom(rom, mode) ? 0 : 1;
+        }
+    }
+
+    fmt::print("{} key timing checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
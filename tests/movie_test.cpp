@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "movie.hpp"
+#include "save_state.hpp"
+
+/*
+    movie_test: a recorded movie must play back through the same frames.
+    Every bundled ROM is recorded for a while with keys queued at odd cycles
+    inside the frames. Partway through, the machine is rewound to an earlier
+    state and the recording goes on from there, as the frontend does. The
+    movie then goes through a file and is played on a fresh instance under
+    another execution mode, and every frame's display hash must match the
+    recorded one. A movie with one hash altered must be caught at that frame.
+*/
+
+namespace
+{
+    constexpr int FRAMES = 200;
+    constexpr int SAVE_FRAME = 70;      // the state the recording rewinds to
+    constexpr int REWIND_FRAME = 110;   // where it does so
+
+    // Records a movie of rom, returns false if it could not be loaded
+    bool Record(const std::string& rom, Movie& movie)
+    {
+        uint64_t rom_hash = 0;
+        Chip8 chip8;
+        chip8.SetSeed(11);
+        chip8.SetExecutionMode(ExecutionMode::Jit);
+        if (!movie::HashFile(rom, rom_hash) || !chip8.LoadROM(rom))
+        {
+            return false;
+        }
+
+        MovieRecorder recorder;
+        recorder.Start(chip8, rom_hash);
+        auto saved = std::make_unique<Chip8State>();
+        uint64_t noise = 0x9E3779B97F4A7C15ull;
+        int held = -1;
+        for (int step = 0; chip8.GetFrames() < FRAMES; step++)
+        {
+            if (step == SAVE_FRAME)
+            {
+                chip8.SaveState(*saved);
+            }
+            if (step == REWIND_FRAME)
+            {
+                chip8.LoadState(*saved);
+                recorder.Rewind(chip8);
+                held = -1;
+                for (uint8_t k = 0; k < 16; k++)
+                {
+                    held = saved->key[k] ? k : held;
+                }
+            }
+
+            // every few frames a key goes down or up somewhere inside the frame
+            noise ^= noise << 13;
+            noise ^= noise >> 7;
+            noise ^= noise << 17;
+            if (noise % 4 == 0)
+            {
+                const uint64_t span = chip8.GetNextVBlank() - chip8.GetCycles();
+                const uint64_t at = chip8.GetCycles() + (noise >> 8) % span;
+                const uint8_t key = held >= 0 ? static_cast<uint8_t>(held) : static_cast<uint8_t>((noise >> 40) & 0xF);
+                const bool down = held < 0;
+                recorder.OnKey(chip8.QueueKey(at, key, down), key, down);
+                held = down ? key : -1;
+            }
+
+            chip8.RunFrame();
+            recorder.OnFrame(chip8);
+        }
+        recorder.Stop();
+        movie = recorder.GetMovie();
+        return true;
+    }
+
+    // Plays movie on a fresh instance of rom
+    PlaybackResult Play(const std::string& rom, const Movie& movie)
+    {
+        Chip8 chip8;
+        chip8.SetExecutionMode(ExecutionMode::Interpreter);
+        if (!chip8.LoadROM(rom))
+        {
+            return PlaybackResult{};
+        }
+        return movie::Play(chip8, movie, true);
+    }
+
+    // Returns false if the played movie did not reproduce the recording
+    bool CheckRom(const std::string& rom, const std::string& path)
+    {
+        const std::string name = std::filesystem::path(rom).filename().string();
+        Movie recorded;
+        Movie movie;
+        if (!Record(rom, recorded) || !movie::WriteFile(path, recorded) || !movie::ReadFile(path, movie))
+        {
+            fmt::print("FAIL: {}: could not record the movie\n", name);
+            return false;
+        }
+        if (movie.frames != FRAMES || movie.frame_hashes.size() != FRAMES)
+        {
+            fmt::print("FAIL: {}: movie holds {} frames and {} hashes, not {}\n",
+                       name, movie.frames, movie.frame_hashes.size(), FRAMES);
+            return false;
+        }
+
+        const PlaybackResult result = Play(rom, movie);
+        if (result.divergent_frame != PlaybackResult::NO_DIVERGENCE || result.frames != movie.frames)
+        {
+            fmt::print("FAIL: {}: playback diverged at frame {} of {}\n", name, result.divergent_frame, movie.frames);
+            return false;
+        }
+
+        const uint64_t altered = FRAMES / 2;
+        movie.frame_hashes[altered] ^= 1;
+        const PlaybackResult tampered = Play(rom, movie);
+        if (tampered.divergent_frame != altered)
+        {
+            fmt::print("FAIL: {}: an altered frame hash was not caught at frame {}\n", name, altered);
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: movie_test <rom-dir>");
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    const std::string path = (std::filesystem::temp_directory_path() / "chip8_movie_test.c8m").string();
+    int failures = 0;
+    for (const std::string& rom : roms)
+    {
+        failures += CheckRom(rom, path) ? 0 : 1;
+    }
+    std::filesystem::remove(path);
+
+    fmt::print("{} of {} movies did not play back\n", failures, roms.size());
+    return failures == 0 ? 0 : 1;
+}
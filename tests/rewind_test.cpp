@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "rewind.hpp"
+#include "save_state.hpp"
+
+/*
+    rewind_test: rewinding N frames and replaying them with the same keys
+    must reproduce the same states. Every bundled ROM is run with keys held
+    for stretches of frames while each frame's state is pushed into a
+    RewindBuffer and hashed. The test then pops back N frames, loads the
+    snapshot and replays; each replayed frame must hash as it did the first
+    time. A small ring is also used, so that keyframes are evicted and the
+    rewind stops short of N.
+*/
+
+namespace
+{
+    constexpr int FRAMES = 240;
+    constexpr int REWIND = 150;
+
+    // FNV-1a over every byte of the state
+    uint64_t HashState(const Chip8State& state)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&state);
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < state.Size(); i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    // The keys change every 40 frames; frame -1 has none down
+    uint16_t KeysAt(int frame)
+    {
+        return frame < 0 ? 0 : static_cast<uint16_t>(1u << ((frame / 40 * 7 + 5) & 0xF));
+    }
+
+    // Presses and releases whatever changed between the previous frame and this one
+    void ApplyKeys(Chip8& chip8, int frame)
+    {
+        const uint16_t before = KeysAt(frame - 1);
+        const uint16_t now = KeysAt(frame);
+        for (uint8_t k = 0; k < 16; k++)
+        {
+            const bool was = (before >> k) & 0x1;
+            const bool is = (now >> k) & 0x1;
+            if (is && !was)
+            {
+                chip8.OnKeyPressed(k);
+            }
+            else if (was && !is)
+            {
+                chip8.OnKeyReleased(k);
+            }
+        }
+    }
+
+    // Returns false if the replay after a rewind diverged
+    bool RunRom(const std::string& rom, size_t capacity)
+    {
+        const std::string name = std::filesystem::path(rom).filename().string();
+        Chip8 chip8;
+        chip8.SetSeed(7);
+        if (!chip8.LoadROM(rom))
+        {
+            return false;
+        }
+
+        RewindBuffer rewind(capacity, 30);
+        auto state = std::make_unique<Chip8State>();
+        std::vector<uint64_t> hashes;   // hashes[f] is the state after frame f
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            ApplyKeys(chip8, frame);
+            chip8.RunFrame();
+            chip8.SaveState(*state);
+            rewind.Push(*state);
+            hashes.push_back(HashState(*state));
+        }
+
+        // The newest snapshot is the current frame; popping one more per
+        // frame of rewind lands on the state after frame FRAMES - 1 - back
+        const int back = std::min(REWIND, static_cast<int>(rewind.Frames()) - 1);
+        for (int i = 0; i <= back; i++)
+        {
+            if (!rewind.Pop(*state))
+            {
+                fmt::print("FAIL: {}: rewind buffer ran dry after {} of {} frames\n", name, i, back);
+                return false;
+            }
+        }
+        const int from = FRAMES - 1 - back;
+        if (HashState(*state) != hashes[from] || !chip8.LoadState(*state))
+        {
+            fmt::print("FAIL: {}: snapshot of frame {} does not match the state it was taken from\n", name, from);
+            return false;
+        }
+
+        for (int frame = from + 1; frame < FRAMES; frame++)
+        {
+            ApplyKeys(chip8, frame);
+            chip8.RunFrame();
+            chip8.SaveState(*state);
+            if (HashState(*state) != hashes[frame])
+            {
+                fmt::print("FAIL: {}: replay after rewinding {} frames diverged at frame {}\n", name, back, frame);
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: rewind_test <rom-dir>");
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    // the small ring holds a few compressed keyframes, so older ones are evicted
+    static constexpr size_t CAPACITIES[] = {RewindBuffer::DEFAULT_CAPACITY, 8 * 1024};
+
+    int failures = 0;
+    int runs = 0;
+    for (size_t capacity : CAPACITIES)
+    {
+        for (const std::string& rom : roms)
+        {
+            failures += RunRom(rom, capacity) ? 0 : 1;
+            runs++;
+        }
+    }
+
+    fmt::print("{} of {} rewinds diverged on replay\n", failures, runs);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "save_state.hpp"
+
+/*
+    save_state_test: LoadState must refuse a state whose fields would index
+    outside the machine's arrays or memory, and leave the machine running
+    as it was. Takes the directory of the bundled ROMs.
+*/
+
+namespace
+{
+    struct Corruption
+    {
+        const char* name;
+        std::function<void(Chip8State&)> apply;
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        logger::Error("Usage: save_state_test <rom-dir>");
+        return 1;
+    }
+    const std::string rom = std::string(argv[1]) + "/BRIX";
+
+    Chip8 chip8;
+    chip8.SetSeed(1);
+    if (!chip8.LoadROM(rom))
+    {
+        return 1;
+    }
+    for (int f = 0; f < 60; f++)
+    {
+        chip8.RunFrame();
+    }
+    auto good = std::make_unique<Chip8State>();
+    chip8.SaveState(*good);
+
+    const Corruption corruptions[] = {
+        {"stack pointer past the stack", [](Chip8State& s) { s.sp = 17; }},
+        {"FX0A register out of range", [](Chip8State& s) { s.waiting_for_key = 1; s.waiting_register = 200; }},
+        {"FX0A waiting on no register", [](Chip8State& s) { s.waiting_for_key = 1; s.waiting_register = Chip8::IDLE_REGISTER; }},
+        {"idle FX0A register out of range", [](Chip8State& s) { s.waiting_for_key = 0; s.waiting_register = 16; }},
+        {"PC outside 4 KB", [](Chip8State& s) { s.pc = 0x1200; }},
+        {"XO-CHIP memory on a 4 KB profile", [](Chip8State& s) { s.memory_pages = PagedMemory::PAGES; }},
+        {"bad magic", [](Chip8State& s) { s.magic = 0; }},
+    };
+
+    int failures = 0;
+    auto state = std::make_unique<Chip8State>();
+    for (const Corruption& c : corruptions)
+    {
+        *state = *good;
+        c.apply(*state);
+        if (chip8.LoadState(*state))
+        {
+            fmt::print("FAIL: accepted a state with {}\n", c.name);
+            failures++;
+        }
+    }
+
+    // the refused loads left the machine alone, and a sound state still loads
+    auto after = std::make_unique<Chip8State>();
+    chip8.SaveState(*after);
+    if (std::memcmp(after.get(), good.get(), good->Size()) != 0 || !chip8.LoadState(*good))
+    {
+        fmt::print("FAIL: machine changed by a refused load, or a sound state was refused\n");
+        failures++;
+    }
+
+    fmt::print("{} of {} corrupt states accepted\n", failures, std::size(corruptions));
+    return failures == 0 ? 0 : 1;
+}
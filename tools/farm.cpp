@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "logger.hpp"
+#include "tool_args.hpp"
+
+/*
+    chip8-farm: runs many ROM jobs in parallel, one Chip8 instance per worker.
+
+    Usage: chip8-farm <job-file> [--threads N] [--mode M] [--cpf N] [--seed N]
+
+    --threads N  worker threads (default: hardware concurrency)
+    --mode M     interpreter, cached, block or jit (default cached)
+    --cpf N      cycles per frame (default: the core's 10 kHz clock)
+    --seed N     seed for CXNN, the same for every job (default: random)
+
+    The job file holds one job per line, '#' starts a comment:
+
+        <rom-file> <frames> [input-script]
+
+    An input script holds one key event per line, applied before the given
+    frame runs:
+
+        <frame> down|up <key 0-F>
+
+    Each job runs with the quirk profile its ROM's file extension selects
+    (quirks::ForRom).
+
+    One result line is printed per job, in job-file order: final framebuffer
+    hash (framebuffer::Hash, FNV-1a over the packed rows), PC, I, V0-VF,
+    cycles and cycles/sec.
+*/
+
+namespace
+{
+    struct KeyEvent
+    {
+        uint64_t frame = 0;
+        uint8_t key = 0;
+        bool down = false;
+    };
+
+    struct Job
+    {
+        std::string rom;
+        uint64_t frames = 0;
+        std::string script;
+        std::vector<KeyEvent> events;   // sorted by frame
+    };
+
+    struct JobResult
+    {
+        bool ok = false;
+        uint64_t gfx_hash = 0;
+        uint16_t pc = 0;
+        uint16_t I = 0;
+        uint8_t V[16] = {};
+        uint64_t cycles = 0;
+        double seconds = 0.0;
+    };
+
+    /*
+        Each worker owns a deque of job indices. A worker pops from the front
+        of its own deque and, once that is empty, steals from the back of the
+        others, so long jobs on one worker do not leave the rest idle.
+    */
+    class WorkStealingPool
+    {
+        public:
+            explicit WorkStealingPool(size_t workers)
+            {
+                for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+                {
+                    _queues.push_back(std::make_unique<Queue>());
+                }
+            }
+
+            // Calls fn(job, worker) once for every job in [0, count)
+            void Run(size_t count, const std::function<void(size_t, size_t)>& fn)
+            {
+                for (size_t job = 0; job < count; job++)
+                {
+                    _queues[job % _queues.size()]->jobs.push_back(job);
+                }
+
+                std::vector<std::jthread> threads;
+                for (size_t worker = 0; worker < _queues.size(); worker++)
+                {
+                    threads.emplace_back([this, worker, &fn]
+                    {
+                        size_t job;
+                        while (Pop(worker, job) || Steal(worker, job))
+                        {
+                            fn(job, worker);
+                        }
+                    });
+                }
+            }
+
+            size_t Workers() const
+            {
+                return _queues.size();
+            }
+
+        private:
+            struct Queue
+            {
+                std::mutex lock;
+                std::deque<size_t> jobs;
+            };
+
+            std::vector<std::unique_ptr<Queue>> _queues;
+
+            bool Pop(size_t worker, size_t& job)
+            {
+                Queue& q = *_queues[worker];
+                std::lock_guard<std::mutex> guard(q.lock);
+                if (q.jobs.empty())
+                {
+                    return false;
+                }
+                job = q.jobs.front();
+                q.jobs.pop_front();
+                return true;
+            }
+
+            // No jobs are added after Run() starts, so one empty pass over
+            // every other queue means the pool is drained
+            bool Steal(size_t thief, size_t& job)
+            {
+                for (size_t i = 1; i < _queues.size(); i++)
+                {
+                    Queue& q = *_queues[(thief + i) % _queues.size()];
+                    std::lock_guard<std::mutex> guard(q.lock);
+                    if (!q.jobs.empty())
+                    {
+                        job = q.jobs.back();
+                        q.jobs.pop_back();
+                        return true;
+                    }
+                }
+                return false;
+            }
+    };
+
+    void Usage()
+    {
+        logger::Error("Usage: chip8-farm <job-file> [--threads N] [--mode M] [--cpf N] [--seed N]");
+    }
+
+    // Strips a '#' comment and reports whether anything is left
+    bool StripComment(std::string& line)
+    {
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos)
+        {
+            line.erase(hash);
+        }
+        return line.find_first_not_of(" \t\r") != std::string::npos;
+    }
+
+    bool LoadScript(const std::string& path, std::vector<KeyEvent>& events)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            logger::Error("Failed to open input script: {}", path);
+            return false;
+        }
+
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); number++)
+        {
+            if (!StripComment(line))
+            {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            std::string frame, action, key;
+            fields >> frame >> action >> key;
+
+            KeyEvent ev;
+            const bool known = (action == "down" || action == "up");
+            char* end = nullptr;
+            const unsigned long k = std::strtoul(key.c_str(), &end, 16);
+            if (!tool_args::ParseCount(frame, ev.frame) || !known || key.empty() || *end != '\0' || k > 0xF)
+            {
+                logger::Error("{}:{}: expected '<frame> down|up <key 0-F>'", path, number);
+                return false;
+            }
+            ev.key = static_cast<uint8_t>(k);
+            ev.down = (action == "down");
+            events.push_back(ev);
+        }
+
+        std::stable_sort(events.begin(), events.end(),
+            [](const KeyEvent& a, const KeyEvent& b) { return a.frame < b.frame; });
+        return true;
+    }
+
+    bool LoadJobs(const std::string& path, std::vector<Job>& jobs)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            logger::Error("Failed to open job file: {}", path);
+            return false;
+        }
+
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); number++)
+        {
+            if (!StripComment(line))
+            {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            std::string frames;
+            Job job;
+            fields >> job.rom >> frames >> job.script;
+            if (!tool_args::ParseCount(frames, job.frames))
+            {
+                logger::Error("{}:{}: expected '<rom-file> <frames> [input-script]'", path, number);
+                return false;
+            }
+            if (!job.script.empty() && !LoadScript(job.script, job.events))
+            {
+                return false;
+            }
+            jobs.push_back(std::move(job));
+        }
+        return true;
+    }
+
+    JobResult RunJob(Chip8& chip8, const Job& job, const uint64_t* seed)
+    {
+        JobResult result;
+        if (seed != nullptr)
+        {
+            chip8.SetSeed(*seed);
+        }
+        chip8.SetQuirks(quirks::ForRom(job.rom));
+        if (!chip8.LoadROM(job.rom))
+        {
+            return result;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        size_t next_event = 0;
+        for (uint64_t frame = 0; frame < job.frames; frame++)
+        {
+            for (; next_event < job.events.size() && job.events[next_event].frame <= frame; next_event++)
+            {
+                const KeyEvent& ev = job.events[next_event];
+                if (ev.down)
+                {
+                    chip8.OnKeyPressed(ev.key);
+                }
+                else
+                {
+                    chip8.OnKeyReleased(ev.key);
+                }
+            }
+            chip8.RunFrame();
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.ok = true;
+        result.gfx_hash = chip8.GetGfxHash();
+        result.pc = chip8._pc;
+        result.I = chip8._I;
+        std::copy(std::begin(chip8._V), std::end(chip8._V), std::begin(result.V));
+        result.cycles = chip8.GetCycles();
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    logger::StartAsync();
+
+    const std::string job_path = argv[1];
+    uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t cycles_per_frame = 0;
+    uint64_t seed = 0;
+    bool seeded = false;
+    ExecutionMode mode = ExecutionMode::Cached;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            Usage();
+            return 1;
+        }
+
+        if (arg == "--mode")
+        {
+            if (!tool_args::ParseMode(argv[++i], mode))
+            {
+                logger::Error("Unknown execution mode: {}", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (!tool_args::ParseCount(argv[i + 1], value))
+        {
+            logger::Error("Invalid number for {}: {}", arg, argv[i + 1]);
+            return 1;
+        }
+        i++;
+
+        if (arg == "--threads")
+        {
+            threads = value;
+        }
+        else if (arg == "--cpf")
+        {
+            cycles_per_frame = value;
+        }
+        else if (arg == "--seed")
+        {
+            seed = value;
+            seeded = true;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (threads == 0)
+    {
+        logger::Error("--threads must be greater than zero");
+        return 1;
+    }
+    if (cycles_per_frame > UINT32_MAX / Chip8::FRAME_HZ)
+    {
+        logger::Error("--cpf is too large: {}", cycles_per_frame);
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    if (!LoadJobs(job_path, jobs))
+    {
+        return 1;
+    }
+
+    WorkStealingPool pool(static_cast<size_t>(std::min<uint64_t>(threads, std::max<size_t>(jobs.size(), 1))));
+    std::vector<JobResult> results(jobs.size());
+
+    // One Chip8 per worker, reused across its jobs (LoadROM resets it); the
+    // instances share nothing, so no locking is needed around them
+    std::vector<std::unique_ptr<Chip8>> machines(pool.Workers());
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.Run(jobs.size(), [&](size_t job, size_t worker)
+    {
+        if (!machines[worker])
+        {
+            machines[worker] = std::make_unique<Chip8>();
+            machines[worker]->SetExecutionMode(mode);
+            if (cycles_per_frame != 0)
+            {
+                machines[worker]->SetClockRate(static_cast<uint32_t>(cycles_per_frame * Chip8::FRAME_HZ));
+            }
+        }
+        results[job] = RunJob(*machines[worker], jobs[job], seeded ? &seed : nullptr);
+    });
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    uint64_t total_cycles = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const Job& job = jobs[i];
+        const JobResult& r = results[i];
+        const std::string script = job.script.empty() ? "-" : job.script;
+        if (!r.ok)
+        {
+            fmt::print("[{}] {} frames={} script={} error\n", i, job.rom, job.frames, script);
+            failed++;
+            continue;
+        }
+
+        std::string regs;
+        for (int v = 0; v < 16; v++)
+        {
+            regs += fmt::format("{}{:02X}", v == 0 ? "" : ",", r.V[v]);
+        }
+        const double cps = r.seconds > 0.0 ? static_cast<double>(r.cycles) / r.seconds : 0.0;
+        fmt::print("[{}] {} frames={} script={} hash={:016x} pc={:03X} I={:03X} V={} cycles={} cycles/sec={:.0f}\n",
+            i, job.rom, job.frames, script, r.gfx_hash, r.pc, r.I, regs, r.cycles, cps);
+        total_cycles += r.cycles;
+    }
+
+    const double cps = seconds > 0.0 ? static_cast<double>(total_cycles) / seconds : 0.0;
+    fmt::print("jobs: {} failed: {} threads: {} seconds: {:.6f} cycles/sec: {:.0f}\n",
+        jobs.size(), failed, pool.Workers(), seconds, cps);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <fmt/core.h>
+#include "chip8.hpp"
+#include "chip8_batch.hpp"
+#include "logger.hpp"
+#include "movie.hpp"
+#include "tool_args.hpp"
+#include "trace.hpp"
+
+/*
+    chip8-headless: runs a ROM without SDL as fast as the host allows.
+
+    Usage: chip8-headless <rom-file> [--cycles N | --frames N] [--cpf N] [--mode M] [--quirks Q] [--lanes N] [--seed N]
+                          [--replay F] [--profile P] [--trace F]
+
+    --cycles N  run N CPU cycles
+    --frames N  run N 60 Hz frames (default 600 frames)
+    --cpf N     cycles per frame (default: the core's 10 kHz clock, ~166.7)
+    --mode M    interpreter, cached, block or jit (default cached)
+    --quirks Q  vip, schip or xochip (default: from the ROM's extension,
+                .sc8 and .xo8, otherwise vip)
+    --lanes N   run N lockstep instances on the batch core instead (--mode is
+                ignored); the rates then count all lanes
+    --seed N    seed for CXNN (lane L of a batch gets N + L); random by default
+    --replay F  play the input movie F instead (its seed, clock and frame
+                count are used) and check every frame's display hash against
+                the recorded one; exits with 1 at the first frame that differs
+    --profile P write the execution profile to P.json and P.folded (builds
+                with CHIP8_PROFILE only; not with --lanes)
+    --trace F   record every instruction to the binary trace F, for
+                chip8-trace (not with --lanes; runs one instruction at a
+                time in every mode)
+
+    Time is the core's virtual clock, so a run is deterministic for a given
+    ROM, clock rate and seed however fast the host is. instructions/sec is
+    the figure to compare; cycles/sec also counts the cycles a ROM idles
+    through while blocked on the display wait or FX0A.
+*/
+
+namespace
+{
+    constexpr uint64_t DEFAULT_FRAMES = 600;
+
+    void Usage()
+    {
+        logger::Error("Usage: chip8-headless <rom-file> [--cycles N | --frames N] [--cpf N] [--mode M] [--quirks Q] [--lanes N] [--seed N] [--replay F] [--profile P] [--trace F]");
+    }
+
+    // Chip8 and Chip8Batch share the run/clock interface. Returns the
+    // instructions executed, which leaves out the cycles spent blocked.
+    template <typename Machine>
+    uint64_t Run(Machine& machine, uint64_t cycles, uint64_t frames)
+    {
+        uint64_t executed = 0;
+        if (cycles != 0)
+        {
+            while (machine.GetCycles() < cycles)
+            {
+                executed += machine.RunCycles(cycles - machine.GetCycles()).executed;
+            }
+        }
+        else
+        {
+            for (uint64_t f = 0; f < frames; f++)
+            {
+                executed += machine.RunFrame().executed;
+            }
+        }
+        return executed;
+    }
+
+    bool WriteProfile(const Chip8& chip8, const std::string& prefix)
+    {
+        const Profiler* profiler = chip8.GetProfiler();
+        return profiler->WriteJson(prefix + ".json") && profiler->WriteFolded(prefix + ".folded");
+    }
+
+    bool OpenTrace(TraceWriter& trace, const std::string& path, const std::string& rom_path, uint64_t seed, uint32_t clock_hz)
+    {
+        TraceHeader header;
+        header.clock_hz = clock_hz;
+        header.seed = seed;
+        return movie::HashFile(rom_path, header.rom_hash) && trace.Open(path, header);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // the ROM comes first; an option in its place is a request for help
+    // (or a mistake), not a file name
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        Usage();
+        const std::string_view first = argc < 2 ? "" : argv[1];
+        return (first == "-h" || first == "--help") ? 0 : 1;
+    }
+
+    logger::StartAsync();
+
+    const std::string rom_path = argv[1];
+    uint64_t frames = DEFAULT_FRAMES;
+    uint64_t cycles = 0;
+    uint64_t cycles_per_frame = 0;
+    uint64_t lanes = 0;
+    uint64_t seed = 0;
+    bool seeded = false;
+    std::string movie_path;
+    std::string profile_path;
+    std::string trace_path;
+    ExecutionMode mode = ExecutionMode::Cached;
+    QuirkProfile profile = quirks::ForRom(rom_path);
+
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            Usage();
+            return 1;
+        }
+
+        if (arg == "--mode")
+        {
+            if (!tool_args::ParseMode(argv[++i], mode))
+            {
+                logger::Error("Unknown execution mode: {}", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--quirks")
+        {
+            if (!quirks::Parse(argv[++i], profile))
+            {
+                logger::Error("Unknown quirk profile: {}", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--replay")
+        {
+            movie_path = argv[++i];
+            continue;
+        }
+        if (arg == "--profile")
+        {
+            profile_path = argv[++i];
+            continue;
+        }
+        if (arg == "--trace")
+        {
+            trace_path = argv[++i];
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (!tool_args::ParseCount(argv[i + 1], value))
+        {
+            logger::Error("Invalid number for {}: {}", arg, argv[i + 1]);
+            return 1;
+        }
+        i++;
+
+        if (arg == "--cycles")
+        {
+            cycles = value;
+        }
+        else if (arg == "--frames")
+        {
+            frames = value;
+        }
+        else if (arg == "--cpf")
+        {
+            cycles_per_frame = value;
+        }
+        else if (arg == "--lanes")
+        {
+            lanes = value;
+        }
+        else if (arg == "--seed")
+        {
+            seed = value;
+            seeded = true;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (cycles_per_frame > UINT32_MAX / Chip8::FRAME_HZ)
+    {
+        logger::Error("--cpf is too large: {}", cycles_per_frame);
+        return 1;
+    }
+
+    if (!profile_path.empty() && !Profiler::ENABLED)
+    {
+        logger::Error("--profile needs a build configured with -DCHIP8_PROFILE=ON");
+        return 1;
+    }
+    if (!profile_path.empty() && lanes != 0)
+    {
+        logger::Error("--profile does not work with --lanes");
+        return 1;
+    }
+    if (!trace_path.empty() && lanes != 0)
+    {
+        logger::Error("--trace does not work with --lanes");
+        return 1;
+    }
+
+    const uint32_t clock_hz = static_cast<uint32_t>(cycles_per_frame * Chip8::FRAME_HZ);
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point stop;
+    uint64_t frames_run = 0;
+    uint64_t executed = 0;
+    PlaybackResult playback;
+    TraceWriter trace;
+
+    if (!movie_path.empty())
+    {
+        Movie movie;
+        uint64_t rom_hash = 0;
+        Chip8 chip8;
+        chip8.SetQuirks(profile);
+        if (!movie::ReadFile(movie_path, movie) || !movie::HashFile(rom_path, rom_hash) || !chip8.LoadROM(rom_path))
+        {
+            return 1;
+        }
+        if (rom_hash != movie.rom_hash)
+        {
+            logger::Error("{} was recorded with a different ROM (hash {:016x}, {} is {:016x})",
+                movie_path, movie.rom_hash, rom_path, rom_hash);
+            return 1;
+        }
+        chip8.SetExecutionMode(mode);
+        if (!trace_path.empty())
+        {
+            if (!OpenTrace(trace, trace_path, rom_path, movie.seed, movie.clock_hz))
+            {
+                return 1;
+            }
+            chip8.SetTrace(&trace);
+        }
+
+        start = std::chrono::steady_clock::now();
+        playback = movie::Play(chip8, movie, true);
+        stop = std::chrono::steady_clock::now();
+        executed = playback.executed;
+        chip8.SetTrace(nullptr);
+        cycles = chip8.GetCycles();
+        frames_run = chip8.GetFrames();
+        if (!profile_path.empty() && !WriteProfile(chip8, profile_path))
+        {
+            return 1;
+        }
+    }
+    else if (lanes != 0)
+    {
+        Chip8Batch batch(lanes);
+        batch.SetQuirks(profile);
+        if (!batch.LoadROM(rom_path))
+        {
+            return 1;
+        }
+        if (cycles_per_frame != 0)
+        {
+            batch.SetClockRate(clock_hz);
+        }
+        if (seeded)
+        {
+            for (size_t lane = 0; lane < batch.Lanes(); lane++)
+            {
+                batch.SetSeed(lane, seed + lane);
+            }
+        }
+
+        start = std::chrono::steady_clock::now();
+        executed = Run(batch, cycles, frames);
+        stop = std::chrono::steady_clock::now();
+        cycles = batch.GetCycles();
+        frames_run = batch.GetFrames();
+    }
+    else
+    {
+        Chip8 chip8;
+        chip8.SetQuirks(profile);
+        if (!chip8.LoadROM(rom_path))
+        {
+            return 1;
+        }
+        chip8.SetExecutionMode(mode);
+        if (cycles_per_frame != 0)
+        {
+            chip8.SetClockRate(clock_hz);
+        }
+        if (seeded)
+        {
+            chip8.SetSeed(seed);
+        }
+        if (!trace_path.empty())
+        {
+            if (!OpenTrace(trace, trace_path, rom_path, chip8.GetSeed(), chip8.GetClockRate()))
+            {
+                return 1;
+            }
+            chip8.SetTrace(&trace);
+        }
+
+        start = std::chrono::steady_clock::now();
+        executed = Run(chip8, cycles, frames);
+        stop = std::chrono::steady_clock::now();
+        chip8.SetTrace(nullptr);
+        cycles = chip8.GetCycles();
+        frames_run = chip8.GetFrames();
+        if (!profile_path.empty() && !WriteProfile(chip8, profile_path))
+        {
+            return 1;
+        }
+    }
+
+    const double seconds =
+        std::chrono::duration<double>(stop - start).count();
+    const double ips = seconds > 0.0 ? static_cast<double>(executed) / seconds : 0.0;
+    const uint64_t lane_cycles = cycles * std::max<uint64_t>(lanes, 1);
+    const double cps = seconds > 0.0 ? static_cast<double>(lane_cycles) / seconds : 0.0;
+
+    fmt::print("rom: {}\n", rom_path);
+    fmt::print("quirks: {}\n", quirks::Name(profile));
+    fmt::print("cycles: {}\n", cycles);
+    fmt::print("frames: {}\n", frames_run);
+    if (lanes != 0)
+    {
+        fmt::print("lanes: {}\n", lanes);
+    }
+    fmt::print("seconds: {:.6f}\n", seconds);
+    fmt::print("instructions/sec: {:.0f}\n", ips);
+    fmt::print("cycles/sec: {:.0f}\n", cps);
+    if (!trace_path.empty())
+    {
+        const uint64_t records = trace.Records();
+        if (!trace.Close())
+        {
+            return 1;
+        }
+        fmt::print("trace: {} instructions to {}\n", records, trace_path);
+    }
+    if (!movie_path.empty())
+    {
+        if (playback.divergent_frame != PlaybackResult::NO_DIVERGENCE)
+        {
+            fmt::print("replay: diverged at frame {} (expected {:016x}, got {:016x})\n",
+                playback.divergent_frame, playback.expected_hash, playback.actual_hash);
+            return 1;
+        }
+        fmt::print("replay: ok\n");
+    }
+    return 0;
+}
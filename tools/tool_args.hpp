@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include "chip8.hpp"
+
+/*
+    Command-line helpers shared by the headless tools.
+*/
+
+namespace tool_args
+{
+    inline bool ParseMode(std::string_view text, ExecutionMode& out)
+    {
+        if (text == "interpreter")
+        {
+            out = ExecutionMode::Interpreter;
+        }
+        else if (text == "cached")
+        {
+            out = ExecutionMode::Cached;
+        }
+        else if (text == "block")
+        {
+            out = ExecutionMode::Block;
+        }
+        else if (text == "jit")
+        {
+            out = ExecutionMode::Jit;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    inline bool ParseCount(std::string_view text, uint64_t& out)
+    {
+        char* end = nullptr;
+        const std::string s(text);
+        out = std::strtoull(s.c_str(), &end, 10);
+        return end != s.c_str() && *end == '\0';
+    }
+}
@@ -0,0 +1,341 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <fmt/core.h>
+#include "logger.hpp"
+#include "profiler.hpp"
+#include "tool_args.hpp"
+#include "trace.hpp"
+
+/*
+    chip8-trace: reads the execution traces chip8-headless --trace writes.
+
+    Usage: chip8-trace dump <trace> [--pc A-B] [--op OP] [--from C] [--count N]
+           chip8-trace diff <trace-a> <trace-b> [--context N]
+
+    dump prints one line per instruction: cycle, PC, opcode and its class,
+    I, the registers it changed, the bytes it wrote and whether it drew or
+    blocked.
+
+    --pc A-B    only instructions at PC A to B inclusive (hex), or a single PC
+    --op OP     only one opcode class (DXYN, 8XY4, FX55, ...) or one exact
+                opcode (D015)
+    --from C    start at cycle C
+    --count N   print at most N instructions
+
+    diff walks both traces in step and stops at the first instruction that
+    differs in any field, printing the N instructions before it (default 8)
+    and both versions of it. Exits with 0 if the traces are the same, 1 if
+    they differ.
+*/
+
+namespace
+{
+    constexpr uint64_t DEFAULT_CONTEXT = 8;
+
+    void Usage()
+    {
+        logger::Error("Usage: chip8-trace dump <trace> [--pc A-B] [--op OP] [--from C] [--count N]");
+        logger::Error("       chip8-trace diff <trace-a> <trace-b> [--context N]");
+    }
+
+    bool ParseHex(std::string_view text, uint16_t& out)
+    {
+        if (text.starts_with("0x") || text.starts_with("0X"))
+        {
+            text.remove_prefix(2);
+        }
+        char* end = nullptr;
+        const std::string s(text);
+        const unsigned long value = std::strtoul(s.c_str(), &end, 16);
+        if (end == s.c_str() || *end != '\0' || value > 0xFFFF)
+        {
+            return false;
+        }
+        out = static_cast<uint16_t>(value);
+        return true;
+    }
+
+    struct Filter
+    {
+        uint16_t pc_first = 0;
+        uint16_t pc_last = 0xFFFF;
+        int op_class = -1;              // Profiler::OpClass, -1 for any
+        int opcode = -1;                // exact opcode, -1 for any
+        uint64_t from = 0;
+        uint64_t count = UINT64_MAX;
+
+        bool Matches(const TraceRecord& record) const
+        {
+            return record.cycle >= from && record.pc >= pc_first && record.pc <= pc_last
+                && (op_class < 0 || Profiler::OpClass(record.opcode) == op_class)
+                && (opcode < 0 || record.opcode == opcode);
+        }
+    };
+
+    bool ParseOp(std::string_view text, Filter& filter)
+    {
+        for (int c = 0; c < Profiler::CLASSES; c++)
+        {
+            if (text == Profiler::ClassName(c))
+            {
+                filter.op_class = c;
+                return true;
+            }
+        }
+        uint16_t opcode = 0;
+        if (text.size() == 4 && ParseHex(text, opcode))
+        {
+            filter.opcode = opcode;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParsePcRange(std::string_view text, Filter& filter)
+    {
+        const size_t dash = text.find('-');
+        if (dash == std::string_view::npos)
+        {
+            return ParseHex(text, filter.pc_first) && ParseHex(text, filter.pc_last);
+        }
+        return ParseHex(text.substr(0, dash), filter.pc_first) && ParseHex(text.substr(dash + 1), filter.pc_last)
+            && filter.pc_first <= filter.pc_last;
+    }
+
+    std::string Format(const TraceRecord& record)
+    {
+        std::string line = fmt::format("{:>10}  {:03X}  {:04X}  {:<5} I={:03X}",
+            record.cycle, record.pc, record.opcode, Profiler::ClassName(Profiler::OpClass(record.opcode)), record.i);
+        for (int r = 0; r < 16; r++)
+        {
+            if ((record.v_changed >> r) & 1)
+            {
+                line += fmt::format(" V{:X}={:02X}", r, record.v[r]);
+            }
+        }
+
+        if (record.mem_count != 0)
+        {
+            // the bytes are not stored: FX55 wrote V0-VX, FX33 the digits of VX
+            const int x = (record.opcode >> 8) & 0xF;
+            line += fmt::format(" [{:03X}]=", record.mem_addr);
+            if ((record.opcode & 0xFF) == 0x33)
+            {
+                line += fmt::format("{:02X} {:02X} {:02X}", record.v[x] / 100, (record.v[x] / 10) % 10, record.v[x] % 10);
+            }
+            else
+            {
+                for (int r = 0; r < record.mem_count; r++)
+                {
+                    line += fmt::format("{}{:02X}", r == 0 ? "" : " ", record.v[r]);
+                }
+            }
+        }
+
+        line += fmt::format(" SP={} DT={} ST={}", record.sp, record.delay_timer, record.sound_timer);
+        if (record.flags & TraceRecord::DREW)
+        {
+            line += " draw";
+        }
+        if (record.flags & TraceRecord::BLOCKED)
+        {
+            line += " blocked";
+        }
+        return line;
+    }
+
+    // Names of the fields in which a and b differ
+    std::string Differences(const TraceRecord& a, const TraceRecord& b)
+    {
+        std::string fields;
+        auto add = [&fields](bool differs, std::string_view name)
+        {
+            if (differs)
+            {
+                fields += fields.empty() ? "" : ", ";
+                fields += name;
+            }
+        };
+        add(a.cycle != b.cycle, "cycle");
+        add(a.pc != b.pc, "PC");
+        add(a.opcode != b.opcode, "opcode");
+        add(a.i != b.i, "I");
+        for (int r = 0; r < 16; r++)
+        {
+            add(a.v[r] != b.v[r], fmt::format("V{:X}", r));
+        }
+        add(a.mem_addr != b.mem_addr || a.mem_count != b.mem_count, "memory write");
+        add(a.sp != b.sp, "SP");
+        add(a.delay_timer != b.delay_timer, "DT");
+        add(a.sound_timer != b.sound_timer, "ST");
+        add(a.flags != b.flags, "flags");
+        return fields;
+    }
+
+    void PrintHeader(const std::string& path, const TraceReader& reader)
+    {
+        const TraceHeader& header = reader.Header();
+        fmt::print("{}: {} instructions, rom {:016x}, seed {}, {} Hz\n",
+            path, reader.Records(), header.rom_hash, header.seed, header.clock_hz);
+    }
+
+    int Dump(int argc, char* argv[])
+    {
+        const std::string path = argv[2];
+        Filter filter;
+        for (int i = 3; i < argc; i += 2)
+        {
+            const std::string_view arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                Usage();
+                return 1;
+            }
+
+            const std::string_view value = argv[i + 1];
+            bool ok = true;
+            if (arg == "--pc")
+            {
+                ok = ParsePcRange(value, filter);
+            }
+            else if (arg == "--op")
+            {
+                ok = ParseOp(value, filter);
+            }
+            else if (arg == "--from")
+            {
+                ok = tool_args::ParseCount(value, filter.from);
+            }
+            else if (arg == "--count")
+            {
+                ok = tool_args::ParseCount(value, filter.count);
+            }
+            else
+            {
+                Usage();
+                return 1;
+            }
+            if (!ok)
+            {
+                logger::Error("Invalid value for {}: {}", arg, value);
+                return 1;
+            }
+        }
+
+        TraceReader reader;
+        if (!reader.Open(path))
+        {
+            return 1;
+        }
+        PrintHeader(path, reader);
+
+        TraceRecord record;
+        uint64_t printed = 0;
+        while (printed < filter.count && reader.Next(record))
+        {
+            if (filter.Matches(record))
+            {
+                fmt::print("{}\n", Format(record));
+                printed++;
+            }
+        }
+        return 0;
+    }
+
+    int Diff(int argc, char* argv[])
+    {
+        if (argc < 4)
+        {
+            Usage();
+            return 1;
+        }
+        const std::string path_a = argv[2];
+        const std::string path_b = argv[3];
+        uint64_t context = DEFAULT_CONTEXT;
+        for (int i = 4; i < argc; i += 2)
+        {
+            if (std::string_view(argv[i]) != "--context" || i + 1 >= argc)
+            {
+                Usage();
+                return 1;
+            }
+            if (!tool_args::ParseCount(argv[i + 1], context))
+            {
+                logger::Error("Invalid number for --context: {}", argv[i + 1]);
+                return 1;
+            }
+        }
+
+        TraceReader a;
+        TraceReader b;
+        if (!a.Open(path_a) || !b.Open(path_b))
+        {
+            return 1;
+        }
+        PrintHeader(path_a, a);
+        PrintHeader(path_b, b);
+
+        std::deque<TraceRecord> before;
+        TraceRecord ra;
+        TraceRecord rb;
+        for (uint64_t n = 0;; n++)
+        {
+            const bool has_a = a.Next(ra);
+            const bool has_b = b.Next(rb);
+            if (!has_a && !has_b)
+            {
+                fmt::print("traces match: {} instructions\n", n);
+                return 0;
+            }
+
+            if (has_a && has_b && std::memcmp(&ra, &rb, sizeof(TraceRecord)) == 0)
+            {
+                before.push_back(ra);
+                if (before.size() > context)
+                {
+                    before.pop_front();
+                }
+                continue;
+            }
+
+            fmt::print("traces differ at instruction {}", n);
+            if (has_a && has_b)
+            {
+                fmt::print(" ({})", Differences(ra, rb));
+            }
+            fmt::print("\n");
+            for (const TraceRecord& record : before)
+            {
+                fmt::print("  {}\n", Format(record));
+            }
+            fmt::print("a {}\n", has_a ? Format(ra) : "(end of trace)");
+            fmt::print("b {}\n", has_b ? Format(rb) : "(end of trace)");
+            return 1;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        Usage();
+        return 1;
+    }
+
+    const std::string_view command = argv[1];
+    if (command == "dump")
+    {
+        return Dump(argc, argv);
+    }
+    if (command == "diff")
+    {
+        return Diff(argc, argv);
+    }
+    Usage();
+    return 1;
+}